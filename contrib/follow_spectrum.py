@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+import argparse
+import mmap
+import struct
+import time
+
+import numpy as np
+
+from spectrum_parser import parse_header
+
+
+class SpectrumRing:
+    """Reader of the shared memory ring published by `rffft -M <name>`"""
+
+    HEADER = struct.Struct('<8sIIQQ')
+    SLOT = struct.Struct('<QQ')
+
+    def __init__(self, name):
+        with open('/dev/shm/' + name.lstrip('/'), 'rb') as f:
+            self.map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, version, self.nslot, self.slotsize, _ = self.HEADER.unpack_from(self.map, 0)
+        if magic != b'RFFFTSHM' or version != 1:
+            raise ValueError('{} is not an rffft ring of version 1'.format(name))
+
+    def count(self):
+        return self.HEADER.unpack_from(self.map, 0)[4]
+
+    def read(self, n):
+        """Subint n as (header, power), None if it is not published yet.
+        Raises KeyError if it was overwritten."""
+        offset = 64 + (n % self.nslot) * self.slotsize
+        seq, size = self.SLOT.unpack_from(self.map, offset)
+        if seq < 2 * n + 2:
+            return None
+        data = self.map[offset + 16:offset + 16 + size]
+        if seq > 2 * n + 2 or self.SLOT.unpack_from(self.map, offset)[0] != seq:
+            raise KeyError(n)
+        header = parse_header(data[:256])
+        dtype = np.int8 if b'NBITS         8' in data[:256] else np.float32
+        return header, np.frombuffer(data[256:], dtype=dtype)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Follow the live spectra of rffft -M <name>')
+    parser.add_argument('name',
+                        type=str,
+                        help='Name of the shared memory ring')
+    args = parser.parse_args()
+
+    ring = SpectrumRing(args.name)
+    n = ring.count()
+    while True:
+        try:
+            subint = ring.read(n)
+        except KeyError:
+            print('Subint {} overwritten, skipping to the latest'.format(n))
+            n = ring.count()
+            continue
+        if subint is None:
+            time.sleep(0.1)
+            continue
+        header, z = subint
+        print('{} {:.6f} MHz {} channels, mean power {:.4g}'.format(header['utc_start'].isoformat(), header['freq'] * 1e-6, len(z), z.mean()))
+        n += 1
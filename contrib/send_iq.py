@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+import argparse
+import socket
+import struct
+import time
+
+
+def datagrams(f, size, seq):
+    """Payloads of size bytes, prefixed by a 64 bit little endian sequence number"""
+    n = 0
+    while True:
+        data = f.read(size)
+        if not data:
+            return
+        yield (struct.pack('<Q', n) + data) if seq else data
+        n += 1
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Stream a raw IQ recording to `rffft -i tcp://... or udp://...`')
+    parser.add_argument('filename',
+                        type=str,
+                        help='Raw IQ recording')
+    parser.add_argument('url',
+                        type=str,
+                        help='tcp://<host>:<port> to serve the samples to one client, or udp://<host>:<port>[?seq] to send datagrams')
+    parser.add_argument('--rate',
+                        type=float,
+                        default=0.0,
+                        help='Bytes per second to pace the stream at [0: as fast as possible]')
+    parser.add_argument('--size',
+                        type=int,
+                        default=4096,
+                        help='Payload bytes per datagram or send call')
+    parser.add_argument('--drop',
+                        type=float,
+                        default=0.0,
+                        help='Fraction of datagrams to drop, to exercise the jitter buffer')
+    args = parser.parse_args()
+
+    scheme, address = args.url.split('://')
+    seq = address.endswith('?seq')
+    host, port = address.replace('?seq', '').rsplit(':', 1)
+    port = int(port)
+
+    if scheme == 'tcp':
+        server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        server.bind((host, port))
+        server.listen(1)
+        sock, _ = server.accept()
+    elif scheme == 'udp':
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    else:
+        raise ValueError('Unknown scheme {}'.format(scheme))
+
+    sent = 0
+    start = time.time()
+    with open(args.filename, 'rb') as f:
+        for n, data in enumerate(datagrams(f, args.size, seq and scheme == 'udp')):
+            if args.drop > 0 and int((n + 1) * args.drop) > int(n * args.drop):
+                continue
+            if scheme == 'tcp':
+                sock.sendall(data)
+            else:
+                sock.sendto(data, (host, port))
+            sent += args.size
+            if args.rate > 0:
+                delay = start + sent / args.rate - time.time()
+                if delay > 0:
+                    time.sleep(delay)
+    sock.close()
@@ -39,7 +39,8 @@ def parse_header(header_b):
 
     header_s = header_b.decode('ASCII').strip('\x00')
 
-    regex = r"^HEADER\nUTC_START    (.*)\nFREQ         (.*) Hz\nBW           (.*) Hz\nLENGTH       (.*) s\nNCHAN        (.*)\nNSUB         (.*)\nEND\n$"
+    # Realtime files may carry further keywords (DRIFT, GAPS, ...) before END
+    regex = r"^HEADER\nUTC_START    (.*)\nFREQ         (.*) Hz\nBW           (.*) Hz\nLENGTH       (.*) s\nNCHAN        (.*)\nNSUB         (.*)\n(?:.*\n)*?END\n$"
     match = re.fullmatch(regex, header_s, re.MULTILINE)
 
     utc_start = datetime.strptime(match.group(1), '%Y-%m-%dT%H:%M:%S.%f')
@@ -4,6 +4,7 @@
 #include <math.h>
 #include <cpgplot.h>
 #include <getopt.h>
+#include "rftime.h"
 #include "rfio.h"
 
 #define LIM 128
@@ -17,8 +18,11 @@ void usage(void)
   printf("-O <file>    Output file name [test_000000.bin]\n");
   printf("-s <start>   Number of starting subintegration [0]\n");
   printf("-l <length>  Number of subintegrations to plot [3600]\n");
+  printf("-T <start>   Start time (YYYY-MM-DDTHH:MM:SS.sss) instead of -s, found in <path>.idx\n");
+  printf("-E <end>     End time instead of -l\n");
   printf("-o <offset>  Frequency offset to apply (Hz) [0.0]\n");
   printf("-b <nbin>    Number of subintegrations to bin [1]\n");
+  printf("-j <threads> Threads loading the files when binning or zooming [one per processor]\n");
   printf("-f <freq>    Frequency to zoom into (Hz)\n");
   printf("-w <bw>      Bandwidth to zoom into (Hz)\n");
   printf("-h           This help\n");
@@ -31,11 +35,11 @@ int main(int argc,char *argv[])
   struct spectrogram s;
   char path[128],outfile[128]="test";
   int arg=0,nsub=3600,nbin=1,isub=0;
-  double f0=0.0,df0=0.0,foff=0.0;
+  double f0=0.0,df0=0.0,foff=0.0,mjd0=0.0,mjd1=0.0;
 
   // Read arguments
   if (argc>1) {
-    while ((arg=getopt(argc,argv,"p:o:O:f:w:s:l:b:h"))!=-1) {
+    while ((arg=getopt(argc,argv,"p:o:O:f:w:s:l:b:hT:E:j:"))!=-1) {
       switch (arg) {
 	
       case 'p':
@@ -53,6 +57,18 @@ int main(int argc,char *argv[])
       case 's':
 	isub=atoi(optarg);
 	break;
+
+      case 'j':
+	set_spectrogram_threads(atoi(optarg));
+	break;
+
+      case 'T':
+	mjd0=nfd2mjd(optarg);
+	break;
+
+      case 'E':
+	mjd1=nfd2mjd(optarg);
+	break;
 	
       case 'l':
 	nsub=atoi(optarg);
@@ -85,7 +101,16 @@ int main(int argc,char *argv[])
   }
 
   // Read data
-  s=read_spectrogram(path,isub,nsub,f0,df0,nbin,foff);
+  if (mjd0>0.0)
+    s=read_spectrogram_mjd(path,mjd0,mjd1,nsub,f0,df0,nbin,foff);
+  else
+    s=read_spectrogram(path,isub,nsub,f0,df0,nbin,foff);
+
+  // Exit on empty data
+  if (s.nsub==0) {
+    fprintf(stderr,"No subints to write\n");
+    return 1;
+  }
 
   // Write data
   write_spectrogram(s,outfile);
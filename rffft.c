@@ -2,20 +2,914 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <fftw3.h>
 #include <getopt.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zstd.h>
 #include "rftime.h"
-
-#include <sox.h>
+#include "rfio.h"
 
 #include "rffft_internal.h"
+#include "rffft_pipeline.h"
+#include "rffft_writer.h"
+#include "rffft_shm.h"
+#include "rffft_net.h"
+#include "rffft_ddc.h"
+
+// Maximum number of output products
+#define MAXPRODUCT 8
+
+// Outputs, products with their peak, minimum and kurtosis planes
+#define MAXOUTPUT (4*MAXPRODUCT)
+
+static const char *planename[]={"mean","peak","min","sk"};
+
+// Subints kept in a shared memory ring
+#define SHMSLOTS 64
+
+// Sample clock of a realtime FFT stream. Times follow from the sample
+// counter, anchored to the wall clock at the time sample 0 was taken.
+// Every wall clock reading gives an estimate of that time that is late by
+// the latency of the input, so the earliest estimate is kept. A re-sync
+// moves the anchor to the earliest estimate since the previous re-sync,
+// which follows dropped samples and sample rate errors.
+struct clock {
+  double fs;                 // Sample rate (Hz)
+  double tsub;               // Duration of a subint (s)
+  double tsync;              // Re-sync interval (s) [0: never]
+  double t0;                 // Wall clock time of sample 0 (s)
+  double tmin;               // Earliest estimate of t0 since the last re-sync
+  double tlast;              // Wall clock time of the last re-sync (s)
+  double drift;              // Lag of the last subint behind the sample clock (s)
+  double gap;                // Summed forward jumps at re-syncs (s)
+  int nobs;                  // Number of subints seen
+  int ngap;                  // Number of forward jumps at re-syncs
+  int nbehind;               // Subints read more than a subint late
+};
+
+// Output settings and state shared with the pipeline callbacks
+struct output {
+  char path[64],prefix[32],output[128],outfname[128];
+  int useoutput,m,nsub,nchan,nuse,nover,realtime,quiet,partial,imin,imax,fac;
+  int adapt;                 // nuse is adapted to the load
+  int plane;                 // Stored plane: 0 mean, 1 peak, 2 minimum power,
+                             // 3 spectral kurtosis
+  char outformat;
+  double mjd,freq,samp_rate,freqmin,freqmax;
+  float fchan,tint;
+  int nint;
+  char *cz;
+  double flen,fsize;         // File duration (s) and size (bytes) [0: nsub]
+  struct rffft_writer *writer;
+  struct rffft_wfile *outfile;
+  char shmname[64];          // Shared memory ring to publish to [empty: none]
+  struct rffft_shm *shm;
+  int idx;                   // Index of the subints [-1: none]
+  const struct rffft_sigmf *sigmf; // Recording whose segments jump in time [NULL: none]
+  long sub0;                 // Subint index of input sample 0
+  long nsamp;                // Input samples per subint
+
+  // Binning of the FFT stream this product is derived from
+  int nbin,ntime;            // Channels and subints per output sample
+  int nacc,nframe,nfft;      // Subints, spectra and transformed spectra so far
+  long nblank,nexam;         // Samples blanked, of those examined so far
+  struct timeval start;      // Start of the first accumulated subint
+  long isamp;                // First sample of the first accumulated subint
+  float *zb;                 // Accumulated power, nchan channels; for
+                             // kurtosis the squared, then the plain power
+  struct clock *clk;         // Sample clock of the FFT stream
+};
+
+// FFT stream, feeding one or more output products
+struct stream {
+  struct rffft_pipeline pipe;
+  struct clock clk;
+  float *zw;
+  int nout;
+  struct output *out[MAXOUTPUT];
+  pthread_t thread;
+};
+
+// Input state shared with the pipeline reader
+struct input {
+  char informat;
+  FILE *file;
+  struct rffft_ddc *ddc;  // Down-converter [NULL: off]
+  char *raw;              // Raw samples for the down-converter
+  int nraw;               // Capacity of raw, in output samples
+  const char *map;        // Mapped input file [NULL: buffered reads]
+  int64_t mapsize;        // End of the mapped samples (bytes)
+  int64_t start,end;      // Start and end of the samples (bytes) [end -1: unknown]
+  int64_t pos;            // Read position (bytes)
+  ZSTD_DCtx *zstd;        // Decompressor of .ziq files [NULL: uncompressed]
+  ZSTD_inBuffer zin;      // Compressed data read so far
+  char *zbuf;
+  struct rffft_net *net;  // Network input [NULL: file]
+  const struct rffft_sigmf *sigmf; // SigMF recording [NULL: none]
+  int64_t isamp;          // Samples read, to find the segments of SigMF recordings
+};
+
+// Position of sample n of the input (bytes), past the header bytes of
+// the segments of SigMF recordings
+int64_t input_offset(struct input *in,int64_t n)
+{
+  if (in->sigmf!=NULL)
+    return rffft_sigmf_offset(in->sigmf,n);
+
+  return in->start+n*rffft_sample_size(in->informat);
+}
+
+// Number of samples in the input file ending at byte end
+int64_t input_samples(struct input *in,int64_t end)
+{
+  const struct rffft_sigmf_capture *c;
+
+  if (in->sigmf!=NULL) {
+    c=&in->sigmf->capture[in->sigmf->ncapture-1];
+    return c->sample_start+(end-c->offset)/rffft_sample_size(in->informat);
+  }
+
+  return (end-in->start)/rffft_sample_size(in->informat);
+}
+
+// Map a regular input file, so samples are unpacked straight from the page
+// cache. Fifos and stdin keep using buffered reads.
+void map_input(struct input *in)
+{
+  struct stat sb;
+  void *ptr;
+
+  in->map=NULL;
+  if (in->file==NULL || in->zstd!=NULL || (in->sigmf!=NULL && in->sigmf->gaps) || fstat(fileno(in->file),&sb)!=0 || !S_ISREG(sb.st_mode) || sb.st_size==0)
+    return;
+
+  in->mapsize=(in->end>=0 && in->end<sb.st_size) ? in->end : sb.st_size;
+  ptr=mmap(NULL,in->mapsize,PROT_READ,MAP_SHARED,fileno(in->file),0);
+  if (ptr==MAP_FAILED)
+    return;
+
+  // Read ahead aggressively and drop pages once passed; huge pages are
+  // only a hint, not every kernel supports them for files
+  madvise(ptr,in->mapsize,MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+  madvise(ptr,in->mapsize,MADV_HUGEPAGE);
+#endif
+
+  in->map=(const char *) ptr;
+
+  return;
+}
+
+// Point at up to nsamp raw complex samples of the mapped input
+int map_raw(void *ctx,const char **ptr,int nsamp)
+{
+  struct input *in=(struct input *) ctx;
+  int64_t n,size=rffft_sample_size(in->informat);
+
+  n=(in->mapsize>in->pos) ? (in->mapsize-in->pos)/size : 0;
+  if (n>nsamp)
+    n=nsamp;
+  *ptr=in->map+in->pos;
+  in->pos+=n*size;
+
+  return (int) n;
+}
+
+// Decompress up to nsamp raw complex samples of a .ziq file
+int read_zstd(struct input *in,void *buffer,int nsamp)
+{
+  ZSTD_outBuffer zout;
+  size_t ret;
+
+  zout.dst=buffer;
+  zout.size=(size_t) nsamp*rffft_sample_size(in->informat);
+  zout.pos=0;
+  while (zout.pos<zout.size) {
+    if (in->zin.pos==in->zin.size) {
+      in->zin.size=fread(in->zbuf,1,ZSTD_DStreamInSize(),in->file);
+      in->zin.pos=0;
+      if (in->zin.size==0)
+	break;
+    }
+    ret=ZSTD_decompressStream(in->zstd,&zout,&in->zin);
+    if (ZSTD_isError(ret)) {
+      fprintf(stderr,"Error decompressing input: %s\n",ZSTD_getErrorName(ret));
+      break;
+    }
+  }
+
+  // A partial sample can only remain at the end of the input
+  return zout.pos/rffft_sample_size(in->informat);
+}
+
+// Read up to nsamp raw complex samples of a SigMF recording, skipping
+// the header bytes that precede its segments
+int read_segments(struct input *in,void *buffer,int nsamp)
+{
+  const struct rffft_sigmf *sigmf=in->sigmf;
+  int64_t pos,left;
+  int k,n,m,size=rffft_sample_size(in->informat);
+
+  for (n=0;n<nsamp;n+=m) {
+    pos=rffft_sigmf_offset(sigmf,in->isamp);
+    if (pos!=in->pos) {
+      if (fseeko(in->file,(off_t) pos,SEEK_SET)!=0)
+	break;
+      in->pos=pos;
+    }
+
+    // Up to the start of the next segment
+    m=nsamp-n;
+    k=rffft_sigmf_segment(sigmf,in->isamp);
+    if (k+1<sigmf->ncapture) {
+      left=sigmf->capture[k+1].sample_start-in->isamp;
+      if (left<m)
+	m=(int) left;
+    }
+    m=fread((char *) buffer+(size_t) n*size,size,m,in->file);
+    in->pos+=(int64_t) m*size;
+    in->isamp+=m;
+    if (m==0)
+      break;
+  }
+
+  return n;
+}
+
+// Read up to nsamp raw complex samples
+int read_raw(struct input *in,void *buffer,int nsamp)
+{
+  const char *ptr;
+  int n,size=rffft_sample_size(in->informat);
+
+  if (in->map!=NULL) {
+    n=map_raw(in,&ptr,nsamp);
+    memcpy(buffer,ptr,(size_t) n*size);
+    return n;
+  }
+  if (in->zstd!=NULL)
+    return read_zstd(in,buffer,nsamp);
+  if (in->net!=NULL)
+    return rffft_net_read(in->net,buffer,nsamp);
+  if (in->sigmf!=NULL && in->sigmf->gaps)
+    return read_segments(in,buffer,nsamp);
+
+  // Stop at the end of the samples of a WAV file
+  if (in->end>=0 && (in->end-in->pos)/size<nsamp)
+    nsamp=(in->end>in->pos) ? (in->end-in->pos)/size : 0;
+
+  n=fread(buffer,size,nsamp,in->file);
+  in->pos+=(int64_t) n*size;
+
+  return n;
+}
+
+// Skip nsamp raw complex samples, seeking where the input allows it
+void skip_input(struct input *in,long nsamp)
+{
+  int64_t size=rffft_sample_size(in->informat);
+  char *buffer;
+  int n;
+
+  if (in->map!=NULL) {
+    in->pos=(in->pos+nsamp*size<in->mapsize) ? in->pos+nsamp*size : in->mapsize;
+    return;
+  }
+  if (in->end>=0 && in->pos+nsamp*size>in->end)
+    nsamp=(in->end-in->pos)/size;
+  if (in->sigmf!=NULL && in->sigmf->gaps) {
+    in->isamp+=nsamp;
+    return;
+  }
+  if (in->zstd==NULL && in->net==NULL && fseeko(in->file,(off_t) (nsamp*size),SEEK_CUR)==0) {
+    in->pos+=nsamp*size;
+    return;
+  }
+
+  // Read and discard
+  buffer=(char *) malloc(65536*size);
+  for (;nsamp>0;nsamp-=n) {
+    n=read_raw(in,buffer,(nsamp<65536) ? nsamp : 65536);
+    if (n<=0)
+      break;
+  }
+  free(buffer);
+
+  return;
+}
+
+// Read up to nsamp complex samples, down-converted if requested
+int read_input(void *ctx,void *buffer,int nsamp)
+{
+  struct input *in=(struct input *) ctx;
+  const char *raw;
+  int n;
+
+  if (in->ddc==NULL)
+    return read_raw(in,buffer,nsamp);
+
+  // Down-convert at most nraw samples at a time, straight from the
+  // mapped input if there is one
+  if (nsamp>in->nraw)
+    nsamp=in->nraw;
+  if (in->map!=NULL) {
+    n=map_raw(in,&raw,nsamp*in->ddc->ndec)/in->ddc->ndec;
+  } else {
+    n=read_raw(in,in->raw,nsamp*in->ddc->ndec)/in->ddc->ndec;
+    raw=in->raw;
+  }
+  if (n>0)
+    rffft_ddc_process(in->ddc,raw,n,(float *) buffer);
+
+  return n;
+}
+
+// Update the sample clock with the wall clock time a subint was read
+void clock_update(struct clock *c,struct rffft_subint *s)
+{
+  double t,t0;
+
+  // Estimate of the time of sample 0
+  t=s->end.tv_sec+1e-6*s->end.tv_usec;
+  t0=t-s->nread/c->fs;
+  if (c->nobs++==0) {
+    c->t0=t0;
+    c->tmin=t0;
+    c->tlast=t;
+  }
+  if (t0<c->t0)
+    c->t0=t0;
+  if (t0<c->tmin)
+    c->tmin=t0;
+
+  // Reading is behind once more than a subint of samples is waiting
+  c->drift=t0-c->t0;
+  if (c->drift>c->tsub)
+    c->nbehind++;
+
+  // Re-sync; jumps beyond what a 100 ppm sample clock error explains are
+  // counted as gaps
+  if (c->tsync>0.0 && t-c->tlast>=c->tsync) {
+    if (c->tmin-c->t0>1e-4*(t-c->tlast)) {
+      c->ngap++;
+      c->gap+=c->tmin-c->t0;
+    }
+    c->t0=c->tmin;
+    c->tmin=t0;
+    c->tlast=t;
+    c->drift=t0-c->t0;
+  }
+
+  return;
+}
+
+// Time (s) by which the segment of a SigMF recording holding subint isub
+// starts later than it would if the samples were contiguous in time
+double capture_jump(struct output *out,long isub)
+{
+  int64_t n=(int64_t) (isub-out->sub0)*out->nsamp;
+
+  return rffft_sigmf_time(out->sigmf,n)-rffft_sigmf_time(out->sigmf,0)-n/out->sigmf->samp_rate;
+}
+
+// Scale, format and store a subintegration
+void write_subint(void *ctx,struct rffft_subint *s)
+{
+  struct output *out=(struct output *) ctx;
+  int i,k,m,n,nchan=out->nchan;
+  size_t size;
+  const char *data;
+  float *z=s->z,length,zavg,zstd,fuse;
+  char *cz=out->cz;
+  char tbuf[30],nfd[32],header[512]="",stats[256]="";
+  double t,mjd;
+  time_t tsec;
+  struct spectrogram_index r;
+
+  // File and subint number
+  m=out->m+s->isub/out->nsub;
+  k=s->isub%out->nsub;
+
+  // Open file
+  if (k==0) {
+    if (out->outfile!=NULL)
+      rffft_writer_close(out->writer,out->outfile);
+    if (out->useoutput==0) {
+      sprintf(out->outfname,"%s/%s_%06d.bin",out->path,out->prefix,m);
+    } else {
+      sprintf(out->outfname,"%s/%s_%06d.bin",out->path,out->output,m);
+    }
+    out->outfile=rffft_writer_open(out->writer,out->outfname);
+  }
+
+  // Duration of the samples, nbin*nchan/nover between spectra
+  length=(double) s->nframe*nchan*out->nbin/out->nover/out->clk->fs;
+
+  // Scale, overlapping spectra add nover times as many spectra, and the
+  // spectra of binned products are nbin times longer. With load shedding
+  // the fraction of spectra transformed varies between subints.
+  fuse=(out->adapt && s->nfft>0) ? (float) s->nframe/(float) s->nfft : (float) out->nuse;
+  if (out->plane!=3) {
+    for (i=0;i<nchan;i++) 
+      z[i]*=fuse/(float) (nchan*out->nbin*out->nover);
+  }
+
+  // Scale to bytes
+  if (out->outformat=='c') {
+    // Compute average
+    for (i=0,zavg=0.0;i<nchan;i++)
+      zavg+=z[i];
+    zavg/=(float) nchan;
+	
+    // Compute standard deviation
+    for (i=0,zstd=0.0;i<nchan;i++)
+      zstd+=pow(z[i]-zavg,2);
+    zstd=sqrt(zstd/(float) nchan);
+
+    // Convert
+    for (i=0;i<nchan;i++) {
+      z[i]=256.0/6.0*(z[i]-zavg)/zstd;
+      if (z[i]<-128.0)
+	z[i]=-128.0;
+      if (z[i]>127.0)
+	z[i]=127.0;
+      cz[i]=(char) z[i];
+    }
+  }
+
+  // Fraction of the samples blanked as impulses
+  if (out->outformat=='f' && s->nexam>0)
+    sprintf(stats,"BLANKED      %f\n",(double) s->nblank/s->nexam);
+
+  // Format start time, from the sample clock
+  if (out->realtime==1) {
+    t=out->clk->t0+s->isamp/out->clk->fs;
+    tsec=(time_t) floor(t);
+    strftime(tbuf,30,"%Y-%m-%dT%T",gmtime(&tsec));
+    sprintf(nfd,"%s.%03d",tbuf,(int) floor(1000.0*(t-tsec)));
+
+    // Duration of the samples covered by the transformed spectra
+    if (out->outformat=='f' && out->adapt) {
+      t=(double) s->nfft*nchan*out->nbin/out->clk->fs;
+      sprintf(stats+strlen(stats),"INTEG        %f s\n",(t<length) ? t : length);
+    }
+
+    // Clock statistics of the run so far, only float headers have room
+    // for them, and they are the first to go if the header is full
+    if (out->outformat=='f')
+      sprintf(stats+strlen(stats),"DRIFT        %f s\nGAPS         %d %f s\nBEHIND       %d\n",out->clk->drift,out->clk->ngap,out->clk->gap,out->clk->nbehind);
+  } else {
+    mjd=out->mjd+(m*out->nsub+k)*out->tint/86400.0;
+    if (out->sigmf!=NULL)
+      mjd+=capture_jump(out,(long) m*out->nsub+k)/86400.0;
+    mjd2nfd(mjd,nfd); 
+    length=out->tint;
+  }
+
+  // Header, float headers end with as many of the statistics as fit
+  if (out->partial==0) {
+    if (out->outformat=='f') 
+      sprintf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\n",nfd,out->freq,out->samp_rate/out->fac,length,nchan,out->nsub);
+    else if (out->outformat=='c')
+      sprintf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\nNBITS         8\nMEAN         %e\nRMS          %e\nEND\n",nfd,out->freq,out->samp_rate/out->fac,length,nchan,out->nsub,zavg,zstd);
+  } else if (out->partial==1) {
+    if (out->outformat=='f') 
+      sprintf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\n",nfd,0.5*(out->freqmax+out->freqmin),(out->freqmax-out->freqmin)/out->fac,length,out->imax-out->imin,out->nsub);
+    else if (out->outformat=='c')
+      sprintf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\nNBITS         8\nMEAN         %e\nRMS          %e\nEND\n",nfd,0.5*(out->freqmax+out->freqmin),(out->freqmax-out->freqmin)/out->fac,length,out->imax-out->imin,out->nsub,zavg,zstd);
+  }
+  if (out->outformat=='f')
+    rffft_header_stats(header,stats);
+  // Limit output
+  if (!out->quiet)
+    printf("%s %s %f %d\n",out->outfname,nfd,length,s->nframe);
+
+  // Stored channels
+  i=(out->partial==1) ? out->imin : 0;
+  n=(out->partial==1) ? out->imax-out->imin : nchan;
+  if (out->outformat=='f') {
+    data=(const char *) &z[i];
+    size=sizeof(float)*n;
+  } else {
+    data=&cz[i];
+    size=sizeof(char)*n;
+  }
+
+  // Dump file, and publish to live consumers
+  rffft_writer_write(out->writer,out->outfile,header,256);
+  rffft_writer_write(out->writer,out->outfile,data,size);
+  if (out->shm!=NULL)
+    rffft_shm_publish(out->shm,header,data,size);
+
+  // Index the subint, chunks write their records independently
+  if (out->idx>=0) {
+    r.file=m;
+    r.nchan=n;
+    r.offset=(int64_t) k*(256+size);
+    r.mjd=nfd2mjd(nfd);
+    r.length=length;
+    r.nbits=(out->outformat=='c') ? 8 : 32;
+    write_index(out->idx,out->nsub,k,&r);
+  }
+
+  return;
+}
+
+// Clear the accumulated power of a product
+void clear_bins(struct output *out)
+{
+  int j;
+
+  for (j=0;j<out->nchan;j++)
+    out->zb[j]=(out->plane==2) ? HUGE_VALF : 0.0;
+  if (out->plane==3) {
+    for (j=0;j<out->nchan;j++)
+      out->zb[out->nchan+j]=0.0;
+  }
+
+  return;
+}
+
+// Bin a subintegration of an FFT stream into the channels and integration
+// time of a product, and store it once complete. Planes other than the
+// mean are only kept for products with the channels of their FFT stream.
+void bin_subint(struct output *out,struct rffft_subint *s)
+{
+  int i,j,l,nfft=out->nchan*out->nbin;
+  float sum,*z=s->z+(size_t) out->plane*nfft;
+  double m,s1;
+  struct rffft_subint sb;
+
+  // Add, with the bins centred on the channels of a direct FFT
+  if (out->nacc==0) {
+    out->start=s->start;
+    out->isamp=s->isamp;
+  }
+  for (j=0;j<out->nchan;j++) {
+    for (i=0,sum=0.0;i<out->nbin;i++) {
+      l=(j*out->nbin+i-out->nbin/2+nfft)%nfft;
+      sum+=z[l];
+    }
+    if (out->plane==1) {
+      if (sum>out->zb[j])
+	out->zb[j]=sum;
+    } else if (out->plane==2) {
+      if (sum<out->zb[j])
+	out->zb[j]=sum;
+    } else {
+      out->zb[j]+=sum;
+    }
+  }
+  if (out->plane==3) {
+    for (j=0;j<out->nchan;j++)
+      out->zb[out->nchan+j]+=s->z[j];
+  }
+  out->nacc++;
+  out->nframe+=s->nframe;
+  out->nfft+=s->nfft;
+  out->nblank+=s->nblank;
+  out->nexam+=s->nexam;
+
+  if (out->nacc<out->ntime && s->last==0)
+    return;
+
+  // Peak and minimum power in the units of the mean. Spectral kurtosis
+  // from the sums of the power and its square over m spectra, 1 for
+  // Gaussian noise, above for impulsive and below for steady signals.
+  m=out->nfft;
+  if (out->plane==1 || out->plane==2) {
+    for (j=0;j<out->nchan;j++)
+      out->zb[j]=(m>0.0) ? out->zb[j]*m : 0.0;
+  } else if (out->plane==3) {
+    for (j=0;j<out->nchan;j++) {
+      s1=out->zb[out->nchan+j];
+      out->zb[j]=(m>1.0 && s1>0.0) ? (m+1.0)/(m-1.0)*(m*out->zb[j]/(s1*s1)-1.0) : 0.0;
+    }
+  }
+
+  // Store
+  sb.isub=s->isub/out->ntime;
+  sb.nframe=out->nframe;
+  sb.nfft=out->nfft;
+  sb.nblank=out->nblank;
+  sb.nexam=out->nexam;
+  sb.nuse=s->nuse;
+  sb.last=s->last;
+  sb.start=out->start;
+  sb.end=s->end;
+  sb.isamp=out->isamp;
+  sb.nread=s->nread;
+  sb.z=out->zb;
+  write_subint(out,&sb);
+
+  // Reset
+  clear_bins(out);
+  out->nacc=0;
+  out->nframe=0;
+  out->nfft=0;
+  out->nblank=0;
+  out->nexam=0;
+
+  return;
+}
+
+// Store a subintegration of an FFT stream in all its products
+void write_stream(void *ctx,struct rffft_subint *s)
+{
+  struct stream *st=(struct stream *) ctx;
+  int i;
+
+  if (st->out[0]->realtime==1)
+    clock_update(&st->clk,s);
+  for (i=0;i<st->nout;i++)
+    bin_subint(st->out[i],s);
+
+  return;
+}
+
+// Run the pipeline of an FFT stream
+void *stream_thread(void *arg)
+{
+  struct stream *st=(struct stream *) arg;
+
+  rffft_pipeline_run(&st->pipe);
+
+  // A time window may end the stream before the input, the tee must not
+  // wait for it
+  if (st->pipe.read==rffft_tee_read)
+    rffft_tee_close(st->pipe.input);
+
+  return NULL;
+}
+
+// Offline processing of a recording in independent chunks. Every chunk
+// holds a whole number of files of every product and is FFT'd by a
+// pipeline of its own, reading the file from its own offset.
+struct chunks {
+  struct stream *st;         // FFT stream and products to run
+  struct input *in;          // Input, shared if mapped
+  char *infname;
+  long skip;                 // Samples before the first chunk
+  int size;                  // Bytes per input sample
+  int nhist;                 // Samples read before the first spectrum
+  long nunit;                // Number of chunks
+  long nsubunit;             // FFT stream subints per chunk
+  long nsamp;                // Samples per chunk
+  long nsublast;             // FFT stream subints of the last chunk [0: to the end]
+  long next;                 // Next chunk to process
+  long nread;                // Samples read, without the repeated history
+  double tbusy;              // Summed FFT CPU time (s)
+  long nblank,nexam;         // Samples blanked, of those examined
+  pthread_mutex_t lock;
+};
+
+// Sample of a recording t seconds after its start, following the capture
+// times of SigMF recordings
+int64_t window_sample(const struct rffft_sigmf *sigmf,double t,double samp_rate)
+{
+  if (sigmf!=NULL)
+    return rffft_sigmf_sample(sigmf,rffft_sigmf_time(sigmf,0)+t);
+
+  return (t>0.0) ? (int64_t) floor(t*samp_rate+0.5) : 0;
+}
+
+// Process chunks until none are left
+void *chunk_thread(void *arg)
+{
+  struct chunks *c=(struct chunks *) arg;
+  struct stream st=*c->st;
+  struct output out[MAXOUTPUT],*o;
+  struct input in;
+  long u;
+  int k;
+
+  // Private copies of the products
+  for (k=0;k<st.nout;k++) {
+    out[k]=*c->st->out[k];
+    out[k].cz=(char *) malloc(sizeof(char)*out[k].nchan);
+    out[k].zb=(float *) malloc(sizeof(float)*2*out[k].nchan);
+    st.out[k]=&out[k];
+  }
+
+  // Private read position in the mapping, or a file of its own
+  in=*c->in;
+  if (in.map==NULL) {
+    in.file=fopen(c->infname,"r");
+    if (in.file==NULL) {
+      fprintf(stderr,"Error opening %s\n",c->infname);
+      exit(-1);
+    }
+  }
+  st.pipe.nthreads=0;
+  st.pipe.input=&in;
+  st.pipe.output=&st;
+
+  for (;;) {
+    pthread_mutex_lock(&c->lock);
+    u=c->next++;
+    pthread_mutex_unlock(&c->lock);
+    if (u>=c->nunit)
+      break;
+
+    // Files and subints of this chunk
+    for (k=0;k<st.nout;k++) {
+      o=&out[k];
+      o->m=c->st->out[k]->m+u*(c->nsubunit/o->ntime/o->nsub);
+      clear_bins(o);
+      o->nacc=0;
+      o->nframe=0;
+      o->nfft=0;
+      o->nblank=0;
+      o->nexam=0;
+      o->outfile=NULL;
+    }
+
+    // The last chunk runs to the end of the input
+    in.isamp=c->skip+u*c->nsamp;
+    in.pos=input_offset(&in,in.isamp);
+    if (in.map==NULL)
+      fseeko(in.file,(off_t) in.pos,SEEK_SET);
+    st.pipe.nsubmax=(u<c->nunit-1) ? c->nsubunit : c->nsublast;
+    rffft_pipeline_run(&st.pipe);
+
+    for (k=0;k<st.nout;k++)
+      if (out[k].outfile!=NULL)
+	rffft_writer_close(out[k].writer,out[k].outfile);
+
+    pthread_mutex_lock(&c->lock);
+    c->nread+=st.pipe.nsamp-((u>0) ? c->nhist : 0);
+    c->tbusy+=st.pipe.tbusy;
+    c->nblank+=st.pipe.nblank;
+    c->nexam+=st.pipe.nexam;
+    pthread_mutex_unlock(&c->lock);
+  }
+
+  if (in.map==NULL)
+    fclose(in.file);
+  for (k=0;k<st.nout;k++) {
+    free(out[k].cz);
+    free(out[k].zb);
+  }
+
+  return NULL;
+}
+
+// Split a recording into chunks and process them with njob threads
+int run_chunks(struct stream *st,struct input *in,char *infname,long skip,int njob)
+{
+  struct chunks c;
+  struct stat sb;
+  pthread_t *thread;
+  long g,a,b,n,t,nsamp;
+  int i,k,nchan=st->pipe.nchan;
+  struct timeval t0,t1;
+
+  // Chunks hold a whole number of files of every product
+  for (k=0,g=1;k<st->nout;k++) {
+    n=(long) st->out[k]->nsub*st->out[k]->ntime;
+    for (a=g,b=n;b!=0;t=b,b=a%b,a=t);
+    g=g/a*n;
+  }
+
+  if (stat(infname,&sb)!=0 || !S_ISREG(sb.st_mode)) {
+    fprintf(stderr,"Chunked processing (-C) requires a regular input file\n");
+    return -1;
+  }
+
+  c.st=st;
+  c.in=in;
+  c.infname=infname;
+  c.skip=skip;
+  c.size=rffft_sample_size(st->pipe.informat);
+  c.nhist=st->pipe.ntap*nchan-st->pipe.step;
+  c.nsubunit=g;
+  c.nsamp=g*st->pipe.nint*st->pipe.step;
+  nsamp=input_samples(in,(in->end>=0) ? in->end : sb.st_size)-skip-c.nhist;
+  c.nunit=(nsamp>0) ? (nsamp+c.nsamp-1)/c.nsamp : 1;
+  c.nsublast=0;
+
+  // A window ends within the last chunk
+  if (st->pipe.nsubmax>0 && st->pipe.nsubmax<=c.nunit*c.nsubunit) {
+    c.nunit=(st->pipe.nsubmax+c.nsubunit-1)/c.nsubunit;
+    c.nsublast=st->pipe.nsubmax-(c.nunit-1)*c.nsubunit;
+  }
+  c.next=0;
+  c.nread=0;
+  c.tbusy=0.0;
+  c.nblank=0;
+  c.nexam=0;
+  pthread_mutex_init(&c.lock,NULL);
+  if (njob>c.nunit)
+    njob=(int) c.nunit;
+  printf("Chunks: %ld of %ld subints, %d threads\n",c.nunit,c.nsubunit,njob);
+
+  gettimeofday(&t0,0);
+  thread=(pthread_t *) malloc(sizeof(pthread_t)*njob);
+  for (i=0;i<njob;i++) {
+    if (pthread_create(&thread[i],NULL,chunk_thread,&c)!=0) {
+      fprintf(stderr,"Error creating threads\n");
+      return -1;
+    }
+  }
+  for (i=0;i<njob;i++)
+    pthread_join(thread[i],NULL);
+  gettimeofday(&t1,0);
+
+  // Statistics for the report
+  st->pipe.nthreads=njob;
+  st->pipe.nsamp=c.nread;
+  st->pipe.tbusy=c.tbusy;
+  st->pipe.tstall=0.0;
+  st->pipe.nblank=c.nblank;
+  st->pipe.nexam=c.nexam;
+  st->pipe.telapsed=(t1.tv_sec-t0.tv_sec)+(t1.tv_usec-t0.tv_usec)*1e-6;
+
+  pthread_mutex_destroy(&c.lock);
+  free(thread);
+
+  return 0;
+}
+
+// Parse an extra output product, c=<chansize>,t=<tint>,R=<fmin>:<fmax>,
+// n=<nsub>,L=<length>,Z=<size>,p=<path>,o=<output>,M=<name>,b
+int parse_product(char *spec,struct output *out)
+{
+  char *key;
+
+  out->freqmin=-1;
+  out->freqmax=-1;
+  out->outformat='f';
+  out->useoutput=0;
+  out->shmname[0]='\0';
+  for (key=strtok(spec,",");key!=NULL;key=strtok(NULL,",")) {
+    if (strncmp(key,"c=",2)==0) {
+      out->fchan=atof(key+2);
+    } else if (strncmp(key,"t=",2)==0) {
+      out->tint=atof(key+2);
+    } else if (strncmp(key,"R=",2)==0) {
+      if (sscanf(key+2,"%lf:%lf",&out->freqmin,&out->freqmax)!=2)
+	return -1;
+    } else if (strncmp(key,"n=",2)==0) {
+      out->nsub=atoi(key+2);
+      out->flen=0.0;
+      out->fsize=0.0;
+    } else if (strncmp(key,"L=",2)==0) {
+      out->flen=atof(key+2);
+    } else if (strncmp(key,"Z=",2)==0) {
+      out->fsize=1e6*atof(key+2);
+    } else if (strncmp(key,"p=",2)==0) {
+      strcpy(out->path,key+2);
+    } else if (strncmp(key,"o=",2)==0) {
+      strcpy(out->output,key+2);
+      out->useoutput=1;
+    } else if (strncmp(key,"M=",2)==0) {
+      snprintf(out->shmname,sizeof(out->shmname),"%s",key+2);
+    } else if (strcmp(key,"b")==0) {
+      out->outformat='c';
+    } else {
+      return -1;
+    }
+  }
+  if (out->fchan<=0.0 || out->tint<=0.0 || out->nsub<=0)
+    return -1;
+
+  return 0;
+}
+
+// Subints per file of a product. Files hold a fixed number of subints, so
+// their indices keep mapping to times; a file duration or size limit sets
+// that number, the smaller one if both are given.
+void file_rotation(struct output *out)
+{
+  long nbyte;
+  int n;
+
+  if (out->flen>0.0)
+    out->nsub=(int) floor(out->flen/out->tint+0.5);
+  if (out->fsize>0.0) {
+    nbyte=256+(long) ((out->partial) ? out->imax-out->imin : out->nchan)*((out->outformat=='c') ? 1 : 4);
+    n=(int) (out->fsize/nbyte);
+    if (out->flen<=0.0 || n<out->nsub)
+      out->nsub=n;
+  }
+  if (out->nsub<1)
+    out->nsub=1;
+
+  return;
+}
 
 void usage(void)
 {
   printf("rffft: FFT RF observations\n\n");
-  printf("-i <file>       Input file (can be fifo) [stdin]\n");
+  printf("-i <file>       Input file (can be fifo), or tcp://<host>:<port>, rtltcp://<host>:<port>\n");
+  printf("                or udp://[<host>]:<port>[?seq] [stdin]\n");
+  printf("-J <ms>         Jitter buffer of network input [50]\n");
   printf("-p <path>       Output path, directory into which to puth the files\n");
   printf("-o <output>     Output filename [default: YYYY-MM-DDTHH:MM:SS.sss_XXXXXX.bin]\n");
   printf("-f <frequency>  Center frequency (Hz)\n");
@@ -23,47 +917,113 @@ void usage(void)
   printf("-c <chansize>   Channel size [100Hz]\n");
   printf("-t <tint>       Integration time [1s]\n");
   printf("-n <nsub>       Number of integrations per file [60]\n");
+  printf("-L <length>     Start a new file every length s, instead of every nsub integrations\n");
+  printf("-Z <size>       Start a new file before it exceeds size MB, instead of every nsub integrations\n");
+  printf("-w <kB>         Write output in blocks of this size from a background thread [1024]\n");
+  printf("-K              Also store peak, minimum and spectral kurtosis planes (_peak, _min, _sk files)\n");
+  printf("-M <name>       Also publish subints to the shared memory ring /<name>\n");
+  printf("-U              Write output with direct I/O (O_DIRECT), bypassing the page cache\n");
   printf("-m <use>        Use every mth integration [1]\n");
-  printf("-F <format>     Input format char, int, float, wav [int]\n");
+  printf("-G <k>[,clip]   Blank impulses, zeroing (or clipping) samples above k times the rms amplitude [0: off]\n");
+  printf("-A <load>       Realtime: use fewer integrations while FFT threads are busier than load [0-1, 0: off]\n");
+  printf("-F <format>     Input format char (cs8), cu8, sc12, int, float, wav, ziq, sigmf [int]\n");
   printf("-T <start time> YYYY-MM-DDTHH:MM:SSS.sss\n");
   printf("-R <fmin,fmax>  Frequency range to store (Hz)\n");
   printf("-S <index>      Starting index [int]\n");
+  printf("-Y <tsync>      Re-sync realtime timestamps to the wall clock at most every tsync s [60, 0: never]\n");
+  printf("-k              Skip the input to the starting index, instead of starting it there\n");
+  printf("-a <window>     Process the window <start>[,<end>] (YYYY-MM-DDTHH:MM:SS.sss) of a recording,\n");
+  printf("                or that of SigMF annotation <window>, skipping to the file holding start\n");
   printf("-2              Square signal before processing (to detect BPSK signals\n");
   printf("-4              Square-square signal before processing (to detect QPSK signals\n");  
   printf("-I              Invert frequencies\n");
   printf("-b              Digitize output to bytes [off]\n");
   printf("-q              Quiet mode, no output [off]\n");
   printf("-P              Parse frequency, samplerate, format and start time from filename\n");
+  printf("-j <threads>    Number of FFT threads, with separate reader and writer threads [0: off]\n");
+  printf("-B <nbatch>     Number of spectra per FFTW call [1]\n");
+  printf("-E <planner>    FFTW planning estimate, measure, patient [estimate]\n");
+  printf("                Plans other than estimate are stored in $ST_DATADIR/data/fftw.wisdom\n");
+  printf("-W <window>     Channelizer hamming, or pfb,<taps> for a polyphase filterbank [hamming]\n");
+  printf("-O <overlap>    Overlap between consecutive spectra 0, 50 or 75 percent [0]\n");
+  printf("-D              Down-convert the -R range before the FFT [off]\n");
+  printf("-X <product>    Additional output c=<chansize>,t=<tint>[,R=<fmin>:<fmax>][,n=<nsub>][,L=<length>][,Z=<size>][,p=<path>][,o=<output>][,M=<name>][,b]\n");
+  printf("                from the same input, binned from a finer FFT where possible; can be repeated\n");
+  printf("-C <jobs>       Process a recording (-T or -P) in chunks with this many threads [0: off]\n");
   printf("-h              This help\n");
 
   return;
 }
 
+// Channels, spectra per subintegration and stored channel range of a product
+int output_channels(struct output *out)
+{
+  // Ensure integer number of spectra per subintegration
+  out->tint=ceil(out->fchan*out->tint)/out->fchan;
+
+  // Number of channels
+  out->nchan=(int) (out->samp_rate/out->fchan);
+
+  // Number of integrations
+  out->nint=(int) (out->tint*(float) out->samp_rate/(float) out->nchan);
+
+  // Get channel range
+  out->partial=0;
+  out->imin=0;
+  out->imax=0;
+  if (out->freqmin>0.0 && out->freqmax>0.0) {
+    out->imin=(int) ((out->freqmin-out->freq+0.5*out->samp_rate)/out->fchan);
+    out->imax=(int) ((out->freqmax-out->freq+0.5*out->samp_rate)/out->fchan);
+    if (out->imin<0 || out->imin>=out->nchan || out->imax<0 || out->imax>=out->nchan || out->imax<=out->imin) {
+      fprintf(stderr,"Output frequency range (%.3lf MHz -> %.3lf MHz) incompatible with\ninput settings (%.3lf MHz center frequency, %.3lf MHz sample rate)!\n",out->freqmin*1e-6,out->freqmax*1e-6,out->freq*1e-6,out->samp_rate*1e-6);
+      return -1;
+    }
+    out->partial=1;
+  }
+
+  return 0;
+}
+
 int main(int argc,char *argv[])
 {
-  int i,j,k,l,nchan,m=0,nint=1,arg=0,nbytes,nsub=60,flag,nuse=1,realtime=1,quiet=0,imin,imax,partial=0,useoutput=0;
-  fftwf_complex *c,*d,ct;
-  fftwf_plan fft;
-  FILE *infile,*outfile;
-  char infname[128]="",outfname[128]="",path[64]=".",prefix[32]="",output[128]="";
+  int i,j,k,nchan,m=0,arg=0,nsub=60,nuse=1,realtime=1,quiet=0,useoutput=0;
+  FILE *infile=NULL;
+  char infname[128]="",path[64]=".",prefix[32]="",output[128]="",shmname[64]="";
   char informat='i',outformat='f';
-  int16_t *ibuf;
-  char *cbuf;
-  float *fbuf;
-  int32_t *wbuf;
-  float *z,length,fchan=100.0,tint=1.0,zavg,zstd,*zw;
-  char *cz;
-  double freq,samp_rate,mjd,freqmin=-1,freqmax=-1;
-  struct timeval start,end;
-  char tbuf[30],nfd[32],header[256]="";
-  int sign=1;
+  float fchan=100.0,tint=1.0;
+  double freq,samp_rate,mjd,freqmin=-1,freqmax=-1,tsync=60.0,load=0.0,flen=0.0,fsize=0.0,jitter=50.0;
+  float blank=0.0;
+  struct timeval start;
+  char nfd[32],shmpath[72],idxprefix[PATH_MAX];
+  int sign=1,nthreads=0,bufsize=1024,direct=0,stats=0,clip=0,n,nbatch=1,ntap=1,overlap=0,nover=1,ddc=0,ndec=1,ic,njob=0,seek=0,usetee;
+  long skip=0;
+  unsigned int planner=FFTW_ESTIMATE;
+  char *env,wisdom[128];
   int parse_params_from_filename = 0;
-  sox_format_t * wav_reader = NULL;
+  struct rffft_wav wav;
+  struct rffft_ziq ziq;
+  struct rffft_sigmf sigmf;
+  int wavfile = 0, ziqfile = 0, sigmffile = 0;
+  char metafname[128],window[64]="";
+  int64_t wstart=0,wend=-1;
+  FILE *file;
+  double t,tw,tend;
+  time_t tsec;
+  char tbuf[30];
   int flag_x2=0,flag_x4=0,fac=1;
+  struct input in;
+  struct output out[MAXOUTPUT],*o;
+  struct stream stream[MAXOUTPUT],*st;
+  struct rffft_tee tee;
+  struct rffft_writer writer;
+  struct rffft_net net;
+  struct rffft_ddc down;
+  char *spec[MAXPRODUCT];
+  int nproduct=1,nstream=0,order[MAXOUTPUT];
 
   // Read arguments
   if (argc>1) {
-    while ((arg=getopt(argc,argv,"i:f:s:c:t:p:n:hm:F:T:bqR:o:IS:P24"))!=-1) {
+    while ((arg=getopt(argc,argv,"i:f:s:c:t:p:n:hm:F:T:bqR:o:IS:P24j:B:E:W:O:DX:C:kY:A:L:Z:w:UM:KG:J:a:"))!=-1) {
       switch(arg) {
 	
       case 'i':
@@ -92,14 +1052,22 @@ int main(int argc,char *argv[])
 	break;
 	
       case 'F':
-	if (strcmp(optarg,"char")==0)
+	if (strcmp(optarg,"char")==0 || strcmp(optarg,"cs8")==0)
 	  informat='c';
+	else if (strcmp(optarg,"cu8")==0)
+	  informat='u';
+	else if (strcmp(optarg,"sc12")==0)
+	  informat='p';
 	else if (strcmp(optarg,"int")==0)
 	  informat='i';
 	else if (strcmp(optarg,"float")==0)
 	  informat='f';
 	else if (strcmp(optarg, "wav") == 0)
 	  informat='w';
+	else if (strcmp(optarg, "ziq") == 0)
+	  informat='z';
+	else if (strcmp(optarg, "sigmf") == 0)
+	  informat='m';
 	break;
 
       case 'R':
@@ -154,6 +1122,106 @@ int main(int argc,char *argv[])
         realtime=0;
         break;
 
+      case 'j':
+	nthreads=atoi(optarg);
+	break;
+
+      case 'Y':
+	tsync=atof(optarg);
+	break;
+
+      case 'A':
+	load=atof(optarg);
+	break;
+
+      case 'L':
+	flen=atof(optarg);
+	break;
+
+      case 'Z':
+	fsize=1e6*atof(optarg);
+	break;
+
+      case 'w':
+	bufsize=atoi(optarg);
+	break;
+
+      case 'U':
+	direct=1;
+	break;
+
+      case 'M':
+	snprintf(shmname,sizeof(shmname),"%s",optarg);
+	break;
+
+      case 'K':
+	stats=1;
+	break;
+
+      case 'J':
+	jitter=atof(optarg);
+	break;
+
+      case 'a':
+	strcpy(window,optarg);
+	break;
+
+      case 'G':
+	blank=atof(optarg);
+	clip=(strstr(optarg,",clip")!=NULL);
+	break;
+
+      case 'B':
+	nbatch=atoi(optarg);
+	break;
+
+      case 'E':
+	if (strcmp(optarg,"estimate")==0)
+	  planner=FFTW_ESTIMATE;
+	else if (strcmp(optarg,"measure")==0)
+	  planner=FFTW_MEASURE;
+	else if (strcmp(optarg,"patient")==0)
+	  planner=FFTW_PATIENT;
+	break;
+
+      case 'W':
+	if (strcmp(optarg,"hamming")==0) {
+	  ntap=1;
+	} else if (sscanf(optarg,"pfb,%d",&ntap)!=1 || ntap<2) {
+	  fprintf(stderr,"Unsupported channelizer %s\n",optarg);
+	  return -1;
+	}
+	break;
+
+      case 'O':
+	overlap=atoi(optarg);
+	if (overlap!=0 && overlap!=50 && overlap!=75) {
+	  fprintf(stderr,"Unsupported overlap %s, use 0, 50 or 75\n",optarg);
+	  return -1;
+	}
+	nover=100/(100-overlap);
+	break;
+
+      case 'D':
+	ddc=1;
+	break;
+
+      case 'X':
+	if (nproduct==MAXPRODUCT) {
+	  fprintf(stderr,"At most %d output products are supported\n",MAXPRODUCT);
+	  return -1;
+	}
+	spec[nproduct++]=optarg;
+	break;
+
+      case 'C':
+	njob=atoi(optarg);
+	break;
+
+      case 'k':
+	seek=1;
+	break;
+
       case 'h':
 	usage();
 	return 0;
@@ -175,81 +1243,264 @@ int main(int argc,char *argv[])
     };
   }
 
-  if (informat == 'w') {
-    if (sox_init() != SOX_SUCCESS) {
-      fprintf(stderr, "Error initalizing sox");
-      exit(-1);
+  // SigMF recordings, given by the metadata, the data file or their
+  // common name, take their settings from the metadata. The time of the
+  // first sample is the start time, unless -T is given.
+  if (informat == 'm') {
+    n = strlen(infname);
+    if (n > 11 && (strcmp(infname + n - 11, ".sigmf-meta") == 0 || strcmp(infname + n - 11, ".sigmf-data") == 0))
+      infname[n - 11] = '\0';
+    if (strlen(infname) + 12 > sizeof(infname)) {
+      fprintf(stderr, "SigMF filename %s too long\n", infname);
+      return -1;
     }
-    if (sox_format_init() != SOX_SUCCESS) {
-      fprintf(stderr, "Error initalizing sox");
+    sprintf(metafname, "%s.sigmf-meta", infname);
+    strcat(infname, ".sigmf-data");
+    file = fopen(metafname, "r");
+    if (file == NULL || rffft_sigmf_meta(file, &sigmf) != 0) {
+      fprintf(stderr, "Error: %s is not SigMF metadata of complex 8 bit or little endian 16 or 32 bit samples.\n", metafname);
       exit(-1);
     }
+    fclose(file);
 
-    wav_reader = sox_open_read(infname, NULL, NULL, NULL);
+    samp_rate = sigmf.samp_rate;
+    informat = sigmf.format;
+    if (sigmf.capture[0].frequency > 0.0)
+      freq = sigmf.capture[0].frequency;
+    for (k = 1; k < sigmf.ncapture; k++) {
+      if (sigmf.capture[k].frequency != sigmf.capture[0].frequency) {
+	fprintf(stderr, "Warning: SigMF captures are at different frequencies, using that of the first\n");
+	break;
+      }
+    }
+    if (realtime == 1 || parse_params_from_filename == 1) {
+      if (sigmf.capture[0].timed == 0) {
+	fprintf(stderr, "SigMF recording %s has no start time, set one with -T\n", metafname);
+	return -1;
+      }
+      t = rffft_sigmf_time(&sigmf, 0);
+      tsec = (time_t) floor(t);
+      strftime(tbuf, 30, "%Y-%m-%dT%T", gmtime(&tsec));
+      sprintf(nfd, "%.19s.%03d", tbuf, (int) floor(1000.0 * (t - tsec)));
+      realtime = 0;
+    }
+    sigmffile = 1;
+  }
+
+  // Open network input, rtl_tcp servers send unsigned 8 bit samples
+  if (rffft_net_url(infname)) {
+    if (informat=='w' || informat=='z') {
+      fprintf(stderr,"WAV and ziq input is not supported over the network\n");
+      return -1;
+    }
+    if (strncmp(infname,"rtltcp://",9)==0)
+      informat='u';
+    if (rffft_net_open(&net,infname,rffft_sample_size(informat),freq,samp_rate,1e-3*jitter)!=0)
+      return -1;
+  } else {
+    // Open file
+    if (strlen(infname)) {
+      infile = fopen(infname, "r");
+    } else {
+      infile = stdin;
+    }
+    if (infile == NULL) {
+      fprintf(stderr, "Error opening file %s\n", infname);
+      exit(-1);
+    }
+  }
 
-    if (wav_reader == NULL) {
-      fprintf(stderr, "Error opening file %s", infname);
+  // Samples of WAV files are read directly, in the format given by the header
+  if (informat == 'w' && sigmffile == 0) {
+    if (rffft_wav_header(infile, &wav) != 0) {
+      fprintf(stderr, "Error: Only 8, 16 or 32 bit integer or 32 bit float wav files supported.\n");
       exit(-1);
     }
 
-    if (wav_reader->signal.channels != 2) {
-      fprintf(stderr, "Error: Only wav files with 2 channels supported.");
+    if (wav.nchannel != 2) {
+      fprintf(stderr, "Error: Only wav files with 2 channels supported.\n");
       exit(-1);
     }
 
-    samp_rate = wav_reader->signal.rate;
+    samp_rate = wav.samp_rate;
+    informat = wav.format;
+    wavfile = 1;
   }
 
-  // Ensure integer number of spectra per subintegration
-  tint=ceil(fchan*tint)/fchan;
+  // SatDump .ziq files, optionally zstd compressed
+  if (informat == 'z') {
+    if (rffft_ziq_header(infile, &ziq) != 0) {
+      fprintf(stderr, "Error: Only 8, 16 or 32 bit ziq files supported.\n");
+      exit(-1);
+    }
 
-  // Number of channels
-  nchan=(int) (samp_rate/fchan);
+    samp_rate = ziq.samp_rate;
+    informat = ziq.format;
+    ziqfile = 1;
+  }
 
-  // Number of integrations
-  nint=(int) (tint*(float) samp_rate/(float) nchan);
+  // Primary output product
+  o=&out[0];
+  strcpy(o->path,path);
+  strcpy(o->output,output);
+  o->useoutput=useoutput;
+  o->m=m;
+  o->nsub=nsub;
+  o->nuse=nuse;
+  o->adapt=(load>0.0);
+  o->nover=nover;
+  o->realtime=realtime;
+  o->quiet=quiet;
+  o->fac=fac;
+  o->outformat=outformat;
+  o->freq=freq;
+  o->samp_rate=samp_rate;
+  o->freqmin=freqmin;
+  o->freqmax=freqmax;
+  o->fchan=fchan;
+  o->tint=tint;
+  o->flen=flen;
+  o->fsize=fsize;
+  strcpy(o->shmname,shmname);
+  o->plane=0;
+  if (output_channels(o)!=0)
+    return -1;
 
-  // Get channel range
-  if (freqmin>0.0 && freqmax>0.0) {
-    imin=(int) ((freqmin-freq+0.5*samp_rate)/fchan);
-    imax=(int) ((freqmax-freq+0.5*samp_rate)/fchan);
-    if (imin<0 || imin>=nchan || imax<0 || imax>=nchan || imax<=imin) {
-      fprintf(stderr,"Output frequency range (%.3lf MHz -> %.3lf MHz) incompatible with\ninput settings (%.3lf MHz center frequency, %.3lf MHz sample rate)!\n",freqmin*1e-6,freqmax*1e-6,freq*1e-6,samp_rate*1e-6);
+  // Additional output products, with the settings of the primary one as
+  // defaults
+  for (k=1;k<nproduct;k++) {
+    out[k]=out[0];
+    if (parse_product(spec[k],&out[k])!=0) {
+      fprintf(stderr,"Invalid output product %s\n",spec[k]);
       return -1;
     }
-    partial=1;
+    if (output_channels(&out[k])!=0)
+      return -1;
   }
-  
+
+  // Overlapping spectra need a whole number of samples between them
+  for (k=0;k<nproduct;k++) {
+    if (out[k].nchan%nover!=0) {
+      fprintf(stderr,"Overlap of %d%% requires a number of channels divisible by %d\n",overlap,nover);
+      return -1;
+    }
+  }
+
+  // File rotation
+  for (k=0;k<nproduct;k++)
+    file_rotation(&out[k]);
+
   // Dump statistics
   printf("Filename: %s\n", (strlen(infname) ? infname : "stdin"));
   printf("Frequency: %f MHz\n",freq*1e-6);
   printf("Bandwidth: %f MHz\n",samp_rate*1e-6);
   printf("Sampling time: %f us\n",1e6/samp_rate);
-  printf("Number of channels: %d\n",nchan);
-  printf("Channel size: %f Hz\n",samp_rate/(float) nchan);
-  printf("Integration time: %f s\n",tint);
-  printf("Number of averaged spectra: %d\n",nint);
-  printf("Number of subints per file: %d\n",nsub);
+  printf("Number of channels: %d\n",o->nchan);
+  printf("Channel size: %f Hz\n",samp_rate/(float) o->nchan);
+  printf("Integration time: %f s\n",o->tint);
+  printf("Number of averaged spectra: %d\n",o->nint*nover);
+  printf("Overlap: %d%%\n",overlap);
+  printf("Number of subints per file: %d\n",o->nsub);
   printf("Starting index: %d\n",m);
 
-  // Allocate
-  c=fftwf_malloc(sizeof(fftwf_complex)*nchan);
-  d=fftwf_malloc(sizeof(fftwf_complex)*nchan);
-  ibuf=(int16_t *) malloc(sizeof(int16_t)*2*nchan);
-  cbuf=(char *) malloc(sizeof(char)*2*nchan);
-  fbuf=(float *) malloc(sizeof(float)*2*nchan);
-  wbuf = (int32_t *)malloc(sizeof(int32_t) * 2 * nchan);
-  z=(float *) malloc(sizeof(float)*nchan);
-  cz=(char *) malloc(sizeof(char)*nchan);
-  zw=(float *) malloc(sizeof(float)*nchan);
-
-  // Compute window
-  for (i=0;i<nchan;i++)
-    zw[i]=0.54-0.46*cos(2.0*M_PI*i/(nchan-1));
-  
+  // Annotations of SigMF recordings, which -a selects by number
+  if (sigmffile==1) {
+    printf("SigMF segments: %d\n",sigmf.ncapture);
+    for (k=0;k<sigmf.nannotation;k++) {
+      t=rffft_sigmf_time(&sigmf,sigmf.annotation[k].sample_start);
+      tsec=(time_t) floor(t);
+      strftime(tbuf,30,"%Y-%m-%dT%T",gmtime(&tsec));
+      printf("Annotation %d: %s.%03d, %f s, %f-%f MHz %s\n",k,tbuf,(int) floor(1000.0*(t-tsec)),sigmf.annotation[k].sample_count/samp_rate,sigmf.annotation[k].freq_lower*1e-6,sigmf.annotation[k].freq_upper*1e-6,sigmf.annotation[k].label);
+    }
+  }
+
+  printf("FFT threads: %d\n",nthreads);
+  printf("Spectra per FFTW call: %d\n",nbatch);
+  printf("Unpack kernel: %s\n",rffft_simd_name(rffft_simd_level()));
+  if (ntap>1)
+    printf("Channelizer: polyphase filterbank, %d taps\n",ntap);
+  else
+    printf("Channelizer: Hamming window\n");
+
+  // Down-convert the stored range, keeping the channels aligned with those
+  // of the full band FFT
+  if (ddc==1) {
+    if (o->partial==0) {
+      fprintf(stderr,"Down-conversion (-D) requires a frequency range (-R)\n");
+      return -1;
+    }
+    if (nproduct>1) {
+      fprintf(stderr,"Down-conversion (-D) supports a single output product\n");
+      return -1;
+    }
+    ndec=rffft_ddc_factor(o->nchan,2*(o->imax-o->imin),nover);
+    if (ndec>1) {
+      ic=(o->imin+o->imax)/2;
+      rffft_ddc_init(&down,ndec,ic-o->nchan/2,o->nchan,informat,sign,flag_x4 ? 2 : flag_x2);
+      o->nchan/=ndec;
+      o->imin+=o->nchan/2-ic;
+      o->imax+=o->nchan/2-ic;
+      printf("Down-converter: %.6f MHz, decimation by %d, %d channel FFT\n",(freq+(ic-o->nchan*ndec/2)*fchan)*1e-6,ndec,o->nchan);
+    } else {
+      printf("Down-converter: range too wide, not used\n");
+    }
+  }
+
+  // Peak, minimum and spectral kurtosis planes of every product, stored
+  // like products of their own
+  if (stats==1) {
+    for (k=0,n=nproduct;k<n;k++) {
+      for (j=1;j<=3;j++) {
+	out[nproduct]=out[k];
+	out[nproduct].plane=j;
+	out[nproduct].shmname[0]='\0';
+	nproduct++;
+      }
+    }
+  }
 
-  // Plan
-  fft=fftwf_plan_dft_1d(nchan,c,d,FFTW_FORWARD,FFTW_ESTIMATE);
+  // Assign the products to FFT streams, finest first. A product is binned
+  // from an earlier stream if it spans a whole number of its channels and
+  // subintegrations, otherwise it gets an FFT stream of its own.
+  for (k=0;k<nproduct;k++) {
+    for (i=k;i>0 && (out[order[i-1]].fchan>out[k].fchan || (out[order[i-1]].fchan==out[k].fchan && out[order[i-1]].tint>out[k].tint));i--)
+      order[i]=order[i-1];
+    order[i]=k;
+  }
+  for (k=0;k<nproduct;k++) {
+    o=&out[order[k]];
+    for (j=0;j<nstream;j++) {
+      st=&stream[j];
+      nchan=st->pipe.nchan;
+      if (nchan%o->nchan==0 && ((long) o->nint*o->nchan)%((long) st->pipe.nint/nover*nchan)==0 && (stats==0 || nchan==o->nchan))
+	break;
+    }
+    st=&stream[j];
+    if (j==nstream) {
+      st->pipe.nchan=o->nchan;
+      st->pipe.nint=o->nint*nover;
+      st->nout=0;
+      nstream++;
+    }
+    o->nbin=st->pipe.nchan/o->nchan;
+    o->ntime=(int) (((long) o->nint*o->nchan)/((long) st->pipe.nint/nover*st->pipe.nchan));
+    o->clk=&st->clk;
+    st->out[st->nout++]=o;
+  }
+  if (nproduct>1) {
+    for (j=0;j<nstream;j++) {
+      for (k=0;k<stream[j].nout;k++) {
+	o=stream[j].out[k];
+	printf("Output product: %f Hz, %f s, %d channels, %s, FFT stream %d binned %dx%d\n",o->fchan,o->tint,o->partial ? o->imax-o->imin : o->nchan,planename[o->plane],j,o->nbin,o->ntime);
+      }
+    }
+  }
+
+  // FFTW wisdom file
+  env=getenv("ST_DATADIR");
+  if (env==NULL || strlen(env)==0)
+    env=".";
+  sprintf(wisdom,"%s/data/fftw.wisdom",env);
 
   // Create prefix
   if (realtime==1) {
@@ -260,220 +1511,310 @@ int main(int argc,char *argv[])
     mjd=nfd2mjd(nfd);
   }
 
-  // Open file
-  if (informat != 'w') {
-    if (strlen(infname)) {
-        infile = fopen(infname, "r");
-    } else {
-        infile = stdin;
+  // Output settings
+  for (k=0;k<nproduct;k++) {
+    o=&out[k];
+    strcpy(o->prefix,prefix);
+    if (o->plane>0) {
+      sprintf(o->prefix+strlen(o->prefix),"_%s",planename[o->plane]);
+      if (strlen(o->output)<sizeof(o->output)-5)
+	sprintf(o->output+strlen(o->output),"_%s",planename[o->plane]);
     }
-  }
-
-  // Forever loop
-  for (;;m++) {
-    // File name
-    if (useoutput==0) {
-      sprintf(outfname,"%s/%s_%06d.bin",path,prefix,m);
-    } else {
-      sprintf(outfname,"%s/%s_%06d.bin",path,output,m);
-    }
-    outfile=fopen(outfname,"w");
-
-    // Loop over subints to dump
-    for (k=0;k<nsub;k++) {
-      // Initialize
-      for (i=0;i<nchan;i++) 
-	z[i]=0.0;
-      
-      // Log start time
-      gettimeofday(&start,0);
-      
-      // Integrate
-      for (j=0;j<nint;j++) {
-	// Read buffer
-	if (informat=='i')
-	  nbytes=fread(ibuf,sizeof(int16_t),2*nchan,infile);
-	else if (informat=='c')
-	  nbytes=fread(cbuf,sizeof(char),2*nchan,infile);
-	else if (informat=='f')
-	  nbytes=fread(fbuf,sizeof(float),2*nchan,infile);
-	else if (informat == 'w')
-	  nbytes = sox_read(wav_reader, wbuf, 2 * nchan);
-
-	// End on empty buffer
-	if (nbytes==0)
-	  break;
-
-	// Skip buffer
-	if (j%nuse!=0)
-	  continue;
-
-	// Unpack 
-	if (informat=='i') {
-	  for (i=0;i<nchan;i++) {
-	    c[i][0]=(float) ibuf[2*i]/32768.0*zw[i];
-	    c[i][1]=(float) ibuf[2*i+1]/32768.0*zw[i]*sign;
-	  } 
-	} else if (informat=='c') {
-	  for (i=0;i<nchan;i++) {
-	    c[i][0]=(float) cbuf[2*i]/256.0*zw[i];
-	    c[i][1]=(float) cbuf[2*i+1]/256.0*zw[i]*sign;
-	  } 
-	} else if (informat=='f') {
-	  for (i=0;i<nchan;i++) {
-	    c[i][0]=(float) fbuf[2*i]*zw[i];
-	    c[i][1]=(float) fbuf[2*i+1]*zw[i]*sign;
-	  }
-	} else if (informat == 'w') {
-	  for (i = 0; i < nchan; i++) {
-	    c[i][0] = (float) wbuf[2*i] / 2147483648 * zw[i];
-	    c[i][1] = (float) wbuf[2*i+1] / 2147483648 * zw[i] * sign;
-	  }
-	}
+    o->mjd=mjd;
+    o->sigmf=NULL;
+    o->cz=(char *) malloc(sizeof(char)*o->nchan);
+    o->zb=(float *) malloc(sizeof(float)*2*o->nchan);
+    clear_bins(o);
+    o->nacc=0;
+    o->nframe=0;
+    o->nfft=0;
+    o->nblank=0;
+    o->nexam=0;
+    o->outfile=NULL;
+    o->writer=&writer;
+    o->shm=NULL;
+    o->idx=-1;
 
-	// Square once
-	if (flag_x2 || flag_x4) {
-	  for (i = 0; i < nchan; i++) {
-	    ct[0] = c[i][0] * c[i][0] - c[i][1] * c[i][1];
-	    ct[1] = 2 * c[i][0] * c[i][1];
-	    c[i][0] = ct[0];
-	    c[i][1] = ct[1];
-	  }
-	}
-
-	// Square twice
-	if (flag_x4) {
-	  for (i = 0; i < nchan; i++) {
-	    ct[0] = c[i][0] * c[i][0] - c[i][1] * c[i][1];
-	    ct[1] = 2 * c[i][0] * c[i][1];
-	    c[i][0] = ct[0];
-	    c[i][1] = ct[1];
-	  }
-	}
-	
-	// Execute
-	fftwf_execute(fft);
-	
-	// Add
-	for (i=0;i<nchan;i++) {
-	  if (i<nchan/2)
-	    l=i+nchan/2;
-	  else
-	    l=i-nchan/2;
-	  
-	  //z[l]+=sqrt(d[i][0]*d[i][0]+d[i][1]*d[i][1]);
-	  z[l]+=d[i][0]*d[i][0]+d[i][1]*d[i][1];
-	}
+    // Products must not write to the same files
+    for (j=0;j<k;j++) {
+      if (strcmp(o->path,out[j].path)==0 && strcmp(o->useoutput ? o->output : o->prefix,out[j].useoutput ? out[j].output : out[j].prefix)==0) {
+	fprintf(stderr,"Output products %d and %d have the same output files, set p= or o=\n",j,k);
+	return -1;
       }
+    }
 
-      // Log end time
-      gettimeofday(&end,0);
-
-      // Time stats
-      length=(end.tv_sec-start.tv_sec)+(end.tv_usec-start.tv_usec)*1e-6;
-      
-      // Scale
-      for (i=0;i<nchan;i++) 
-	z[i]*=(float) nuse/(float) nchan;
-      
-      // Scale to bytes
-      if (outformat=='c') {
-	// Compute average
-	for (i=0,zavg=0.0;i<nchan;i++)
-	  zavg+=z[i];
-	zavg/=(float) nchan;
-	
-      // Compute standard deviation
-	for (i=0,zstd=0.0;i<nchan;i++)
-	  zstd+=pow(z[i]-zavg,2);
-	zstd=sqrt(zstd/(float) nchan);
-
-	// Convert
-	for (i=0;i<nchan;i++) {
-	  z[i]=256.0/6.0*(z[i]-zavg)/zstd;
-	  if (z[i]<-128.0)
-	    z[i]=-128.0;
-	  if (z[i]>127.0)
-	    z[i]=127.0;
-	  cz[i]=(char) z[i];
+    // Shared memory ring for live consumers
+    if (strlen(o->shmname)>0) {
+      if (njob>0) {
+	fprintf(stderr,"Publishing to shared memory (-M) is not supported with chunked processing (-C)\n");
+	return -1;
+      }
+      for (j=0;j<k;j++) {
+	if (strcmp(o->shmname,out[j].shmname)==0) {
+	  fprintf(stderr,"Output products %d and %d publish to the same shared memory, set M=\n",j,k);
+	  return -1;
 	}
       }
+      sprintf(shmpath,"%s%s",(o->shmname[0]=='/') ? "" : "/",o->shmname);
+      o->shm=(struct rffft_shm *) malloc(sizeof(struct rffft_shm));
+      if (rffft_shm_create(o->shm,shmpath,SHMSLOTS,(size_t) ((o->partial) ? o->imax-o->imin : o->nchan)*((o->outformat=='c') ? 1 : sizeof(float)))!=0)
+	return -1;
+      printf("Shared memory ring: %s, %d subints\n",shmpath,SHMSLOTS);
+    }
+  }
 
-      // Format start time
-      if (realtime==1) {
-	strftime(tbuf,30,"%Y-%m-%dT%T",gmtime(&start.tv_sec));
-	sprintf(nfd,"%s.%03ld",tbuf,start.tv_usec/1000);
-      } else {
-	mjd2nfd(mjd+(m*nsub+k)*tint/86400.0,nfd); 
-	length=tint;
-      }
+  // Input settings
+  in.informat=informat;
+  in.file=infile;
+  in.net=rffft_net_url(infname) ? &net : NULL;
+  in.sigmf=(sigmffile==1) ? &sigmf : NULL;
+  in.isamp=0;
+  in.ddc=NULL;
+  in.raw=NULL;
+  in.zstd=NULL;
+  if (wavfile==1) {
+    in.start=wav.offset;
+    in.end=(wav.size>=0) ? wav.offset+wav.size : -1;
+  } else if (ziqfile==1) {
+    in.start=ziq.offset;
+    in.end=-1;
+    if (ziq.compressed) {
+      in.zstd=ZSTD_createDCtx();
+      in.zbuf=(char *) malloc(ZSTD_DStreamInSize());
+      in.zin.src=in.zbuf;
+      in.zin.size=0;
+      in.zin.pos=0;
+    }
+  } else if (sigmffile==1) {
+    in.start=rffft_sigmf_offset(&sigmf,0);
+    in.end=-1;
+    fseeko(infile,(off_t) in.start,SEEK_SET);
+  } else {
+    in.start=(infile!=NULL && ftello(infile)>=0) ? ftello(infile) : 0;
+    in.end=-1;
+  }
+  in.pos=in.start;
+  map_input(&in);
+  if (ndec>1) {
+    in.ddc=&down;
+    in.nraw=(262144/ndec>0) ? 262144/ndec : 1;
+    in.raw=(char *) malloc((size_t) in.nraw*ndec*rffft_sample_size(informat));
+  }
 
-      // Header
-      if (partial==0) {
-	if (outformat=='f') 
-	  sprintf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\nEND\n",nfd,freq,samp_rate/fac,length,nchan,nsub);
-	else if (outformat=='c')
-	  sprintf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\nNBITS         8\nMEAN         %e\nRMS          %e\nEND\n",nfd,freq,samp_rate/fac,length,nchan,nsub,zavg,zstd);
-      } else if (partial==1) {
-	if (outformat=='f') 
-	  sprintf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\nEND\n",nfd,0.5*(freqmax+freqmin),(freqmax-freqmin)/fac,length,imax-imin,nsub);
-	else if (outformat=='c')
-	  sprintf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\nNBITS         8\nMEAN         %e\nRMS          %e\nEND\n",nfd,0.5*(freqmax+freqmin),(freqmax-freqmin)/fac,length,imax-imin,nsub,zavg,zstd);
+  // Time window of a recording, or the span of a SigMF annotation, which
+  // starts at the file holding its first sample
+  if (strlen(window)>0) {
+    if (realtime==1) {
+      fprintf(stderr,"Processing a window (-a) requires a recording with a start time (-T, -P or SigMF)\n");
+      return -1;
+    }
+    if (strchr(window,'T')==NULL) {
+      k=atoi(window);
+      if (sigmffile==0 || k<0 || k>=sigmf.nannotation) {
+	fprintf(stderr,"No SigMF annotation %s\n",window);
+	return -1;
       }
-      // Limit output
-      if (!quiet)
-	printf("%s %s %f %d\n",outfname,nfd,length,j);
-      
-      // Dump file
-      fwrite(header,sizeof(char),256,outfile);
-      if (partial==0) {
-	if (outformat=='f')
-	  fwrite(z,sizeof(float),nchan,outfile);
-	else if (outformat=='c')
-	  fwrite(cz,sizeof(char),nchan,outfile);
-      } else if (partial==1) {
-	if (outformat=='f')
-	  fwrite(&z[imin],sizeof(float),imax-imin,outfile);
-	else if (outformat=='c')
-	  fwrite(&cz[imin],sizeof(char),imax-imin,outfile);
+      wstart=sigmf.annotation[k].sample_start;
+      wend=(sigmf.annotation[k].sample_count>0) ? wstart+sigmf.annotation[k].sample_count : -1;
+    } else {
+      rffft_datetime(nfd,&t);
+      if (rffft_datetime(window,&tw)!=0 || (strchr(window,',')!=NULL && rffft_datetime(strchr(window,',')+1,&tend)!=0)) {
+	fprintf(stderr,"Invalid window %s\n",window);
+	return -1;
       }
-      // Break;
-      if (nbytes==0)
-	break;
+      wstart=window_sample((sigmffile==1) ? &sigmf : NULL,tw-t,samp_rate);
+      if (strchr(window,',')!=NULL)
+	wend=window_sample((sigmffile==1) ? &sigmf : NULL,tend-t,samp_rate);
+    }
+    if (wend>=0 && wend<=wstart) {
+      fprintf(stderr,"Empty window %s\n",window);
+      return -1;
     }
+    m=(int) (wstart/((int64_t) out[0].nsub*out[0].nint*out[0].nchan*ndec));
+    for (k=0;k<nproduct;k++)
+      out[k].m=m;
+    seek=1;
+    printf("Window: samples %lld to %lld, from file %d\n",(long long) wstart,(long long) wend,m);
+  }
 
-    // Break;
-    if (nbytes==0)
-      break;
-    
-    // Close file
-    fclose(outfile);
+  // Start at file m of the recording, which requires all products to
+  // have files of the same length
+  if (seek==1 && m>0) {
+    skip=(long) m*out[0].nsub*out[0].nint*out[0].nchan;
+    for (k=1;k<nproduct;k++) {
+      if ((long) m*out[k].nsub*out[k].nint*out[k].nchan!=skip) {
+	fprintf(stderr,"Skipping to a starting index (-k) requires products with files of the same length\n");
+	return -1;
+      }
+    }
+    skip*=ndec;
+    if (njob==0)
+      skip_input(&in,skip);
   }
 
-  if (informat != 'w') {
-    fclose(infile);
+  // Subint times of SigMF recordings follow the times of their captures
+  if (sigmffile==1 && sigmf.ncapture>1) {
+    for (k=0;k<nproduct;k++) {
+      out[k].sigmf=&sigmf;
+      out[k].sub0=(seek==1) ? 0 : (long) m*out[k].nsub;
+      out[k].nsamp=(long) out[k].nint*out[k].nchan*ndec;
+    }
   }
 
-  if (informat == 'w') {
-    sox_close(wav_reader);
-    sox_format_quit();
-    sox_quit();
+  // Several streams read the same samples, and compressed input is
+  // decompressed on a thread of its own
+  usetee=(nstream>1 || in.zstd!=NULL);
+  if (usetee && rffft_tee_start(&tee,nstream,rffft_sample_size((ndec>1) ? 'f' : informat),read_input,&in)!=0)
+    return -1;
+
+  // Pipeline settings
+  for (j=0;j<nstream;j++) {
+    st=&stream[j];
+    nchan=st->pipe.nchan;
+
+    // Compute window or filterbank coefficients
+    st->zw=(float *) malloc(sizeof(float)*nchan*ntap);
+    if (ntap==1) {
+      for (i=0;i<nchan;i++)
+	st->zw[i]=0.54-0.46*cos(2.0*M_PI*i/(nchan-1));
+    } else {
+      rffft_pfb_coefficients(nchan,ntap,st->zw);
+    }
+
+    st->pipe.step=nchan/nover;
+    st->pipe.nuse=nuse;
+    st->pipe.nframe=0;
+    st->pipe.informat=(ndec>1) ? 'f' : informat;
+    st->pipe.sign=(ndec>1) ? 1 : sign;
+    st->pipe.nsquare=(ndec>1) ? 0 : (flag_x4 ? 2 : flag_x2);
+    st->pipe.ntap=ntap;
+    st->pipe.zw=st->zw;
+    st->pipe.stats=stats;
+    st->pipe.blank=blank;
+    st->pipe.clip=clip;
+    st->pipe.nbatch=nbatch;
+    st->pipe.planner=planner;
+    st->pipe.wisdom=wisdom;
+    st->pipe.nthreads=nthreads;
+    st->pipe.nsubmax=(wend>=0) ? (int) ((wend-skip+(int64_t) st->pipe.nint*st->pipe.step*ndec-1)/((int64_t) st->pipe.nint*st->pipe.step*ndec)) : 0;
+    st->pipe.load=load;
+    st->pipe.read=usetee ? rffft_tee_read : read_input;
+    st->pipe.map=(!usetee && ndec==1 && in.map!=NULL) ? map_raw : NULL;
+    st->pipe.input=usetee ? (void *) &tee.reader[j] : (void *) &in;
+    st->pipe.write=write_stream;
+    st->pipe.output=st;
+
+    // Sample clock
+    st->clk.fs=samp_rate/ndec;
+    st->clk.tsub=(double) st->pipe.nint*st->pipe.step/st->clk.fs;
+    st->clk.tsync=tsync;
+    st->clk.drift=0.0;
+    st->clk.gap=0.0;
+    st->clk.nobs=0;
+    st->clk.ngap=0;
+    st->clk.nbehind=0;
   }
 
-  // Destroy plan
-  fftwf_destroy_plan(fft);
+  // Load shedding only makes sense while samples arrive in real time
+  if (load>0.0 && realtime==0) {
+    fprintf(stderr,"Load shedding (-A) requires realtime input, without -T or -P\n");
+    return -1;
+  }
+
+  // Chunks of a recording can be processed independently, as the output
+  // times follow from the subint indices
+  if (njob>0) {
+    if (realtime==1 || strlen(infname)==0 || in.zstd!=NULL || ndec>1 || nstream>1 || nthreads>0) {
+      fprintf(stderr,"Chunked processing (-C) requires an uncompressed input file with a start time\n(-T or -P), a single FFT stream and no -D or -j\n");
+      return -1;
+    }
+  }
+
+  // Background writer, every open file holds a buffer
+  if (rffft_writer_start(&writer,2*nproduct*((njob>0) ? njob : 1)+4,(size_t) bufsize*1024,direct,(realtime==1) ? 1.0 : 0.0)!=0)
+    return -1;
+
+  // Index of the subints of every product, for seeking in time
+  for (k=0;k<nproduct;k++) {
+    if (snprintf(idxprefix,sizeof(idxprefix),"%s/%s",out[k].path,out[k].useoutput ? out[k].output : out[k].prefix)>=(int) sizeof(idxprefix)) {
+      fprintf(stderr,"Path of output %d too long, not indexing it\n",k);
+      out[k].idx=-1;
+      continue;
+    }
+    out[k].idx=open_index(idxprefix,out[k].m,out[k].nsub);
+    if (out[k].idx<0)
+      fprintf(stderr,"Failed to write index %s.idx\n",idxprefix);
+  }
+
+  // Process
+  if (njob>0) {
+    if (run_chunks(&stream[0],&in,infname,skip,njob)!=0)
+      return -1;
+  } else if (nstream==1) {
+    stream_thread(&stream[0]);
+  } else {
+    for (j=0;j<nstream;j++) {
+      if (pthread_create(&stream[j].thread,NULL,stream_thread,&stream[j])!=0) {
+	fprintf(stderr,"Error creating threads\n");
+	return -1;
+      }
+    }
+    for (j=0;j<nstream;j++)
+      pthread_join(stream[j].thread,NULL);
+  }
+  if (usetee)
+    rffft_tee_finish(&tee);
+
+  // Close files
+  for (k=0;k<nproduct;k++)
+    if (out[k].outfile!=NULL)
+      rffft_writer_close(&writer,out[k].outfile);
+  rffft_writer_finish(&writer);
+  for (k=0;k<nproduct;k++) {
+    if (out[k].shm!=NULL) {
+      rffft_shm_close(out[k].shm);
+      free(out[k].shm);
+    }
+    if (out[k].idx>=0)
+      close(out[k].idx);
+  }
+
+  if (in.map!=NULL)
+    munmap((void *) in.map,in.mapsize);
+  if (in.net!=NULL)
+    rffft_net_close(&net);
+  else
+    fclose(infile);
+
+  // Throughput
+  for (j=0;j<nstream;j++) {
+    if (nstream>1)
+      printf("FFT stream %d, %d channels:\n",j,stream[j].pipe.nchan);
+    rffft_pipeline_report(&stream[j].pipe,samp_rate/ndec);
+    if (realtime==1)
+      printf("Sample clock: drift %.6f s, %d gaps of %.6f s in total, %d subints read behind real time\n",stream[j].clk.drift,stream[j].clk.ngap,stream[j].clk.gap,stream[j].clk.nbehind);
+  }
+  if (in.net!=NULL)
+    rffft_net_report(&net);
+  rffft_writer_report(&writer);
 
   // Deallocate
-  free(ibuf);
-  free(cbuf);
-  free(fbuf);
-  free(wbuf);
-  fftwf_free(c);
-  fftwf_free(d);
-  free(z);
-  free(cz);
-  free(zw);
+  if (ndec>1) {
+    rffft_ddc_free(&down);
+    free(in.raw);
+  }
+  if (in.zstd!=NULL) {
+    ZSTD_freeDCtx(in.zstd);
+    free(in.zbuf);
+  }
+  if (sigmffile==1)
+    rffft_sigmf_free(&sigmf);
+  for (k=0;k<nproduct;k++) {
+    free(out[k].cz);
+    free(out[k].zb);
+  }
+  for (j=0;j<nstream;j++)
+    free(stream[j].zw);
   
   return 0;
 }
-
@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "rffft_internal.h"
+#include "rffft_ddc.h"
+
+// Output samples split into polyphase branches at a time
+#define DDC_TILE 64
+
+// Filter taps per polyphase branch
+#define DDC_NTAP 16
+
+// Compile the inner loops for several instruction sets where the toolchain
+// supports it. Products are not fused into FMAs, so the results do not
+// depend on the CPU.
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#pragma GCC optimize ("fp-contract=off")
+#define DDC_CLONES __attribute__((target_clones("avx512f","avx2","default")))
+#define DDC_CLONES_MIX __attribute__((target_clones("avx2","default")))
+#else
+#define DDC_CLONES
+#define DDC_CLONES_MIX
+#endif
+
+int rffft_ddc_factor(int nchan,int nmin,int nmul)
+{
+  int ndec;
+
+  if (nmin<1)
+    nmin=1;
+  for (ndec=nchan/nmin;ndec>=2;ndec--) {
+    if (nchan%ndec==0 && (nchan/ndec)%nmul==0)
+      return ndec;
+  }
+
+  return 1;
+}
+
+void rffft_ddc_init(struct rffft_ddc *d,int ndec,int k,int nperiod,char format,int sign,int nsquare)
+{
+  int i,n=ndec*DDC_NTAP,a,b,g;
+  double x,w,sum;
+
+  d->ndec=ndec;
+  d->ntap=DDC_NTAP;
+  d->format=format;
+  d->sign=sign;
+  d->nsquare=nsquare;
+
+  // Lowpass with a cutoff at half the output sample rate; the Blackman-Harris
+  // window puts the transition between a quarter and three quarters of it
+  d->h=(float *) malloc(sizeof(float)*n);
+  for (i=0,sum=0.0;i<n;i++) {
+    x=(i-0.5*(n-1))/ndec;
+    w=0.35875-0.48829*cos(2.0*M_PI*i/(n-1))+0.14128*cos(4.0*M_PI*i/(n-1))-0.01168*cos(6.0*M_PI*i/(n-1));
+    d->h[i]=((x==0.0) ? 1.0 : sin(M_PI*x)/(M_PI*x))*w;
+    sum+=d->h[i];
+  }
+
+  // Gain of sqrt(ndec) keeps the noise power per sample, so spectra of the
+  // decimated signal have the same levels as those of the full band
+  for (i=0;i<n;i++)
+    d->h[i]*=sqrt(ndec)/sum;
+
+  // Shortest NCO period
+  for (a=abs(k),b=nperiod;b!=0;g=b,b=a%b,a=g);
+  g=(a>0) ? a : 1;
+  k/=g;
+  d->nperiod=nperiod/g;
+  d->nco=(float *) malloc(sizeof(float)*2*d->nperiod);
+  for (i=0;i<d->nperiod;i++) {
+    x=-2.0*M_PI*(double) ((long) k*i%d->nperiod)/d->nperiod;
+    d->nco[2*i]=cos(x);
+    d->nco[2*i+1]=sin(x);
+  }
+  d->iphase=0;
+
+  // Buffers for a tile of input samples
+  d->ones=(float *) malloc(sizeof(float)*DDC_TILE*ndec);
+  for (i=0;i<DDC_TILE*ndec;i++)
+    d->ones[i]=1.0;
+  d->x=(float *) malloc(sizeof(float)*2*DDC_TILE*ndec);
+
+  d->nmax=0;
+  d->xp=NULL;
+
+  return;
+}
+
+// Grow the work buffers, keeping the filter history of every branch
+static void ddc_resize(struct rffft_ddc *d,int nout)
+{
+  int p,nhist=DDC_NTAP-1;
+  float *xp;
+
+  xp=(float *) calloc((size_t) 2*d->ndec*(nhist+nout),sizeof(float));
+  if (d->xp!=NULL) {
+    for (p=0;p<d->ndec;p++)
+      memcpy(xp+2*p*(nhist+nout),d->xp+2*p*(nhist+d->nmax),sizeof(float)*2*nhist);
+    free(d->xp);
+  }
+  d->xp=xp;
+  d->nmax=nout;
+
+  return;
+}
+
+// Multiply samples by the NCO phasors, starting at phase index idx
+// AVX-512 would fuse the complex product into fmaddsub
+DDC_CLONES_MIX
+static void ddc_mix(const float *nco,int nperiod,int idx,float *c,int n)
+{
+  int i,m;
+  float re,im;
+  const float *w;
+
+  // Contiguous runs between wraps of the NCO, so the loop vectorizes
+  for (;n>0;n-=m,c+=2*m,idx=0) {
+    m=(nperiod-idx<n) ? nperiod-idx : n;
+    w=nco+2*idx;
+    for (i=0;i<m;i++) {
+      re=c[2*i]*w[2*i]-c[2*i+1]*w[2*i+1];
+      im=c[2*i]*w[2*i+1]+c[2*i+1]*w[2*i];
+      c[2*i]=re;
+      c[2*i+1]=im;
+    }
+  }
+
+  return;
+}
+
+// Add one polyphase branch to nout outputs. With a constant number of taps
+// the compiler unrolls the tap loop and vectorizes over the outputs; every
+// output is summed in the same order, whatever the instruction set.
+DDC_CLONES
+static void ddc_branch(const float *h,int ndec,const float *restrict xb,int nout,float *restrict y)
+{
+  int i,q;
+  float hq[DDC_NTAP],acc;
+
+  for (q=0;q<DDC_NTAP;q++)
+    hq[q]=h[q*ndec];
+
+  for (i=0;i<2*nout;i++) {
+    acc=y[i];
+    for (q=0;q<DDC_NTAP;q++)
+      acc+=hq[q]*xb[i+2*q];
+    y[i]=acc;
+  }
+
+  return;
+}
+
+void rffft_ddc_process(struct rffft_ddc *d,const void *buffer,int nout,float *y)
+{
+  int i,m,m0,m1,n,p,row,size,nhist=DDC_NTAP-1;
+  float *c,*xb;
+
+  if (nout>d->nmax)
+    ddc_resize(d,nout);
+  row=2*(nhist+d->nmax);
+
+  // Unpack, optionally square, mix to zero frequency and split into the
+  // polyphase branches, DDC_TILE outputs at a time so the samples stay in
+  // the cache between the passes
+  size=rffft_sample_size(d->format);
+  for (m0=0;m0<nout;m0=m1) {
+    m1=(m0+DDC_TILE<nout) ? m0+DDC_TILE : nout;
+    n=(m1-m0)*d->ndec;
+    rffft_unpack(d->format,(const char *) buffer+(size_t) m0*d->ndec*size,n,d->ones,d->sign,d->nsquare,d->x);
+    ddc_mix(d->nco,d->nperiod,d->iphase,d->x,n);
+    d->iphase=(d->iphase+n)%d->nperiod;
+    for (p=0;p<d->ndec;p++) {
+      c=d->x+2*p;
+      xb=d->xp+p*row+2*(nhist+m0);
+      for (m=m0;m<m1;m++,c+=2*d->ndec,xb+=2) {
+	xb[0]=c[0];
+	xb[1]=c[1];
+      }
+    }
+  }
+
+  // Filter
+  for (i=0;i<2*nout;i++)
+    y[i]=0.0;
+  for (p=0;p<d->ndec;p++)
+    ddc_branch(d->h+p,d->ndec,d->xp+p*row,nout,y);
+
+  // Keep history
+  for (p=0;p<d->ndec;p++)
+    memmove(d->xp+p*row,d->xp+p*row+2*nout,sizeof(float)*2*nhist);
+
+  return;
+}
+
+void rffft_ddc_free(struct rffft_ddc *d)
+{
+  free(d->h);
+  free(d->nco);
+  free(d->ones);
+  free(d->x);
+  free(d->xp);
+
+  return;
+}
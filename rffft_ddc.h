@@ -0,0 +1,40 @@
+#ifndef _RFFFT_DDC_H
+#define _RFFFT_DDC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Digital down-converter: NCO mix followed by a polyphase FIR decimator
+struct rffft_ddc {
+  int ndec;                  // Decimation factor
+  int ntap;                  // Filter taps per polyphase branch
+  float *h;                  // Lowpass prototype, ndec*ntap coefficients
+  int nperiod;               // NCO period (samples)
+  float *nco;                // NCO phasors, nperiod complex values
+  int iphase;                // Current NCO index
+  char format;               // Input format ('c', 'i', 'f', 'w')
+  int sign;                  // -1 to invert frequencies
+  int nsquare;               // Number of times to square before mixing
+  int nmax;                  // Capacity of the work buffers (output samples)
+  float *ones,*x,*xp;        // Unit window, unpacked input, polyphase branches
+};
+
+// Largest decimation factor of an nchan point spectrum that keeps at least
+// nmin channels, with the remaining number of channels a multiple of nmul
+int rffft_ddc_factor(int nchan,int nmin,int nmul);
+
+// Set up a down-converter shifting frequency k/nperiod (in units of the
+// sample rate) to zero and decimating by ndec
+void rffft_ddc_init(struct rffft_ddc *d,int ndec,int k,int nperiod,char format,int sign,int nsquare);
+
+// Down-convert nout*ndec raw samples into nout interleaved complex floats
+void rffft_ddc_process(struct rffft_ddc *d,const void *buffer,int nout,float *y);
+
+void rffft_ddc_free(struct rffft_ddc *d);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RFFFT_DDC_H */
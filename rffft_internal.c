@@ -2,8 +2,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <libgen.h>
+#include <math.h>
 
 
 // Filename formats:
@@ -12,9 +14,9 @@
 //   - 2023-08-05_18-02-45-534_16000000SPS_2284000000Hz.s16
 //   - 2023-08-05_18-02-45-1691258565.534000_16000000SPS_2284000000Hz.f32
 //   - 2023-08-07_16-36-47-1691426207.749000_2400000SPS_100000000Hz.wav
-//   s8: char, s16 short int, f32 float.
-//   SatDump also supports a compressed versions of s8/s16/f32 with .ziq
-//   extension. Those are not yet supported
+//   s8: char, u8 unsigned char, s16 short int, f32 float.
+//   SatDump also supports (compressed) versions of s8/s16/f32 with .ziq
+//   extension, format 'z'; the sample format follows from the header.
 //   timestamp can have an added milliseconds field, configurable. This feature
 //   was broken during some time so files with this convention still exists.
 // - GQRX:
@@ -22,6 +24,9 @@
 //   format always float32
 // - SDR Console:
 //   - 07-Aug-2023 181711.798 401.774MHz.wav
+// - SigMF:
+//   - recording.sigmf-meta or recording.sigmf-data
+//   format 'm'; the parameters follow from the metadata.
 int rffft_params_from_filename(char * filename, double * samplerate, double * frequency, char * format, char * starttime) {
   // Temp vars to hold parsed values
   int p_year, p_month, p_day, p_hours, p_minutes, p_seconds, p_fractal_seconds;
@@ -32,6 +37,13 @@ int rffft_params_from_filename(char * filename, double * samplerate, double * fr
   int parsed_tokens;
 
   char * base_filename = basename(filename);
+  size_t len = strlen(base_filename);
+
+  // SigMF recording
+  if ((len > 11) && ((strcmp(".sigmf-meta", base_filename + len - 11) == 0) || (strcmp(".sigmf-data", base_filename + len - 11) == 0))) {
+    *format = 'm';
+    return 0;
+  }
 
   // Broken SatDump string with milliseconds activated
   parsed_tokens = sscanf(
@@ -55,12 +67,16 @@ int rffft_params_from_filename(char * filename, double * samplerate, double * fr
 
     if ((strlen(p_format) == 2) && (strncmp("s8", p_format, 2) == 0)) {
       *format = 'c';
+    } else if ((strlen(p_format) == 2) && (strncmp("u8", p_format, 2) == 0)) {
+      *format = 'u';
     } else if ((strlen(p_format) == 3) && (strncmp("s16", p_format, 3) == 0)) {
       *format = 'i';
     } else if ((strlen(p_format) == 3) && (strncmp("f32", p_format, 3) == 0)) {
       *format = 'f';
     } else if ((strlen(p_format) == 3) && (strncmp("wav", p_format, 3) == 0)) {
       *format = 'w';
+    } else if ((strlen(p_format) == 3) && (strncmp("ziq", p_format, 3) == 0)) {
+      *format = 'z';
     } else {
       printf("Unsupported SatDump format %s\n", p_format);
       return -1;
@@ -92,12 +108,16 @@ int rffft_params_from_filename(char * filename, double * samplerate, double * fr
 
     if ((strlen(p_format) == 2) && (strncmp("s8", p_format, 2) == 0)) {
       *format = 'c';
+    } else if ((strlen(p_format) == 2) && (strncmp("u8", p_format, 2) == 0)) {
+      *format = 'u';
     } else if ((strlen(p_format) == 3) && (strncmp("s16", p_format, 3) == 0)) {
       *format = 'i';
     } else if ((strlen(p_format) == 3) && (strncmp("f32", p_format, 3) == 0)) {
       *format = 'f';
     } else if ((strlen(p_format) == 3) && (strncmp("wav", p_format, 3) == 0)) {
       *format = 'w';
+    } else if ((strlen(p_format) == 3) && (strncmp("ziq", p_format, 3) == 0)) {
+      *format = 'z';
     } else {
       printf("Unsupported SatDump format %s\n", p_format);
       return -1;
@@ -128,12 +148,16 @@ int rffft_params_from_filename(char * filename, double * samplerate, double * fr
 
     if ((strlen(p_format) == 2) && (strncmp("s8", p_format, 2) == 0)) {
       *format = 'c';
+    } else if ((strlen(p_format) == 2) && (strncmp("u8", p_format, 2) == 0)) {
+      *format = 'u';
     } else if ((strlen(p_format) == 3) && (strncmp("s16", p_format, 3) == 0)) {
       *format = 'i';
     } else if ((strlen(p_format) == 3) && (strncmp("f32", p_format, 3) == 0)) {
       *format = 'f';
     } else if ((strlen(p_format) == 3) && (strncmp("wav", p_format, 3) == 0)) {
       *format = 'w';
+    } else if ((strlen(p_format) == 3) && (strncmp("ziq", p_format, 3) == 0)) {
+      *format = 'z';
     } else {
       printf("Unsupported SatDump format %s\n", p_format);
       return -1;
@@ -224,3 +248,578 @@ int rffft_params_from_filename(char * filename, double * samplerate, double * fr
 
   return -1;
 }
+
+int rffft_sample_size(char format) {
+  switch (format) {
+    case 'c':
+    case 'u':
+      return 2 * sizeof(char);
+    case 'p':
+      return 3;
+    case 'i':
+      return 2 * sizeof(int16_t);
+    case 'f':
+      return 2 * sizeof(float);
+    case 'w':
+      return 2 * sizeof(int32_t);
+    default:
+      return 0;
+  }
+}
+
+int rffft_header_stats(char * header, const char * stats) {
+  size_t len = strlen(header), n;
+  const char * p, * q;
+  int nkept = 0;
+
+  // Keep lines while they leave room for END and the terminator
+  for (p = stats; (q = strchr(p, '\n')) != NULL; p = q + 1) {
+    n = q - p + 1;
+    if (len + n + 4 >= 256)
+      break;
+    memcpy(header + len, p, n);
+    len += n;
+    nkept++;
+  }
+  strcpy(header + len, "END\n");
+
+  return nkept;
+}
+
+// Little endian integers
+static uint32_t get_u16(const unsigned char * b) {
+  return b[0] | (b[1] << 8);
+}
+
+static uint32_t get_u32(const unsigned char * b) {
+  return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t) b[3] << 24);
+}
+
+static int64_t get_u64(const unsigned char * b) {
+  return (int64_t) get_u32(b) | ((int64_t) get_u32(b + 4) << 32);
+}
+
+// Skip n bytes, reading them if the file can not seek
+static int skip_bytes(FILE * file, int64_t n) {
+  char buf[4096];
+  size_t m;
+
+  if (fseeko(file, (off_t) n, SEEK_CUR) == 0)
+    return 0;
+  for (; n > 0; n -= m) {
+    m = (n < (int64_t) sizeof(buf)) ? n : sizeof(buf);
+    if (fread(buf, 1, m, file) != m)
+      return -1;
+  }
+
+  return 0;
+}
+
+int rffft_wav_header(FILE * file, struct rffft_wav * wav) {
+  unsigned char b[40];
+  uint32_t size;
+  int rf64, tag = 0, have_fmt = 0;
+  int64_t pos, datasize = -1;
+
+  // RIFF header, or RF64 and BW64 for files over 4 GB
+  if (fread(b, 1, 12, file) != 12 || memcmp(b + 8, "WAVE", 4) != 0)
+    return -1;
+  if (memcmp(b, "RIFF", 4) == 0)
+    rf64 = 0;
+  else if (memcmp(b, "RF64", 4) == 0 || memcmp(b, "BW64", 4) == 0)
+    rf64 = 1;
+  else
+    return -1;
+  pos = 12;
+
+  // Walk the chunks until the samples
+  for (;;) {
+    if (fread(b, 1, 8, file) != 8)
+      return -1;
+    size = get_u32(b + 4);
+    pos += 8;
+
+    if (memcmp(b, "ds64", 4) == 0 && size >= 24) {
+      // 64 bit sizes of the RF64 file and its data chunk
+      if (fread(b, 1, 24, file) != 24)
+        return -1;
+      datasize = get_u64(b + 8);
+      if (skip_bytes(file, size - 24 + (size & 1)) != 0)
+        return -1;
+    } else if (memcmp(b, "fmt ", 4) == 0 && size >= 16) {
+      if (fread(b, 1, (size < 40) ? size : 40, file) != ((size < 40) ? size : 40))
+        return -1;
+      tag = get_u16(b);
+      wav->nchannel = get_u16(b + 2);
+      wav->samp_rate = get_u32(b + 4);
+      wav->nbits = get_u16(b + 14);
+
+      // Extensible format, the subformat GUID starts with the tag
+      if (tag == 0xFFFE && size >= 26)
+        tag = get_u16(b + 24);
+      if (size > 40 && skip_bytes(file, size - 40) != 0)
+        return -1;
+      if ((size & 1) && skip_bytes(file, 1) != 0)
+        return -1;
+      have_fmt = 1;
+    } else if (memcmp(b, "data", 4) == 0) {
+      break;
+    } else if (skip_bytes(file, (int64_t) size + (size & 1)) != 0) {
+      return -1;
+    }
+    pos += (int64_t) size + (size & 1);
+  }
+  if (have_fmt == 0)
+    return -1;
+
+  // Data size, from the ds64 chunk for RF64 files, unknown for streamed
+  // files that never got their size filled in
+  wav->offset = pos;
+  if (rf64 == 1 && size == 0xFFFFFFFF)
+    wav->size = datasize;
+  else if (size == 0 || size == 0xFFFFFFFF)
+    wav->size = -1;
+  else
+    wav->size = size;
+
+  // PCM (tag 1) or IEEE float (tag 3) samples
+  if (tag == 1 && wav->nbits == 8)
+    wav->format = 'u';
+  else if (tag == 1 && wav->nbits == 16)
+    wav->format = 'i';
+  else if (tag == 1 && wav->nbits == 32)
+    wav->format = 'w';
+  else if (tag == 3 && wav->nbits == 32)
+    wav->format = 'f';
+  else
+    return -1;
+
+  return 0;
+}
+
+int rffft_ziq_header(FILE * file, struct rffft_ziq * ziq) {
+  unsigned char b[22];
+  int64_t size;
+
+  // Signature, compression flag, bits per sample, sample rate and the
+  // length of the annotation that precedes the samples
+  if (fread(b, 1, 22, file) != 22 || memcmp(b, "ZIQ_", 4) != 0)
+    return -1;
+  ziq->compressed = b[4];
+  ziq->nbits = b[5];
+  ziq->samp_rate = (double) get_u64(b + 6);
+  size = get_u64(b + 14);
+  if (size < 0 || skip_bytes(file, size) != 0)
+    return -1;
+  ziq->offset = 22 + size;
+
+  if (ziq->nbits == 8)
+    ziq->format = 'c';
+  else if (ziq->nbits == 16)
+    ziq->format = 'i';
+  else if (ziq->nbits == 32)
+    ziq->format = 'f';
+  else
+    return -1;
+
+  return 0;
+}
+
+// Minimal JSON reader for SigMF metadata: objects are walked member by
+// member, values that are not needed are skipped
+struct json {
+  const char * p;
+  const char * end;
+};
+
+static void json_space(struct json * j) {
+  while (j->p < j->end && (*j->p == ' ' || *j->p == '\t' || *j->p == '\n' || *j->p == '\r'))
+    j->p++;
+}
+
+static int json_char(struct json * j, char c) {
+  json_space(j);
+  if (j->p < j->end && *j->p == c) {
+    j->p++;
+    return 1;
+  }
+  return 0;
+}
+
+// String into s of size n, truncated if longer; escapes other than
+// \" and \\ are kept as the escaped character
+static int json_string(struct json * j, char * s, size_t n) {
+  size_t k = 0;
+
+  if (json_char(j, '"') == 0)
+    return -1;
+  while (j->p < j->end && *j->p != '"') {
+    if (*j->p == '\\' && j->p + 1 < j->end)
+      j->p++;
+    if (k + 1 < n)
+      s[k++] = *j->p;
+    j->p++;
+  }
+  if (n > 0)
+    s[k] = '\0';
+  return json_char(j, '"') ? 0 : -1;
+}
+
+static int json_number(struct json * j, double * x) {
+  char * q;
+
+  json_space(j);
+  *x = strtod(j->p, &q);
+  if (q == j->p || q > j->end)
+    return -1;
+  j->p = q;
+  return 0;
+}
+
+static int json_skip(struct json * j) {
+  char s[8];
+
+  json_space(j);
+  if (j->p >= j->end)
+    return -1;
+  if (*j->p == '"')
+    return json_string(j, s, sizeof(s));
+  if (json_char(j, '{')) {
+    if (json_char(j, '}'))
+      return 0;
+    do {
+      if (json_string(j, s, sizeof(s)) != 0 || json_char(j, ':') == 0 || json_skip(j) != 0)
+        return -1;
+    } while (json_char(j, ','));
+    return json_char(j, '}') ? 0 : -1;
+  }
+  if (json_char(j, '[')) {
+    if (json_char(j, ']'))
+      return 0;
+    do {
+      if (json_skip(j) != 0)
+        return -1;
+    } while (json_char(j, ','));
+    return json_char(j, ']') ? 0 : -1;
+  }
+  // Numbers, true, false and null
+  while (j->p < j->end && strchr(",}] \t\n\r", *j->p) == NULL)
+    j->p++;
+  return 0;
+}
+
+// Walk the members of an object, calling member for each key with the
+// reader at its value, which member must consume
+static int json_object(struct json * j, int (*member)(struct json *, const char *, void *), void * ctx) {
+  char key[64];
+
+  if (json_char(j, '{') == 0)
+    return -1;
+  if (json_char(j, '}'))
+    return 0;
+  do {
+    if (json_string(j, key, sizeof(key)) != 0 || json_char(j, ':') == 0 || member(j, key, ctx) != 0)
+      return -1;
+  } while (json_char(j, ','));
+  return json_char(j, '}') ? 0 : -1;
+}
+
+int rffft_datetime(const char * s, double * t) {
+  int year, month, day, hour, minute, a, m;
+  double second;
+  long days;
+
+  if (sscanf(s, "%d-%d-%dT%d:%d:%lf", &year, &month, &day, &hour, &minute, &second) != 6)
+    return -1;
+
+  // Days since 1970-01-01 of the proleptic Gregorian calendar
+  a = (month <= 2) ? 1 : 0;
+  m = month + 12 * a - 3;
+  year -= a;
+  days = 365L * year + year / 4 - year / 100 + year / 400 + (153 * m + 2) / 5 + day - 719469;
+  *t = days * 86400.0 + hour * 3600.0 + minute * 60.0 + second;
+
+  return 0;
+}
+
+// Members of global, capture and annotation objects
+static int sigmf_global(struct json * j, const char * key, void * ctx) {
+  struct rffft_sigmf * sigmf = (struct rffft_sigmf *) ctx;
+  char s[32];
+
+  if (strcmp(key, "core:datatype") == 0) {
+    if (json_string(j, s, sizeof(s)) != 0)
+      return -1;
+    if (strcmp(s, "ci8") == 0 || strcmp(s, "ci8_le") == 0 || strcmp(s, "ci8_be") == 0)
+      sigmf->format = 'c';
+    else if (strcmp(s, "cu8") == 0 || strcmp(s, "cu8_le") == 0 || strcmp(s, "cu8_be") == 0)
+      sigmf->format = 'u';
+    else if (strcmp(s, "ci16_le") == 0)
+      sigmf->format = 'i';
+    else if (strcmp(s, "ci32_le") == 0)
+      sigmf->format = 'w';
+    else if (strcmp(s, "cf32_le") == 0)
+      sigmf->format = 'f';
+    else
+      sigmf->format = '\0';
+    return 0;
+  }
+  if (strcmp(key, "core:sample_rate") == 0)
+    return json_number(j, &sigmf->samp_rate);
+  return json_skip(j);
+}
+
+static int sigmf_capture(struct json * j, const char * key, void * ctx) {
+  struct rffft_sigmf_capture * c = (struct rffft_sigmf_capture *) ctx;
+  char s[64];
+  double x;
+
+  if (strcmp(key, "core:sample_start") == 0 || strcmp(key, "core:header_bytes") == 0) {
+    if (json_number(j, &x) != 0 || x < 0)
+      return -1;
+    if (key[5] == 's')
+      c->sample_start = (int64_t) x;
+    else
+      c->header_bytes = (int64_t) x;
+    return 0;
+  }
+  if (strcmp(key, "core:frequency") == 0)
+    return json_number(j, &c->frequency);
+  if (strcmp(key, "core:datetime") == 0) {
+    if (json_string(j, s, sizeof(s)) != 0 || rffft_datetime(s, &c->time) != 0)
+      return -1;
+    c->timed = 1;
+    return 0;
+  }
+  return json_skip(j);
+}
+
+static int sigmf_annotation(struct json * j, const char * key, void * ctx) {
+  struct rffft_sigmf_annotation * a = (struct rffft_sigmf_annotation *) ctx;
+  double x;
+
+  if (strcmp(key, "core:sample_start") == 0 || strcmp(key, "core:sample_count") == 0) {
+    if (json_number(j, &x) != 0 || x < 0)
+      return -1;
+    if (key[12] == 's')
+      a->sample_start = (int64_t) x;
+    else
+      a->sample_count = (int64_t) x;
+    return 0;
+  }
+  if (strcmp(key, "core:freq_lower_edge") == 0)
+    return json_number(j, &a->freq_lower);
+  if (strcmp(key, "core:freq_upper_edge") == 0)
+    return json_number(j, &a->freq_upper);
+  if (strcmp(key, "core:label") == 0)
+    return json_string(j, a->label, sizeof(a->label));
+  return json_skip(j);
+}
+
+static int sigmf_top(struct json * j, const char * key, void * ctx) {
+  struct rffft_sigmf * sigmf = (struct rffft_sigmf *) ctx;
+  int n;
+
+  if (strcmp(key, "global") == 0)
+    return json_object(j, sigmf_global, sigmf);
+
+  if (strcmp(key, "captures") == 0 || strcmp(key, "annotations") == 0) {
+    if (json_char(j, '[') == 0)
+      return -1;
+    if (json_char(j, ']'))
+      return 0;
+    do {
+      if (key[0] == 'c') {
+        n = sigmf->ncapture++;
+        sigmf->capture = (struct rffft_sigmf_capture *) realloc(sigmf->capture, sizeof(struct rffft_sigmf_capture) * sigmf->ncapture);
+        memset(&sigmf->capture[n], 0, sizeof(struct rffft_sigmf_capture));
+        if (json_object(j, sigmf_capture, &sigmf->capture[n]) != 0)
+          return -1;
+      } else {
+        n = sigmf->nannotation++;
+        sigmf->annotation = (struct rffft_sigmf_annotation *) realloc(sigmf->annotation, sizeof(struct rffft_sigmf_annotation) * sigmf->nannotation);
+        memset(&sigmf->annotation[n], 0, sizeof(struct rffft_sigmf_annotation));
+        if (json_object(j, sigmf_annotation, &sigmf->annotation[n]) != 0)
+          return -1;
+      }
+    } while (json_char(j, ','));
+    return json_char(j, ']') ? 0 : -1;
+  }
+
+  return json_skip(j);
+}
+
+int rffft_sigmf_meta(FILE * file, struct rffft_sigmf * sigmf) {
+  struct json j;
+  char * buf = NULL;
+  size_t n = 0, m;
+  int64_t header = 0;
+  int i, size, status;
+
+  memset(sigmf, 0, sizeof(struct rffft_sigmf));
+
+  // The metadata is small, read it whole
+  do {
+    buf = (char *) realloc(buf, n + 65536);
+    m = fread(buf + n, 1, 65536, file);
+    n += m;
+  } while (m > 0);
+  j.p = buf;
+  j.end = buf + n;
+  status = json_object(&j, sigmf_top, sigmf);
+  free(buf);
+  size = rffft_sample_size(sigmf->format);
+  if (status != 0 || size == 0 || sigmf->samp_rate <= 0) {
+    rffft_sigmf_free(sigmf);
+    return -1;
+  }
+
+  // Recordings without captures are a single segment
+  if (sigmf->ncapture == 0) {
+    sigmf->ncapture = 1;
+    sigmf->capture = (struct rffft_sigmf_capture *) calloc(1, sizeof(struct rffft_sigmf_capture));
+  }
+
+  // Byte offsets, after the header bytes of this and earlier segments, and
+  // times of segments without one, continuing the previous segment
+  for (i = 0; i < sigmf->ncapture; i++) {
+    struct rffft_sigmf_capture * c = &sigmf->capture[i];
+
+    if (i > 0 && c->sample_start < c[-1].sample_start) {
+      rffft_sigmf_free(sigmf);
+      return -1;
+    }
+    header += c->header_bytes;
+    if (i > 0 && c->header_bytes > 0)
+      sigmf->gaps = 1;
+    c->offset = header + c->sample_start * size;
+    if (c->timed == 0 && i > 0)
+      c->time = c[-1].time + (c->sample_start - c[-1].sample_start) / sigmf->samp_rate;
+  }
+
+  return 0;
+}
+
+void rffft_sigmf_free(struct rffft_sigmf * sigmf) {
+  free(sigmf->capture);
+  free(sigmf->annotation);
+  sigmf->capture = NULL;
+  sigmf->annotation = NULL;
+  sigmf->ncapture = 0;
+  sigmf->nannotation = 0;
+}
+
+int rffft_sigmf_segment(const struct rffft_sigmf * sigmf, int64_t n) {
+  int lo = 0, hi = sigmf->ncapture - 1, mid;
+
+  // Last segment starting at or before sample n
+  while (lo < hi) {
+    mid = (lo + hi + 1) / 2;
+    if (sigmf->capture[mid].sample_start <= n)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+
+  return lo;
+}
+
+int64_t rffft_sigmf_offset(const struct rffft_sigmf * sigmf, int64_t n) {
+  const struct rffft_sigmf_capture * c = &sigmf->capture[rffft_sigmf_segment(sigmf, n)];
+
+  return c->offset + (n - c->sample_start) * rffft_sample_size(sigmf->format);
+}
+
+double rffft_sigmf_time(const struct rffft_sigmf * sigmf, int64_t n) {
+  const struct rffft_sigmf_capture * c = &sigmf->capture[rffft_sigmf_segment(sigmf, n)];
+
+  return c->time + (n - c->sample_start) / sigmf->samp_rate;
+}
+
+int64_t rffft_sigmf_sample(const struct rffft_sigmf * sigmf, double t) {
+  int i;
+  int64_t n;
+
+  // Last segment starting at or before t, times falling between segments
+  // map to the start of the next one
+  for (i = 0; i + 1 < sigmf->ncapture && sigmf->capture[i + 1].time <= t; i++);
+  n = sigmf->capture[i].sample_start + (int64_t) floor((t - sigmf->capture[i].time) * sigmf->samp_rate + 0.5);
+  if (i + 1 < sigmf->ncapture && n > sigmf->capture[i + 1].sample_start)
+    n = sigmf->capture[i + 1].sample_start;
+
+  return (n > 0) ? n : 0;
+}
+
+void rffft_pfb_coefficients(int nchan, int ntap, float * h) {
+  int i, n = nchan * ntap;
+  double x, a, w, sum, gain;
+
+  for (i = 0, sum = 0.0; i < n; i++) {
+    // Sinc with a cutoff at half a channel
+    x = (i - 0.5 * (n - 1)) / nchan;
+    a = (x == 0.0) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+
+    // Blackman-Harris window
+    w = 0.35875 - 0.48829 * cos(2.0 * M_PI * i / (n - 1)) + 0.14128 * cos(4.0 * M_PI * i / (n - 1)) - 0.01168 * cos(6.0 * M_PI * i / (n - 1));
+
+    h[i] = a * w;
+    sum += h[i];
+  }
+
+  // Normalize to the gain of the Hamming window
+  for (i = 0, gain = 0.0; i < nchan; i++)
+    gain += 0.54 - 0.46 * cos(2.0 * M_PI * i / (nchan - 1));
+  for (i = 0; i < n; i++)
+    h[i] *= gain / sum;
+}
+
+void rffft_pfb(const float * x, const float * h, int nchan, int ntap, float * c) {
+  int i, t;
+  const float * xt, * ht;
+
+  for (i = 0; i < 2 * nchan; i++)
+    c[i] = 0.0;
+
+  for (t = 0; t < ntap; t++) {
+    xt = x + 2 * (size_t) t * nchan;
+    ht = h + (size_t) t * nchan;
+    for (i = 0; i < nchan; i++) {
+      c[2 * i] += ht[i] * xt[2 * i];
+      c[2 * i + 1] += ht[i] * xt[2 * i + 1];
+    }
+  }
+}
+
+void rffft_accumulate(const float * d, int nchan, float * z) {
+  int i, l;
+
+  for (i = 0; i < nchan; i++) {
+    if (i < nchan / 2)
+      l = i + nchan / 2;
+    else
+      l = i - nchan / 2;
+
+    z[l] += d[2 * i] * d[2 * i] + d[2 * i + 1] * d[2 * i + 1];
+  }
+}
+
+void rffft_accumulate_stats(const float * d, int nchan, float * z) {
+  int i, l;
+  float p;
+  float * zmax = z + nchan, * zmin = z + 2 * nchan, * z2 = z + 3 * nchan;
+
+  for (i = 0; i < nchan; i++) {
+    if (i < nchan / 2)
+      l = i + nchan / 2;
+    else
+      l = i - nchan / 2;
+
+    p = d[2 * i] * d[2 * i] + d[2 * i + 1] * d[2 * i + 1];
+    z[l] += p;
+    if (p > zmax[l])
+      zmax[l] = p;
+    if (p < zmin[l])
+      zmin[l] = p;
+    z2[l] += p * p;
+  }
+}
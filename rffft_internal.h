@@ -1,6 +1,8 @@
 #ifndef _RFFFT_INTERNAL_H
 #define _RFFFT_INTERNAL_H
 
+#include <stdio.h>
+#include <stdint.h>
 #include "sgdp4h.h"
 
 #ifdef __cplusplus
@@ -12,10 +14,154 @@ extern "C" {
 // output:
 // samplerate: parsed samplerate
 // frequency: parsed frequency
-// format: parsed sample format: char: 'c', int: 'i', float: 'f', wav: 'w'
+// format: parsed sample format: char: 'c', int: 'i', float: 'f', wav: 'w', ziq: 'z', SigMF: 'm'
 // starttime: parsed start time string formatted YYYY-MM-DDTHH:MM:SS.sss
 int rffft_params_from_filename(char * filename, double * samplerate, double * frequency, char * format, char * starttime);
 
+// Size in bytes of a single complex sample in the given input format:
+// 'c' signed and 'u' offset binary 8 bit, 'p' packed 12 bit, 'i' 16 bit,
+// 'w' 32 bit integers and 'f' 32 bit floats
+int rffft_sample_size(char format);
+
+// End the header of a float subint with the keyword lines of stats and
+// END. The lines are in order of priority and are taken as long as the
+// header stays within 256 bytes, so the last lines are dropped first.
+// header must have room for 256 bytes. Returns the number of lines kept.
+int rffft_header_stats(char * header, const char * stats);
+
+// Sample layout of a RIFF or RF64 WAV file
+struct rffft_wav {
+  char format;          // Input format of the samples ('u', 'i', 'w', 'f')
+  int nchannel;         // Number of channels
+  int nbits;            // Bits per sample
+  double samp_rate;     // Sample rate (Hz)
+  int64_t offset;       // Start of the sample data (bytes)
+  int64_t size;         // Length of the sample data (bytes), -1 if unknown
+};
+
+// Parse the header of a WAV file, leaving the file at the start of the
+// samples. Returns 0 on success, -1 for unsupported or invalid files.
+int rffft_wav_header(FILE * file, struct rffft_wav * wav);
+
+// Header of a SatDump .ziq file
+struct rffft_ziq {
+  char format;          // Input format of the samples ('c', 'i', 'f')
+  int compressed;       // Samples are a zstd stream
+  int nbits;            // Bits per sample
+  double samp_rate;     // Sample rate (Hz)
+  int64_t offset;       // Start of the samples (bytes)
+};
+
+// Parse the header of a .ziq file, leaving the file at the start of the
+// samples. Returns 0 on success, -1 for unsupported or invalid files.
+int rffft_ziq_header(FILE * file, struct rffft_ziq * ziq);
+
+// Capture segment of a SigMF recording, samples from sample_start on
+// share its settings
+struct rffft_sigmf_capture {
+  int64_t sample_start;  // First sample of the segment
+  int64_t header_bytes;  // Bytes of non-sample data preceding the segment
+  int64_t offset;        // Position of the first sample in the data file (bytes)
+  double frequency;      // Center frequency (Hz), 0 if not given
+  double time;           // UTC of the first sample (Unix time)
+  int timed;             // Time given, otherwise it continues the previous segment
+};
+
+// Annotation of a span of samples of a SigMF recording
+struct rffft_sigmf_annotation {
+  int64_t sample_start;  // First sample
+  int64_t sample_count;  // Number of samples, 0 if not given
+  double freq_lower;     // Frequency edges (Hz), 0 if not given
+  double freq_upper;
+  char label[64];
+};
+
+// SigMF recording, described by the JSON of its .sigmf-meta file
+struct rffft_sigmf {
+  char format;           // Input format of the samples ('c', 'u', 'i', 'w', 'f')
+  double samp_rate;      // Sample rate (Hz)
+  int gaps;              // Header bytes between segments, samples are not contiguous
+  int ncapture;
+  struct rffft_sigmf_capture * capture;
+  int nannotation;
+  struct rffft_sigmf_annotation * annotation;
+};
+
+// Parse the metadata of a SigMF recording. Returns 0 on success, -1 for
+// invalid metadata or sample formats other than complex 8 bit, and complex
+// little endian 16 and 32 bit integers and 32 bit floats.
+int rffft_sigmf_meta(FILE * file, struct rffft_sigmf * sigmf);
+void rffft_sigmf_free(struct rffft_sigmf * sigmf);
+
+// Capture segment holding sample n
+int rffft_sigmf_segment(const struct rffft_sigmf * sigmf, int64_t n);
+
+// Position of sample n in the data file (bytes)
+int64_t rffft_sigmf_offset(const struct rffft_sigmf * sigmf, int64_t n);
+
+// UTC of an ISO 8601 date and time (YYYY-MM-DDTHH:MM:SS.sss), as Unix time
+int rffft_datetime(const char * s, double * t);
+
+// UTC of sample n, and the sample at UTC t (Unix time)
+double rffft_sigmf_time(const struct rffft_sigmf * sigmf, int64_t n);
+int64_t rffft_sigmf_sample(const struct rffft_sigmf * sigmf, double t);
+
+// Instruction set levels of the unpack kernels
+#define RFFFT_SIMD_NONE 0
+#define RFFFT_SIMD_SSE2 1
+#define RFFFT_SIMD_AVX2 2
+#define RFFFT_SIMD_AVX512 3
+
+// Best unpack kernel supported by this CPU, and its name
+int rffft_simd_level(void);
+const char * rffft_simd_name(int level);
+
+// Convert nsamp raw complex samples to windowed interleaved floats in a
+// single pass, using the best kernel for this CPU
+// format: input sample format ('c', 'u', 'p', 'i', 'f', 'w')
+// zw: window, nsamp values
+// sign: -1 to invert frequencies (conjugate), 1 otherwise
+// nsquare: number of times to square the samples (0, 1 or 2)
+void rffft_unpack(char format, const void * buffer, int nsamp, const float * zw, int sign, int nsquare, float * c);
+
+// As rffft_unpack, with the kernel for the given level
+void rffft_unpack_simd(int level, char format, const void * buffer, int nsamp, const float * zw, int sign, int nsquare, float * c);
+
+// Count the nsamp interleaved complex samples of x with a power above
+// thresh*w2[i], and sum the power and the weights w2 of the others into
+// sum and wsum. For windowed samples, w2 holds the squared window, so the
+// threshold applies to the power before windowing and sum/wsum estimates
+// its mean.
+int rffft_count_above(const float * x, const float * w2, int nsamp, float thresh, float * sum, float * wsum);
+
+// As rffft_count_above, with the kernel for the given level
+int rffft_count_above_simd(int level, const float * x, const float * w2, int nsamp, float thresh, float * sum, float * wsum);
+
+// Blank the samples counted by rffft_count_above: zero them, or scale them
+// down to the threshold if clip is set. Returns the number blanked.
+int rffft_blank(float * x, const float * w2, int nsamp, float thresh, int clip, float * sum, float * wsum);
+
+// Square nsamp interleaved complex samples in place
+void rffft_square(float * c, int nsamp);
+
+// Prototype filter of a critically sampled polyphase filterbank:
+// a Blackman-Harris windowed sinc of nchan*ntap coefficients, with a
+// cutoff at half a channel and the same DC gain as the Hamming window
+void rffft_pfb_coefficients(int nchan, int ntap, float * h);
+
+// Weight ntap consecutive blocks of nchan interleaved complex samples in x
+// with the prototype filter h and sum them into the nchan samples of c
+void rffft_pfb(const float * x, const float * h, int nchan, int ntap, float * c);
+
+// Add the power of an nchan point FFT to z, swapping halves so the
+// center frequency ends up in channel nchan/2
+void rffft_accumulate(const float * d, int nchan, float * z);
+
+// As rffft_accumulate, and also keep the peak and minimum power, and the
+// sum of the squared power (|X|^4) for spectral kurtosis, in the planes
+// z[nchan..2*nchan), z[2*nchan..3*nchan) and z[3*nchan..4*nchan)
+void rffft_accumulate_stats(const float * d, int nchan, float * z);
+
 #ifdef __cplusplus
 }
 #endif
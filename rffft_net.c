@@ -0,0 +1,528 @@
+// For recvmmsg
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "rffft_net.h"
+
+// Datagrams per receive call, and largest datagram
+#define NBATCH 64
+#define MAXPACKET 65536
+
+// The input ends after this long without datagrams (s)
+#define NETIDLE 5.0
+
+// Monotonic clock (s)
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+
+  return ts.tv_sec+1e-9*ts.tv_nsec;
+}
+
+int rffft_net_url(const char *name)
+{
+  return strncmp(name,"tcp://",6)==0 || strncmp(name,"rtltcp://",9)==0 || strncmp(name,"udp://",6)==0;
+}
+
+// Split <scheme>://<host>:<port>[?seq], the host may be empty or in brackets
+static int parse_url(struct rffft_net *n,const char *url,char *host,char *port)
+{
+  const char *s;
+  char *p;
+
+  if (strncmp(url,"tcp://",6)==0)
+    n->proto=RFFFT_NET_TCP;
+  else if (strncmp(url,"rtltcp://",9)==0)
+    n->proto=RFFFT_NET_RTLTCP;
+  else if (strncmp(url,"udp://",6)==0)
+    n->proto=RFFFT_NET_UDP;
+  else
+    return -1;
+  s=strstr(url,"://")+3;
+  if (strlen(s)>=128)
+    return -1;
+  strcpy(host,s);
+
+  // Options
+  n->seq=0;
+  p=strchr(host,'?');
+  if (p!=NULL) {
+    if (strcmp(p,"?seq")!=0 || n->proto!=RFFFT_NET_UDP)
+      return -1;
+    n->seq=1;
+    *p='\0';
+  }
+
+  p=strrchr(host,':');
+  if (p==NULL || strlen(p+1)==0)
+    return -1;
+  strcpy(port,p+1);
+  *p='\0';
+  if (host[0]=='[' && p[-1]==']') {
+    memmove(host,host+1,strlen(host)-2);
+    host[strlen(host)-2]='\0';
+  }
+  if (host[0]=='\0' && n->proto!=RFFFT_NET_UDP)
+    return -1;
+
+  return 0;
+}
+
+// Copy n bytes into the ring at stream position pos, or zeros if data is NULL
+static void ring_put(struct rffft_net *n,uint64_t pos,const char *data,size_t m)
+{
+  size_t off=pos&(n->nring-1),k;
+
+  k=(m<n->nring-off) ? m : n->nring-off;
+  if (data!=NULL) {
+    memcpy(n->ring+off,data,k);
+    memcpy(n->ring,data+k,m-k);
+  } else {
+    memset(n->ring+off,0,k);
+    memset(n->ring,0,m-k);
+  }
+
+  return;
+}
+
+// Commit datagrams in sequence, giving up on a missing one once depth
+// later ones arrived, or all of them when flushing
+static void commit(struct rffft_net *n,int flush)
+{
+  int i;
+
+  while (n->seqnext<=n->seqmax) {
+    i=n->seqnext%n->npkt;
+    if (n->have[i]) {
+      n->have[i]=0;
+    } else if (flush || n->seqmax>=n->seqnext+n->depth) {
+      ring_put(n,n->head,NULL,n->plen);
+      n->nlost++;
+    } else {
+      break;
+    }
+    n->head+=n->plen;
+    n->seqnext++;
+  }
+
+  return;
+}
+
+// Add a datagram, called with the lock held
+static void add_datagram(struct rffft_net *n,const char *data,size_t m)
+{
+  uint64_t seq;
+  int i;
+
+  n->npacket++;
+  n->nbytes+=m;
+
+  // Without sequence numbers, append what fits
+  if (n->seq==0) {
+    if (m>n->nring-(n->head-n->tail)) {
+      n->noverflow++;
+      return;
+    }
+    ring_put(n,n->head,data,m);
+    n->head+=m;
+    return;
+  }
+
+  if (m<=8) {
+    n->nbad++;
+    return;
+  }
+  for (i=7,seq=0;i>=0;i--)
+    seq=(seq<<8)|(unsigned char) data[i];
+  data+=8;
+  m-=8;
+
+  // The first datagram sets the payload size and the slots
+  if (n->plen==0) {
+    n->plen=(int) m;
+    n->npkt=(int) (n->nring/m);
+    n->have=(unsigned char *) calloc(n->npkt,1);
+    n->depth=(int) ceil(n->jitter*n->samp_rate*n->size/m);
+    if (n->depth<1)
+      n->depth=1;
+    if (n->depth>n->npkt/2)
+      n->depth=n->npkt/2;
+    n->seqnext=seq;
+    n->seqmax=seq;
+  }
+  if ((int) m!=n->plen) {
+    n->nbad++;
+    return;
+  }
+
+  // A sender restart, or a jump beyond the ring, starts afresh
+  if (seq+n->npkt<n->seqnext || seq>=n->seqnext+n->npkt) {
+    commit(n,1);
+    n->seqnext=seq;
+    n->seqmax=seq;
+    n->nresync++;
+  }
+  if (seq<n->seqnext) {
+    n->nlate++;
+    return;
+  }
+  if (n->have[seq%n->npkt])
+    return;
+
+  // Place the payload at its position if the reader left room for it
+  if (n->head+(seq-n->seqnext+1)*n->plen-n->tail>n->nring) {
+    n->noverflow++;
+    return;
+  }
+  ring_put(n,n->head+(seq-n->seqnext)*n->plen,data,m);
+  n->have[seq%n->npkt]=1;
+  if (seq<n->seqmax)
+    n->nreorder++;
+  else
+    n->seqmax=seq;
+
+  commit(n,0);
+
+  return;
+}
+
+// Receive up to NBATCH datagrams, returns the number received
+static int receive(struct rffft_net *n,char *buf,size_t *len)
+{
+#ifdef __linux__
+  struct mmsghdr msg[NBATCH];
+  struct iovec iov[NBATCH];
+  int i,m;
+
+  memset(msg,0,sizeof(msg));
+  for (i=0;i<NBATCH;i++) {
+    iov[i].iov_base=buf+(size_t) i*MAXPACKET;
+    iov[i].iov_len=MAXPACKET;
+    msg[i].msg_hdr.msg_iov=&iov[i];
+    msg[i].msg_hdr.msg_iovlen=1;
+  }
+  m=recvmmsg(n->fd,msg,NBATCH,MSG_WAITFORONE,NULL);
+  for (i=0;i<m;i++)
+    len[i]=msg[i].msg_len;
+
+  return m;
+#else
+  ssize_t m;
+
+  m=recv(n->fd,buf,MAXPACKET,0);
+  if (m<0)
+    return -1;
+  len[0]=m;
+
+  return 1;
+#endif
+}
+
+// UDP receiver thread
+static void *udp_thread(void *arg)
+{
+  struct rffft_net *n=(struct rffft_net *) arg;
+  char *buf;
+  size_t len[NBATCH];
+  int i,m,done;
+  long nlost=0;
+  double t,tlast=0.0,treport=0.0;
+
+  buf=(char *) malloc((size_t) NBATCH*MAXPACKET);
+  for (;;) {
+    m=receive(n,buf,len);
+    t=now();
+    pthread_mutex_lock(&n->lock);
+    done=n->done;
+    pthread_mutex_unlock(&n->lock);
+    if (done)
+      break;
+    if (m<=0) {
+      if (m<0 && errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=EINTR) {
+        fprintf(stderr,"Error receiving datagrams: %s\n",strerror(errno));
+        break;
+      }
+      // The input ends once the sender stops
+      if (tlast>0.0 && t-tlast>NETIDLE)
+        break;
+      continue;
+    }
+    tlast=t;
+
+    pthread_mutex_lock(&n->lock);
+    for (i=0;i<m;i++)
+      add_datagram(n,buf+(size_t) i*MAXPACKET,len[i]);
+    if (m>n->nbatch)
+      n->nbatch=m;
+    pthread_cond_broadcast(&n->cond);
+    pthread_mutex_unlock(&n->lock);
+
+    // Report losses as they happen, at most once a second
+    if (n->nlost+n->noverflow>nlost && t-treport>=1.0) {
+      fprintf(stderr,"Network input: %ld datagrams lost, %ld dropped for lack of buffer space\n",n->nlost,n->noverflow);
+      nlost=n->nlost+n->noverflow;
+      treport=t;
+    }
+  }
+  free(buf);
+
+  // Whatever is still waiting for missing datagrams
+  pthread_mutex_lock(&n->lock);
+  if (n->seq && n->plen>0)
+    commit(n,1);
+  n->eof=1;
+  pthread_cond_broadcast(&n->cond);
+  pthread_mutex_unlock(&n->lock);
+
+  return NULL;
+}
+
+// TCP receiver thread, receives straight into the ring
+static void *tcp_thread(void *arg)
+{
+  struct rffft_net *n=(struct rffft_net *) arg;
+  size_t off,m;
+  ssize_t r;
+  int done;
+
+  for (;;) {
+    // Wait for room
+    pthread_mutex_lock(&n->lock);
+    if (n->head-n->tail==n->nring) {
+      n->nwait++;
+      while (n->head-n->tail==n->nring && n->done==0)
+        pthread_cond_wait(&n->cond,&n->lock);
+    }
+    off=n->head&(n->nring-1);
+    m=n->nring-(n->head-n->tail);
+    if (m>n->nring-off)
+      m=n->nring-off;
+    done=n->done;
+    pthread_mutex_unlock(&n->lock);
+    if (done)
+      break;
+
+    r=recv(n->fd,n->ring+off,m,0);
+    if (r<0 && errno==EINTR)
+      continue;
+    if (r<=0)
+      break;
+
+    pthread_mutex_lock(&n->lock);
+    n->head+=r;
+    n->npacket++;
+    n->nbytes+=r;
+    pthread_cond_broadcast(&n->cond);
+    pthread_mutex_unlock(&n->lock);
+  }
+
+  pthread_mutex_lock(&n->lock);
+  n->eof=1;
+  pthread_cond_broadcast(&n->cond);
+  pthread_mutex_unlock(&n->lock);
+
+  return NULL;
+}
+
+// Send an rtl_tcp command
+static int rtltcp_command(int fd,int cmd,uint32_t value)
+{
+  unsigned char buf[5];
+
+  buf[0]=cmd;
+  buf[1]=value>>24;
+  buf[2]=value>>16;
+  buf[3]=value>>8;
+  buf[4]=value;
+
+  return (send(fd,buf,5,0)==5) ? 0 : -1;
+}
+
+// Check the rtl_tcp greeting and tune
+static int rtltcp_start(struct rffft_net *n,double freq,double samp_rate)
+{
+  unsigned char hdr[12];
+  size_t k;
+  ssize_t r;
+
+  for (k=0;k<sizeof(hdr);k+=r) {
+    r=recv(n->fd,hdr+k,sizeof(hdr)-k,0);
+    if (r<=0)
+      break;
+  }
+  if (k<sizeof(hdr) || memcmp(hdr,"RTL0",4)!=0) {
+    fprintf(stderr,"Not an rtl_tcp server\n");
+    return -1;
+  }
+  printf("rtl_tcp: tuner type %u, %u gains\n",(hdr[4]<<24)|(hdr[5]<<16)|(hdr[6]<<8)|hdr[7],(hdr[8]<<24)|(hdr[9]<<16)|(hdr[10]<<8)|hdr[11]);
+
+  // Set sample rate (2) and frequency (1)
+  if (rtltcp_command(n->fd,2,(uint32_t) samp_rate)!=0 || rtltcp_command(n->fd,1,(uint32_t) freq)!=0) {
+    fprintf(stderr,"Error tuning rtl_tcp server\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+int rffft_net_open(struct rffft_net *n,const char *url,int size,double freq,double samp_rate,double jitter)
+{
+  struct addrinfo hints,*res,*ai;
+  struct sockaddr_storage addr;
+  socklen_t alen=sizeof(addr);
+  struct timeval tv={0,200000};
+  char host[128],port[128];
+  int rcvbuf=8<<20;
+  double nbytes;
+
+  if (parse_url(n,url,host,port)!=0) {
+    fprintf(stderr,"Invalid network input %s, expected tcp://<host>:<port>, rtltcp://<host>:<port> or udp://[<host>]:<port>[?seq]\n",url);
+    return -1;
+  }
+
+  // Connect, or bind for datagrams
+  memset(&hints,0,sizeof(hints));
+  hints.ai_family=AF_UNSPEC;
+  hints.ai_socktype=(n->proto==RFFFT_NET_UDP) ? SOCK_DGRAM : SOCK_STREAM;
+  hints.ai_flags=(n->proto==RFFFT_NET_UDP) ? AI_PASSIVE : 0;
+  if (getaddrinfo((host[0]=='\0') ? NULL : host,port,&hints,&res)!=0) {
+    fprintf(stderr,"Unknown host %s\n",host);
+    return -1;
+  }
+  for (ai=res,n->fd=-1;ai!=NULL;ai=ai->ai_next) {
+    n->fd=socket(ai->ai_family,ai->ai_socktype,ai->ai_protocol);
+    if (n->fd<0)
+      continue;
+    if (n->proto==RFFFT_NET_UDP) {
+      setsockopt(n->fd,SOL_SOCKET,SO_RCVBUF,&rcvbuf,sizeof(rcvbuf));
+      if (bind(n->fd,ai->ai_addr,ai->ai_addrlen)==0)
+        break;
+    } else if (connect(n->fd,ai->ai_addr,ai->ai_addrlen)==0) {
+      break;
+    }
+    close(n->fd);
+    n->fd=-1;
+  }
+  freeaddrinfo(res);
+  if (n->fd<0) {
+    fprintf(stderr,"Error opening %s: %s\n",url,strerror(errno));
+    return -1;
+  }
+
+  // Wake up regularly to notice the end of the input
+  if (n->proto==RFFFT_NET_UDP) {
+    setsockopt(n->fd,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof(tv));
+    if (getsockname(n->fd,(struct sockaddr *) &addr,&alen)==0)
+      n->port=ntohs((addr.ss_family==AF_INET6) ? ((struct sockaddr_in6 *) &addr)->sin6_port : ((struct sockaddr_in *) &addr)->sin_port);
+  }
+  if (n->proto==RFFFT_NET_RTLTCP && rtltcp_start(n,freq,samp_rate)!=0) {
+    close(n->fd);
+    return -1;
+  }
+
+  // Ring of half a second of samples and twice the jitter buffer, at
+  // least 4 MB
+  nbytes=(0.5+2.0*jitter)*samp_rate*size;
+  for (n->nring=4<<20;n->nring<nbytes;n->nring*=2);
+  n->ring=(char *) malloc(n->nring);
+  n->size=size;
+  n->jitter=jitter;
+  n->samp_rate=samp_rate;
+  n->head=0;
+  n->tail=0;
+  n->eof=0;
+  n->done=0;
+  n->plen=0;
+  n->have=NULL;
+  n->npacket=0;
+  n->nbytes=0.0;
+  n->nlost=0;
+  n->nlate=0;
+  n->nreorder=0;
+  n->noverflow=0;
+  n->nbad=0;
+  n->nresync=0;
+  n->nwait=0;
+  n->nbatch=0;
+  pthread_mutex_init(&n->lock,NULL);
+  pthread_cond_init(&n->cond,NULL);
+
+  if (pthread_create(&n->thread,NULL,(n->proto==RFFFT_NET_UDP) ? udp_thread : tcp_thread,n)!=0) {
+    fprintf(stderr,"Error creating threads\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+int rffft_net_read(void *net,void *buffer,int nsamp)
+{
+  struct rffft_net *n=(struct rffft_net *) net;
+  size_t off,m,k;
+
+  // Wait for a whole sample
+  pthread_mutex_lock(&n->lock);
+  while (n->head-n->tail<(uint64_t) n->size && n->eof==0)
+    pthread_cond_wait(&n->cond,&n->lock);
+  m=(n->head-n->tail)/n->size;
+  pthread_mutex_unlock(&n->lock);
+
+  if (m>(size_t) nsamp)
+    m=nsamp;
+  m*=n->size;
+  off=n->tail&(n->nring-1);
+  k=(m<n->nring-off) ? m : n->nring-off;
+  memcpy(buffer,n->ring+off,k);
+  memcpy((char *) buffer+k,n->ring,m-k);
+
+  pthread_mutex_lock(&n->lock);
+  n->tail+=m;
+  pthread_cond_broadcast(&n->cond);
+  pthread_mutex_unlock(&n->lock);
+
+  return (int) (m/n->size);
+}
+
+void rffft_net_close(struct rffft_net *n)
+{
+  pthread_mutex_lock(&n->lock);
+  n->done=1;
+  pthread_cond_broadcast(&n->cond);
+  pthread_mutex_unlock(&n->lock);
+  shutdown(n->fd,SHUT_RDWR);
+  pthread_join(n->thread,NULL);
+
+  close(n->fd);
+  pthread_mutex_destroy(&n->lock);
+  pthread_cond_destroy(&n->cond);
+  free(n->ring);
+  free(n->have);
+
+  return;
+}
+
+void rffft_net_report(struct rffft_net *n)
+{
+  if (n->proto!=RFFFT_NET_UDP) {
+    printf("Network input: %.3f MB in %ld reads, receiver waited %ld times for free buffer space\n",n->nbytes*1e-6,n->npacket,n->nwait);
+    return;
+  }
+  printf("Network input: %ld datagrams of %.3f MB in total, at most %d per receive call\n",n->npacket,n->nbytes*1e-6,n->nbatch);
+  if (n->seq)
+    printf("Network input: %ld datagrams lost and replaced by zeros, %ld reordered, %ld late, %ld sequence jumps\n",n->nlost,n->nreorder,n->nlate,n->nresync);
+  if (n->noverflow>0 || n->nbad>0)
+    printf("Network input: %ld datagrams dropped for lack of buffer space, %ld of an unexpected size\n",n->noverflow,n->nbad);
+
+  return;
+}
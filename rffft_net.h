@@ -0,0 +1,84 @@
+#ifndef _RFFFT_NET_H
+#define _RFFFT_NET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Protocols
+#define RFFFT_NET_TCP 1      // Raw samples from a TCP server
+#define RFFFT_NET_RTLTCP 2   // rtl_tcp server, unsigned 8 bit samples
+#define RFFFT_NET_UDP 3      // Raw samples in UDP datagrams
+
+// Network input. A receiver thread fills a ring of samples, which is also
+// the jitter buffer: sequenced UDP datagrams are placed at their position
+// in the stream, so datagrams arriving out of order still fill their slot,
+// and those missing once later ones have filled the jitter buffer are
+// replaced by zeros, which keeps the sample count and the timestamps.
+struct rffft_net {
+  int proto;
+  int seq;                   // Datagrams start with a 64 bit little endian
+                             // sequence number
+  int fd;
+  int port;                  // Local port of UDP input
+  int size;                  // Bytes per sample
+  char *ring;                // Ring of nring bytes, a power of two
+  size_t nring;
+  uint64_t head,tail;        // Stream bytes committed and read
+  int eof,done;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t thread;
+
+  // Reordering of sequenced datagrams
+  double jitter;             // Jitter buffer (s)
+  double samp_rate;
+  int plen;                  // Payload bytes per datagram [0: none seen yet]
+  int depth;                 // Datagrams received before a missing one is lost
+  int npkt;                  // Datagram slots in the ring
+  unsigned char *have;       // Datagrams received ahead of seqnext, per slot
+  uint64_t seqnext;          // Next sequence number to commit
+  uint64_t seqmax;           // Highest sequence number received
+
+  // Statistics
+  long npacket;              // Datagrams or TCP reads received
+  double nbytes;             // Bytes received
+  long nlost;                // Datagrams replaced by zeros
+  long nlate;                // Datagrams arriving after being given up
+  long nreorder;             // Datagrams arriving out of order
+  long noverflow;            // Datagrams dropped as the ring was full
+  long nbad;                 // Datagrams of an unexpected size
+  long nresync;              // Jumps in the sequence numbers
+  long nwait;                // Times the receiver waited for the reader
+  int nbatch;                // Largest number of datagrams per receive call
+};
+
+// Whether name is a network input URL
+int rffft_net_url(const char *name);
+
+// Connect to a server, or listen for datagrams, with samples of size bytes:
+//   tcp://<host>:<port>         raw samples from a TCP server
+//   rtltcp://<host>:<port>      rtl_tcp server, tuned to freq and samp_rate
+//   udp://[<host>]:<port>[?seq] raw samples in UDP datagrams, with ?seq
+//                               prefixed by a sequence number
+int rffft_net_open(struct rffft_net *n,const char *url,int size,double freq,double samp_rate,double jitter);
+
+// Read callback, waits for up to nsamp samples and returns the number
+// read, 0 once the input ended
+int rffft_net_read(void *net,void *buffer,int nsamp);
+
+// Stop receiving and free the ring
+void rffft_net_close(struct rffft_net *n);
+
+// Print reception statistics
+void rffft_net_report(struct rffft_net *n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RFFFT_NET_H */
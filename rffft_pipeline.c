@@ -0,0 +1,912 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <fftw3.h>
+#include "rffft_internal.h"
+#include "rffft_pipeline.h"
+
+// Target number of complex samples per input block
+#define BLOCKSIZE 262144
+
+// Samples buffered by a tee
+#define TEESIZE (16*BLOCKSIZE)
+
+// The FFTW planner is not thread safe, and several pipelines may run at once
+static pthread_mutex_t planner_lock=PTHREAD_MUTEX_INITIALIZER;
+
+// Input block; turn is 2*seq while free to hold block seq, 2*seq+1 once filled
+struct block {
+  atomic_long turn;
+  long isub;
+  int iblock,j0,nframe,nuse;
+  char *buf;
+  const char *data;  // Samples of the block, in buf or in the mapped input
+};
+
+// Subintegration slot; turn is 2*isub while free, 2*isub+1 while in use
+struct slot {
+  atomic_long turn;
+  atomic_int nadd;    // Number of blocks added so far
+  atomic_int nblock;  // Number of blocks in this subint, -1 while reading
+  struct rffft_subint s;
+};
+
+struct state;
+
+// FFT thread with its own plans and partial spectrum
+struct worker {
+  struct state *st;
+  fftwf_complex *c,*d;
+  fftwf_plan fft,fftb;
+  float *x,*z;
+  long nblank,nexam;  // Samples blanked and examined in the current block
+  double tbusy;
+  pthread_t thread;
+};
+
+struct state {
+  struct rffft_pipeline *p;
+  int nblk,nslot,nsub;
+  struct block *block;
+  struct slot *slot;
+  struct worker *worker;
+  int nhist;           // Samples of history preceding each block
+  char *hist;          // Tail of the previous block
+  int mapped;          // Blocks point into the mapped input
+  const char *cur;     // End of the mapped samples read so far
+  float *ones;         // Unit window for the filterbank input
+  float *zw2;          // Window applied to the power, for blanking
+  atomic_long next;    // Next block to be claimed by an FFT thread
+  atomic_long ntotal;  // Number of blocks read, -1 while reading
+  atomic_long nsbusy;  // Summed FFT thread CPU time (ns)
+  int nuse;            // Current nuse, adapted to the load
+  double tadapt,busy;  // Wall clock and busy time at the last adaptation (s)
+};
+
+// Monotonic clock (s)
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+
+  return ts.tv_sec+1e-9*ts.tv_nsec;
+}
+
+// CPU time used by the calling thread (s)
+static double cputime(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID,&ts);
+
+  return ts.tv_sec+1e-9*ts.tv_nsec;
+}
+
+// Wait a little while polling
+static void backoff(int *n)
+{
+  struct timespec ts={0,50000};
+
+  if ((*n)++<64)
+    sched_yield();
+  else
+    nanosleep(&ts,NULL);
+
+  return;
+}
+
+// Number of values per spectrum, with the extra planes
+static int nplane(struct rffft_pipeline *p)
+{
+  return (p->stats) ? 4*p->nchan : p->nchan;
+}
+
+// Clear a spectrum and its extra planes
+static void clear_spectrum(struct rffft_pipeline *p,float *z)
+{
+  int i;
+
+  for (i=0;i<p->nchan;i++)
+    z[i]=0.0;
+  if (p->stats) {
+    for (i=0;i<p->nchan;i++) {
+      z[p->nchan+i]=0.0;
+      z[2*p->nchan+i]=HUGE_VALF;
+      z[3*p->nchan+i]=0.0;
+    }
+  }
+
+  return;
+}
+
+// Add a partial spectrum, taking the peak and minimum of the extra planes
+static void add_spectrum(struct rffft_pipeline *p,float *z,const float *w)
+{
+  int i;
+
+  for (i=0;i<p->nchan;i++)
+    z[i]+=w[i];
+  if (p->stats) {
+    for (i=0;i<p->nchan;i++) {
+      if (w[p->nchan+i]>z[p->nchan+i])
+        z[p->nchan+i]=w[p->nchan+i];
+      if (w[2*p->nchan+i]<z[2*p->nchan+i])
+        z[2*p->nchan+i]=w[2*p->nchan+i];
+      z[3*p->nchan+i]+=w[3*p->nchan+i];
+    }
+  }
+
+  return;
+}
+
+// Account FFT thread CPU time
+static void add_busy(struct state *st,struct worker *w,double t)
+{
+  w->tbusy+=t;
+  atomic_fetch_add(&st->nsbusy,(long) (1e9*t));
+
+  return;
+}
+
+// Number of spectra j0 to j0+nframe-1 that are transformed
+static int count_used(int j0,int nframe,int nuse)
+{
+  return (j0+nframe+nuse-1)/nuse-(j0+nuse-1)/nuse;
+}
+
+// Adapt nuse to the load of the FFT threads since the previous call. The
+// FFT cost scales with the number of spectra transformed, so nuse is raised
+// in proportion to an overload, and lowered one step at a time once the
+// load would stay clearly below the target.
+static void adapt_nuse(struct state *st)
+{
+  struct rffft_pipeline *p=st->p;
+  int nworker=(p->nthreads>0) ? p->nthreads : 1;
+  double t,busy,load;
+
+  t=now();
+  busy=1e-9*atomic_load(&st->nsbusy);
+  if (p->load>0.0 && t>st->tadapt) {
+    load=(busy-st->busy)/(nworker*(t-st->tadapt));
+    if (load>p->load)
+      st->nuse=(int) ceil(st->nuse*load/p->load);
+    else if (st->nuse>p->nuse && load*st->nuse/(st->nuse-1)<0.9*p->load)
+      st->nuse--;
+    if (st->nuse>p->nint)
+      st->nuse=p->nint;
+    if (st->nuse>p->nusemax)
+      p->nusemax=st->nuse;
+  }
+  st->tadapt=t;
+  st->busy=busy;
+
+  return;
+}
+
+// Map up to nframe spectra of the input, pointing *data at the block
+// including its history, which precedes it in the mapping. Only a partial
+// spectrum at the end of the input is copied to buf to be zero padded.
+static int map_block(struct state *st,char *buf,int nframe,int *eof,const char **data)
+{
+  struct rffft_pipeline *p=st->p;
+  int n,m,nsamp,size;
+  const char *ptr,*start;
+
+  size=rffft_sample_size(p->informat);
+  nsamp=nframe*p->step;
+
+  for (n=0;n<nsamp;n+=m) {
+    m=p->map(p->input,&ptr,nsamp-n);
+    if (m<=0)
+      break;
+    st->cur=ptr+(size_t) m*size;
+  }
+  p->nsamp+=n;
+  *eof=(n<nsamp);
+
+  start=st->cur-(size_t) (n+st->nhist)*size;
+  if (n%p->step==0) {
+    *data=start;
+  } else {
+    memcpy(buf,start,(size_t) (n+st->nhist)*size);
+    memset(buf+(size_t) (n+st->nhist)*size,0,(size_t) (p->step-n%p->step)*size);
+    *data=buf;
+  }
+
+  return (n+p->step-1)/p->step;
+}
+
+// Read up to nframe spectra, returns the number of (partial) spectra read
+// and flags the end of the input on a short read. The block starts with
+// the last nhist samples of the previous block, so consecutive spectra
+// may overlap and the filterbank sees its full input.
+static int read_block(struct state *st,char *buf,int nframe,int *eof,const char **block)
+{
+  struct rffft_pipeline *p=st->p;
+  int n,m,nsamp,size;
+  char *data;
+
+  if (st->mapped)
+    return map_block(st,buf,nframe,eof,block);
+
+  size=rffft_sample_size(p->informat);
+  nsamp=nframe*p->step;
+  data=buf+(size_t) st->nhist*size;
+  *block=buf;
+
+  // Prepend history
+  if (st->nhist>0)
+    memcpy(buf,st->hist,(size_t) st->nhist*size);
+
+  for (n=0;n<nsamp;n+=m) {
+    m=p->read(p->input,data+(size_t) n*size,nsamp-n);
+    if (m<=0)
+      break;
+  }
+  p->nsamp+=n;
+  *eof=(n<nsamp);
+
+  // Zero pad partial spectrum
+  if (n%p->step!=0)
+    memset(data+(size_t) n*size,0,(size_t) (p->step-n%p->step)*size);
+
+  // Keep history
+  if (st->nhist>0)
+    memcpy(st->hist,buf+(size_t) n*size,(size_t) st->nhist*size);
+
+  return (n+p->step-1)/p->step;
+}
+
+// Add the power of a spectrum
+static void accumulate(struct rffft_pipeline *p,const float *d,float *z)
+{
+  if (p->stats)
+    rffft_accumulate_stats(d,p->nchan,z);
+  else
+    rffft_accumulate(d,p->nchan,z);
+
+  return;
+}
+
+// Blank impulses in the samples of a spectrum, with a threshold on their
+// power before windowing. The threshold follows a running estimate of the
+// mean power, which starts afresh at each block from the median power of 8
+// stretches of its first spectrum, unaffected by impulses covering less
+// than half of it. Results then do not depend on which thread processes
+// the block.
+static void blank_samples(struct rffft_pipeline *p,struct worker *w,float *x,const float *w2,int n,float *pw)
+{
+  int i,j,m,nseg;
+  float k2=p->blank*p->blank,sum,wsum,seg[8],t;
+
+  if (*pw<0.0) {
+    nseg=(n>=8) ? 8 : 1;
+    for (i=0;i<nseg;i++) {
+      j=i*n/nseg;
+      m=(i+1)*n/nseg-j;
+      rffft_count_above(x+2*(size_t) j,w2+j,m,HUGE_VALF,&sum,&wsum);
+      seg[i]=(wsum>0.0) ? sum/wsum : 0.0;
+
+      // Insert in order
+      for (j=i;j>0 && seg[j-1]>seg[j];j--) {
+        t=seg[j];
+        seg[j]=seg[j-1];
+        seg[j-1]=t;
+      }
+    }
+    *pw=0.5*(seg[(nseg-1)/2]+seg[nseg/2]);
+  }
+
+  m=rffft_blank(x,w2,n,k2*(*pw),p->clip,&sum,&wsum);
+  w->nblank+=m;
+  w->nexam+=n;
+
+  // Update the running estimate with the samples that were kept, and start
+  // afresh if none were, as after a gap in the input
+  if (wsum>0.0)
+    *pw+=(sum/wsum-*pw)/16.0;
+  else
+    *pw=-1.0;
+
+  return;
+}
+
+// Integrate the spectra in a block into the partial spectrum of a worker
+static void process_block(struct rffft_pipeline *p,struct worker *w,const char *buf,int j0,int nframe,int nuse)
+{
+  int j,k,n,size;
+  float *c,pw=-1.0;
+  const char *raw;
+
+  size=rffft_sample_size(p->informat);
+
+  clear_spectrum(p,w->z);
+  w->nblank=0;
+  w->nexam=0;
+
+  for (j=0,n=0;j<nframe;j++) {
+    // Skip spectrum
+    if ((j0+j)%nuse!=0)
+      continue;
+
+    c=(float *) w->c[(size_t) n*p->nchan];
+    raw=buf+(size_t) j*p->step*size;
+    if (p->ntap==1) {
+      // Unpack, window and square straight into the FFT input
+      rffft_unpack(p->informat,raw,p->nchan,p->zw,p->sign,p->nsquare,c);
+      if (p->blank>0.0)
+        blank_samples(p,w,c,w->st->zw2,p->nchan,&pw);
+    } else {
+      // Polyphase filterbank, filter ntap spectra worth of samples
+      rffft_unpack(p->informat,raw,p->ntap*p->nchan,w->st->ones,p->sign,p->nsquare,w->x);
+      if (p->blank>0.0)
+        blank_samples(p,w,w->x,w->st->ones,p->ntap*p->nchan,&pw);
+      rffft_pfb(w->x,p->zw,p->nchan,p->ntap,c);
+    }
+
+    // Execute and add a full batch
+    if (++n==p->nbatch) {
+      fftwf_execute(w->fftb);
+      for (k=0;k<n;k++)
+        accumulate(p,(float *) w->d[(size_t) k*p->nchan],w->z);
+      n=0;
+    }
+  }
+
+  // Remaining spectra, one at a time
+  for (k=0;k<n;k++) {
+    if (k>0)
+      memcpy(w->c,w->c[(size_t) k*p->nchan],sizeof(fftwf_complex)*p->nchan);
+    fftwf_execute(w->fft);
+    accumulate(p,(float *) w->d,w->z);
+  }
+
+  return;
+}
+
+// Single threaded loop
+static void run_serial(struct state *st)
+{
+  struct rffft_pipeline *p=st->p;
+  struct worker *w=&st->worker[0];
+  struct rffft_subint *s=&st->slot[0].s;
+  char *buf=st->block[0].buf;
+  const char *data;
+  int j,n,nframe;
+  double t0;
+
+  for (s->isub=0;;s->isub++) {
+    // Initialize
+    clear_spectrum(p,s->z);
+    s->nframe=0;
+    s->nfft=0;
+    s->nblank=0;
+    s->nexam=0;
+    s->last=0;
+    adapt_nuse(st);
+    s->nuse=st->nuse;
+    gettimeofday(&s->start,0);
+
+    // Integrate
+    for (j=0;j<p->nint;j+=nframe) {
+      nframe=(p->nint-j<p->nframe) ? p->nint-j : p->nframe;
+      n=read_block(st,buf,nframe,&s->last,&data);
+      if (n>0) {
+        t0=cputime();
+        process_block(p,w,data,j,n,s->nuse);
+        add_spectrum(p,s->z,w->z);
+        s->nblank+=w->nblank;
+        s->nexam+=w->nexam;
+        add_busy(st,w,cputime()-t0);
+        s->nframe+=n;
+        s->nfft+=count_used(j,n,s->nuse);
+      }
+      if (s->last)
+        break;
+    }
+    gettimeofday(&s->end,0);
+    s->isamp=s->isub*p->nint*p->step;
+    s->nread=p->nsamp;
+    if (p->nsubmax>0 && s->isub+1>=p->nsubmax)
+      s->last=1;
+
+    p->nblank+=s->nblank;
+    p->nexam+=s->nexam;
+    p->write(p->output,s);
+
+    if (s->last)
+      break;
+  }
+
+  return;
+}
+
+// Reader thread, drains the input into the block ring
+static void *reader_thread(void *arg)
+{
+  struct state *st=(struct state *) arg;
+  struct rffft_pipeline *p=st->p;
+  struct slot *sl;
+  struct block *b;
+  long seq=0,isub;
+  int j,k,n,ib,nframe,last=0;
+  double t0;
+
+  for (isub=0;last==0;isub++) {
+    sl=&st->slot[isub%st->nsub];
+
+    // Wait for the writer to release the subint slot
+    if (atomic_load(&sl->turn)!=2*isub) {
+      t0=now();
+      for (k=0;atomic_load(&sl->turn)!=2*isub;)
+        backoff(&k);
+      p->tstall+=now()-t0;
+    }
+
+    // Initialize
+    clear_spectrum(p,sl->s.z);
+    sl->s.isub=isub;
+    sl->s.nframe=0;
+    sl->s.nfft=0;
+    sl->s.nblank=0;
+    sl->s.nexam=0;
+    sl->s.last=0;
+    adapt_nuse(st);
+    sl->s.nuse=st->nuse;
+    atomic_store(&sl->nadd,0);
+    atomic_store(&sl->nblock,-1);
+    gettimeofday(&sl->s.start,0);
+    atomic_store(&sl->turn,2*isub+1);
+
+    // Read blocks
+    for (j=0,ib=0;j<p->nint;j+=nframe) {
+      nframe=(p->nint-j<p->nframe) ? p->nint-j : p->nframe;
+      b=&st->block[seq%st->nslot];
+
+      // Wait for an FFT thread to release the block
+      if (atomic_load(&b->turn)!=2*seq) {
+        t0=now();
+        for (k=0;atomic_load(&b->turn)!=2*seq;)
+          backoff(&k);
+        p->tstall+=now()-t0;
+      }
+
+      n=read_block(st,b->buf,nframe,&last,&b->data);
+      if (n>0) {
+        b->isub=isub;
+        b->iblock=ib;
+        b->j0=j;
+        b->nframe=n;
+        b->nuse=sl->s.nuse;
+        sl->s.nframe+=n;
+        sl->s.nfft+=count_used(j,n,b->nuse);
+        atomic_store(&b->turn,2*seq+1);
+        ib++;
+        seq++;
+      }
+      if (last)
+        break;
+    }
+    gettimeofday(&sl->s.end,0);
+    sl->s.isamp=isub*p->nint*p->step;
+    sl->s.nread=p->nsamp;
+    if (p->nsubmax>0 && isub+1>=p->nsubmax)
+      last=1;
+    sl->s.last=last;
+    atomic_store(&sl->nblock,ib);
+  }
+  atomic_store(&st->ntotal,seq);
+
+  return NULL;
+}
+
+// FFT thread, integrates blocks and adds them to their subint in order
+static void *fft_thread(void *arg)
+{
+  struct worker *w=(struct worker *) arg;
+  struct state *st=w->st;
+  struct rffft_pipeline *p=st->p;
+  struct block *b;
+  struct slot *sl;
+  long seq,ntotal;
+  int k,ib;
+  double t0;
+
+  for (;;) {
+    seq=atomic_fetch_add(&st->next,1);
+    b=&st->block[seq%st->nslot];
+
+    // Wait for the block, stop when the input is exhausted
+    for (k=0;atomic_load(&b->turn)!=2*seq+1;) {
+      ntotal=atomic_load(&st->ntotal);
+      if (ntotal>=0 && seq>=ntotal)
+        return NULL;
+      backoff(&k);
+    }
+
+    t0=cputime();
+    sl=&st->slot[b->isub%st->nsub];
+    ib=b->iblock;
+    process_block(p,w,b->data,b->j0,b->nframe,b->nuse);
+    atomic_store(&b->turn,2*(seq+st->nslot));
+    add_busy(st,w,cputime()-t0);
+
+    // Add in block order, so results do not depend on the number of threads
+    for (k=0;atomic_load(&sl->nadd)!=ib;)
+      backoff(&k);
+    add_spectrum(p,sl->s.z,w->z);
+    sl->s.nblank+=w->nblank;
+    sl->s.nexam+=w->nexam;
+    atomic_store(&sl->nadd,ib+1);
+  }
+
+  return NULL;
+}
+
+// Writer thread, emits finished subints in order
+static void *writer_thread(void *arg)
+{
+  struct state *st=(struct state *) arg;
+  struct rffft_pipeline *p=st->p;
+  struct slot *sl;
+  long isub;
+  int k,nblock,last;
+
+  for (isub=0;;isub++) {
+    sl=&st->slot[isub%st->nsub];
+
+    // Wait for all blocks of this subint
+    for (k=0;;backoff(&k)) {
+      if (atomic_load(&sl->turn)!=2*isub+1)
+        continue;
+      nblock=atomic_load(&sl->nblock);
+      if (nblock>=0 && atomic_load(&sl->nadd)==nblock)
+        break;
+    }
+
+    p->nblank+=sl->s.nblank;
+    p->nexam+=sl->s.nexam;
+    p->write(p->output,&sl->s);
+
+    last=sl->s.last;
+    atomic_store(&sl->turn,2*(isub+st->nsub));
+    if (last)
+      break;
+  }
+
+  return NULL;
+}
+
+int rffft_pipeline_run(struct rffft_pipeline *p)
+{
+  struct state st;
+  pthread_t reader,writer;
+  int i,n,nworker;
+  size_t size;
+  const char *data;
+  double t0;
+
+  // Spectra per block
+  if (p->step<=0 || p->step>p->nchan)
+    p->step=p->nchan;
+  if (p->nframe<=0) {
+    p->nframe=BLOCKSIZE/p->step;
+    if (p->nframe<1)
+      p->nframe=1;
+  }
+  if (p->nbatch<1)
+    p->nbatch=1;
+  if (p->nbatch>p->nint)
+    p->nbatch=p->nint;
+  p->nframe=(p->nframe+p->nbatch-1)/p->nbatch*p->nbatch;
+  if (p->nframe>p->nint)
+    p->nframe=p->nint;
+
+  // Ring sizes
+  if (p->ntap<1)
+    p->ntap=1;
+  nworker=(p->nthreads>0) ? p->nthreads : 1;
+  st.p=p;
+  st.nblk=(p->nint+p->nframe-1)/p->nframe;
+  st.nslot=(p->nthreads>0) ? 4*p->nthreads : 1;
+  st.nsub=(p->nthreads>0) ? st.nslot/st.nblk+2 : 1;
+  atomic_init(&st.next,0);
+  atomic_init(&st.ntotal,-1);
+  atomic_init(&st.nsbusy,0);
+  if (p->nuse<1)
+    p->nuse=1;
+  st.nuse=p->nuse;
+  p->nusemax=p->nuse;
+
+  // History for overlapping spectra and the filterbank
+  st.nhist=p->ntap*p->nchan-p->step;
+  st.hist=(char *) calloc((size_t) st.nhist+1,rffft_sample_size(p->informat));
+  st.ones=(float *) malloc(sizeof(float)*p->ntap*p->nchan);
+  for (i=0;i<p->ntap*p->nchan;i++)
+    st.ones[i]=1.0;
+  // The samples are windowed before they are squared nsquare times
+  st.zw2=(float *) malloc(sizeof(float)*p->nchan);
+  for (i=0;i<p->nchan;i++)
+    st.zw2[i]=pow(p->zw[i],2<<p->nsquare);
+
+  // Allocate
+  size=((size_t) p->nframe*p->step+st.nhist)*rffft_sample_size(p->informat);
+  st.block=(struct block *) malloc(sizeof(struct block)*st.nslot);
+  for (i=0;i<st.nslot;i++) {
+    atomic_init(&st.block[i].turn,2*i);
+    st.block[i].buf=(char *) malloc(size);
+  }
+  st.slot=(struct slot *) malloc(sizeof(struct slot)*st.nsub);
+  for (i=0;i<st.nsub;i++) {
+    atomic_init(&st.slot[i].turn,2*i);
+    atomic_init(&st.slot[i].nadd,0);
+    atomic_init(&st.slot[i].nblock,-1);
+    st.slot[i].s.z=(float *) malloc(sizeof(float)*nplane(p));
+  }
+
+  // Load wisdom from earlier runs
+  pthread_mutex_lock(&planner_lock);
+  if (p->wisdom!=NULL && p->planner!=FFTW_ESTIMATE)
+    fftwf_import_wisdom_from_filename(p->wisdom);
+
+  // Plans are created here, as the FFTW planner is not thread safe. The
+  // first worker does the planning, the others reuse its wisdom.
+  st.worker=(struct worker *) malloc(sizeof(struct worker)*nworker);
+  for (i=0;i<nworker;i++) {
+    st.worker[i].st=&st;
+    st.worker[i].c=fftwf_malloc(sizeof(fftwf_complex)*p->nchan*p->nbatch);
+    st.worker[i].d=fftwf_malloc(sizeof(fftwf_complex)*p->nchan*p->nbatch);
+    st.worker[i].z=(float *) malloc(sizeof(float)*nplane(p));
+    st.worker[i].x=(p->ntap>1) ? (float *) malloc(sizeof(float)*2*p->ntap*p->nchan) : NULL;
+    st.worker[i].fft=fftwf_plan_dft_1d(p->nchan,st.worker[i].c,st.worker[i].d,FFTW_FORWARD,p->planner);
+    st.worker[i].fftb=fftwf_plan_many_dft(1,&p->nchan,p->nbatch,st.worker[i].c,NULL,1,p->nchan,st.worker[i].d,NULL,1,p->nchan,FFTW_FORWARD,p->planner);
+    st.worker[i].tbusy=0.0;
+  }
+
+  // Store wisdom for later runs
+  if (p->wisdom!=NULL && p->planner!=FFTW_ESTIMATE) {
+    if (fftwf_export_wisdom_to_filename(p->wisdom)==0)
+      fprintf(stderr,"Error writing FFTW wisdom to %s\n",p->wisdom);
+  }
+  pthread_mutex_unlock(&planner_lock);
+
+  p->nsamp=0;
+  p->tstall=0.0;
+  p->nblank=0;
+  p->nexam=0;
+  t0=now();
+  st.tadapt=t0;
+  st.busy=0.0;
+
+  // Fill the history from the input, so the first spectra see data over
+  // their full length
+  st.mapped=(p->map!=NULL);
+  st.cur=NULL;
+  for (i=0,n=0;n<st.nhist;n+=i) {
+    if (st.mapped) {
+      i=p->map(p->input,&data,st.nhist-n);
+      if (i>0)
+        st.cur=data+(size_t) i*rffft_sample_size(p->informat);
+    } else {
+      i=p->read(p->input,st.hist+(size_t) n*rffft_sample_size(p->informat),st.nhist-n);
+    }
+    if (i<=0)
+      break;
+  }
+  p->nsamp+=n;
+
+  // An input shorter than the history is zero padded like a read one
+  if (st.mapped && n<st.nhist) {
+    if (n>0)
+      memcpy(st.hist,st.cur-(size_t) n*rffft_sample_size(p->informat),(size_t) n*rffft_sample_size(p->informat));
+    st.mapped=0;
+  }
+
+  if (p->nthreads==0) {
+    run_serial(&st);
+  } else {
+    if (pthread_create(&reader,NULL,reader_thread,&st)!=0 ||
+        pthread_create(&writer,NULL,writer_thread,&st)!=0) {
+      fprintf(stderr,"Error creating threads\n");
+      exit(-1);
+    }
+    for (i=0;i<nworker;i++) {
+      if (pthread_create(&st.worker[i].thread,NULL,fft_thread,&st.worker[i])!=0) {
+        fprintf(stderr,"Error creating threads\n");
+        exit(-1);
+      }
+    }
+    pthread_join(reader,NULL);
+    for (i=0;i<nworker;i++)
+      pthread_join(st.worker[i].thread,NULL);
+    pthread_join(writer,NULL);
+  }
+
+  p->telapsed=now()-t0;
+  for (i=0,p->tbusy=0.0;i<nworker;i++)
+    p->tbusy+=st.worker[i].tbusy;
+
+  // Deallocate
+  pthread_mutex_lock(&planner_lock);
+  for (i=0;i<nworker;i++) {
+    fftwf_destroy_plan(st.worker[i].fft);
+    fftwf_destroy_plan(st.worker[i].fftb);
+    fftwf_free(st.worker[i].c);
+    fftwf_free(st.worker[i].d);
+    free(st.worker[i].z);
+    free(st.worker[i].x);
+  }
+  pthread_mutex_unlock(&planner_lock);
+  for (i=0;i<st.nslot;i++)
+    free(st.block[i].buf);
+  for (i=0;i<st.nsub;i++)
+    free(st.slot[i].s.z);
+  free(st.worker);
+  free(st.block);
+  free(st.slot);
+  free(st.hist);
+  free(st.ones);
+  free(st.zw2);
+
+  return 0;
+}
+
+void rffft_pipeline_report(struct rffft_pipeline *p,double samp_rate)
+{
+  double rate,tdata;
+
+  if (p->telapsed<=0.0 || p->nsamp==0)
+    return;
+
+  rate=(double) p->nsamp/p->telapsed;
+  tdata=(double) p->nsamp/samp_rate;
+
+  printf("Processed %ld samples in %.3f s: %.3f MS/s, %.2fx real time\n",p->nsamp,p->telapsed,rate*1e-6,rate/samp_rate);
+  printf("FFT threads: %d, busy %.2f cores on average, reader waited %.3f s for free buffers\n",(p->nthreads>0) ? p->nthreads : 1,p->tbusy/p->telapsed,p->tstall);
+  printf("FFT cost: %.3f core-seconds per second of data, i.e. cores needed to sustain %.3f MS/s\n",p->tbusy/tdata,samp_rate*1e-6);
+  if (p->load>0.0)
+    printf("Load shedding: used every %d to %d spectra to keep the FFT load below %.0f%%\n",p->nuse,p->nusemax,100.0*p->load);
+  if (p->blank>0.0 && p->nexam>0)
+    printf("Impulse blanking: %s %.4f%% of the samples above %g sigma\n",(p->clip) ? "clipped" : "blanked",100.0*p->nblank/p->nexam,p->blank);
+
+  return;
+}
+
+// Producer thread, reads the input into the ring while all readers keep
+// up, and stops once every reader is done
+static void *tee_thread(void *arg)
+{
+  struct rffft_tee *t=(struct rffft_tee *) arg;
+  long i,tail;
+  int n,m,nopen;
+
+  for (;;) {
+    // Wait for space, at most up to the end of the ring
+    pthread_mutex_lock(&t->lock);
+    for (;;) {
+      for (i=0,nopen=0,tail=t->head;i<t->nreader;i++) {
+	if (t->done[i])
+	  continue;
+	nopen++;
+	if (t->tail[i]<tail)
+	  tail=t->tail[i];
+      }
+      if (nopen==0 || t->head-tail<TEESIZE)
+	break;
+      pthread_cond_wait(&t->cond,&t->lock);
+    }
+    pthread_mutex_unlock(&t->lock);
+    if (nopen==0)
+      break;
+    n=TEESIZE-(int) (t->head%TEESIZE);
+    if (n>TEESIZE-(t->head-tail))
+      n=TEESIZE-(int) (t->head-tail);
+    if (n>BLOCKSIZE)
+      n=BLOCKSIZE;
+
+    m=t->read(t->input,t->buf+(size_t) (t->head%TEESIZE)*t->size,n);
+
+    pthread_mutex_lock(&t->lock);
+    if (m>0)
+      t->head+=m;
+    else
+      t->eof=1;
+    pthread_cond_broadcast(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    if (m<=0)
+      break;
+  }
+
+  return NULL;
+}
+
+int rffft_tee_start(struct rffft_tee *t,int nreader,int size,int (*read)(void *input,void *buffer,int nsamp),void *input)
+{
+  int i;
+
+  t->nreader=nreader;
+  t->size=size;
+  t->read=read;
+  t->input=input;
+  t->buf=(char *) malloc((size_t) TEESIZE*size);
+  t->tail=(long *) calloc(nreader,sizeof(long));
+  t->done=(int *) calloc(nreader,sizeof(int));
+  t->reader=(struct rffft_tee_reader *) malloc(sizeof(struct rffft_tee_reader)*nreader);
+  for (i=0;i<nreader;i++) {
+    t->reader[i].tee=t;
+    t->reader[i].id=i;
+  }
+  t->head=0;
+  t->eof=0;
+  pthread_mutex_init(&t->lock,NULL);
+  pthread_cond_init(&t->cond,NULL);
+
+  if (pthread_create(&t->thread,NULL,tee_thread,t)!=0) {
+    fprintf(stderr,"Error creating threads\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+int rffft_tee_read(void *arg,void *buffer,int nsamp)
+{
+  struct rffft_tee_reader *r=(struct rffft_tee_reader *) arg;
+  struct rffft_tee *t=r->tee;
+  long tail=t->tail[r->id];
+  int n;
+
+  // Wait for data
+  pthread_mutex_lock(&t->lock);
+  while (t->head==tail && t->eof==0)
+    pthread_cond_wait(&t->cond,&t->lock);
+  n=(int) (t->head-tail);
+  pthread_mutex_unlock(&t->lock);
+
+  // Copy up to the end of the ring, the producer does not touch this part
+  if (n>nsamp)
+    n=nsamp;
+  if (n>TEESIZE-tail%TEESIZE)
+    n=TEESIZE-(int) (tail%TEESIZE);
+  memcpy(buffer,t->buf+(size_t) (tail%TEESIZE)*t->size,(size_t) n*t->size);
+
+  // Release
+  pthread_mutex_lock(&t->lock);
+  t->tail[r->id]+=n;
+  pthread_cond_broadcast(&t->cond);
+  pthread_mutex_unlock(&t->lock);
+
+  return n;
+}
+
+void rffft_tee_close(void *arg)
+{
+  struct rffft_tee_reader *r=(struct rffft_tee_reader *) arg;
+  struct rffft_tee *t=r->tee;
+
+  pthread_mutex_lock(&t->lock);
+  t->done[r->id]=1;
+  pthread_cond_broadcast(&t->cond);
+  pthread_mutex_unlock(&t->lock);
+
+  return;
+}
+
+void rffft_tee_finish(struct rffft_tee *t)
+{
+  pthread_join(t->thread,NULL);
+  pthread_mutex_destroy(&t->lock);
+  pthread_cond_destroy(&t->cond);
+  free(t->buf);
+  free(t->tail);
+  free(t->done);
+  free(t->reader);
+
+  return;
+}
@@ -0,0 +1,128 @@
+#ifndef _RFFFT_PIPELINE_H
+#define _RFFFT_PIPELINE_H
+
+#include <sys/time.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Accumulated subintegration handed to the output stage
+struct rffft_subint {
+  long isub;                 // Subintegration number since start
+  int nframe;                // Number of spectra read into this subint
+  int last;                  // Input ended during this subint
+  struct timeval start,end;  // Wall clock time at start and end of reading
+  long isamp;                // Input sample at the start of the subint
+  long nread;                // Input samples read by the end of reading
+  int nfft;                  // Spectra transformed, fewer than nframe when skipping
+  int nuse;                  // Largest nuse applied to this subint
+  long nblank,nexam;         // Samples blanked, of those examined
+  float *z;                  // Accumulated power, nchan channels, followed
+                             // by the peak, minimum and summed squared
+                             // power planes if stats is set
+};
+
+struct rffft_pipeline {
+  // Transform settings
+  int nchan;                 // FFT length
+  int step;                  // Samples between consecutive spectra [0: nchan]
+  int nint;                  // Spectra per subintegration
+  int nuse;                  // Use every nuse-th spectrum
+  int nframe;                // Spectra per input block [0: automatic]
+  int nbatch;                // Spectra per FFTW call
+  char informat;             // Input format ('c', 'i', 'f', 'w')
+  int sign;                  // -1 to invert frequencies
+  int nsquare;               // Number of times to square before the FFT
+  int ntap;                  // Filterbank taps [1: windowed FFT]
+  float *zw;                 // Window or filterbank prototype, ntap*nchan values
+  int stats;                 // Also keep peak, minimum and squared power
+
+  // Impulse blanking [0: off]. Samples with an amplitude above blank times
+  // the running rms amplitude are zeroed, or clipped to the threshold if
+  // clip is set, before windowing.
+  float blank;
+  int clip;
+
+  // FFTW planner flags, and wisdom file to load and store [NULL: none]
+  unsigned int planner;
+  char *wisdom;
+
+  // Number of FFT threads [0: process everything in the calling thread]
+  int nthreads;
+
+  // Stop after this many subintegrations [0: at the end of the input]
+  long nsubmax;
+
+  // Adaptive load shedding [0: off]. Between subints, nuse is raised above
+  // its initial value while the FFT threads are busier than this fraction
+  // of the time, and lowered again when they have room to spare.
+  double load;
+
+  // Read up to nsamp complex samples into buffer, returns number read
+  int (*read)(void *input,void *buffer,int nsamp);
+  void *input;
+
+  // Optional zero-copy input [NULL: use read]. Points *ptr at up to nsamp
+  // samples and returns the number available; the samples of successive
+  // calls must be contiguous and remain valid until the run ends.
+  int (*map)(void *input,const char **ptr,int nsamp);
+
+  // Store a finished subintegration, called in order
+  void (*write)(void *output,struct rffft_subint *s);
+  void *output;
+
+  // Statistics, filled in by rffft_pipeline_run
+  long nsamp;                // Complex samples read
+  double telapsed;           // Wall clock duration of the run (s)
+  double tbusy;              // Summed FFT thread CPU time (s)
+  double tstall;             // Time the reader waited for free buffers (s)
+  int nusemax;               // Largest nuse applied
+  long nblank,nexam;         // Samples blanked, of those examined
+};
+
+// Run reader, FFT and writer stages until the input is exhausted
+int rffft_pipeline_run(struct rffft_pipeline *p);
+
+// Print throughput statistics for a finished run
+void rffft_pipeline_report(struct rffft_pipeline *p,double samp_rate);
+
+// Fan out one input to several pipelines, each reading every sample once
+struct rffft_tee_reader {
+  struct rffft_tee *tee;
+  int id;
+};
+
+struct rffft_tee {
+  int (*read)(void *input,void *buffer,int nsamp);
+  void *input;
+  int size;                  // Bytes per sample
+  int nreader;
+  struct rffft_tee_reader *reader;
+  char *buf;                 // Ring of samples
+  long head,*tail;           // Samples read, and taken by each reader
+  int *done;                 // Readers that stopped reading
+  int eof;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t thread;
+};
+
+// Start reading the input in a separate thread
+int rffft_tee_start(struct rffft_tee *t,int nreader,int size,int (*read)(void *input,void *buffer,int nsamp),void *input);
+
+// Read callback for a pipeline, pass &t->reader[i] as its input
+int rffft_tee_read(void *reader,void *buffer,int nsamp);
+
+// Stop reading through a reader, so the others no longer wait for it
+void rffft_tee_close(void *reader);
+
+// Wait for the input to end, or every reader to close, and free the ring
+void rffft_tee_finish(struct rffft_tee *t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RFFFT_PIPELINE_H */
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rffft_shm.h"
+
+// Slot header bytes preceding the subint
+#define SLOTHEAD 16
+
+// Sequence numbers and the subint count are shared between processes and
+// accessed with the GCC atomic builtins, which work on plain integers
+#define LOAD(p) __atomic_load_n(p,__ATOMIC_ACQUIRE)
+#define STORE(p,v) __atomic_store_n(p,v,__ATOMIC_RELEASE)
+
+static struct rffft_shm_slot *slot(struct rffft_shm *s,uint64_t n)
+{
+  return (struct rffft_shm_slot *) (s->ring+(n%s->hdr->nslot)*s->hdr->slotsize);
+}
+
+int rffft_shm_create(struct rffft_shm *s,const char *name,int nslot,size_t size)
+{
+  int fd;
+  uint64_t slotsize;
+
+  slotsize=(SLOTHEAD+256+size+63)/64*64;
+  snprintf(s->name,sizeof(s->name),"%s",name);
+  s->owner=1;
+  s->size=sizeof(struct rffft_shm_header)+(size_t) nslot*slotsize;
+
+  // Replace a ring left behind by an earlier run
+  shm_unlink(s->name);
+  fd=shm_open(s->name,O_RDWR|O_CREAT|O_EXCL,0644);
+  if (fd<0) {
+    fprintf(stderr,"Error creating shared memory %s: %s\n",s->name,strerror(errno));
+    return -1;
+  }
+  if (ftruncate(fd,(off_t) s->size)!=0) {
+    fprintf(stderr,"Error sizing shared memory %s: %s\n",s->name,strerror(errno));
+    close(fd);
+    shm_unlink(s->name);
+    return -1;
+  }
+  s->hdr=(struct rffft_shm_header *) mmap(NULL,s->size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+  close(fd);
+  if (s->hdr==MAP_FAILED) {
+    fprintf(stderr,"Error mapping shared memory %s: %s\n",s->name,strerror(errno));
+    shm_unlink(s->name);
+    return -1;
+  }
+  s->ring=(char *) s->hdr+sizeof(struct rffft_shm_header);
+
+  // The new object is zero filled, so all slots are empty
+  s->hdr->version=RFFFT_SHM_VERSION;
+  s->hdr->nslot=nslot;
+  s->hdr->slotsize=slotsize;
+  s->hdr->nsub=0;
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(s->hdr->magic,RFFFT_SHM_MAGIC,8);
+
+  return 0;
+}
+
+void rffft_shm_publish(struct rffft_shm *s,const char *header,const void *data,size_t size)
+{
+  struct rffft_shm_slot *sl;
+  uint64_t n=s->hdr->nsub;
+
+  if (256+size>s->hdr->slotsize-SLOTHEAD)
+    size=s->hdr->slotsize-SLOTHEAD-256;
+
+  // Mark the slot as being written, then fill it
+  sl=slot(s,n);
+  STORE(&sl->seq,2*n+1);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  sl->size=256+size;
+  memcpy(sl->data,header,256);
+  memcpy(sl->data+256,data,size);
+  STORE(&sl->seq,2*n+2);
+  STORE(&s->hdr->nsub,n+1);
+
+  return;
+}
+
+int rffft_shm_attach(struct rffft_shm *s,const char *name)
+{
+  int fd;
+  struct stat sb;
+
+  snprintf(s->name,sizeof(s->name),"%s",name);
+  s->owner=0;
+  fd=shm_open(s->name,O_RDONLY,0);
+  if (fd<0) {
+    fprintf(stderr,"Error opening shared memory %s: %s\n",s->name,strerror(errno));
+    return -1;
+  }
+  if (fstat(fd,&sb)!=0 || sb.st_size<(off_t) sizeof(struct rffft_shm_header)) {
+    fprintf(stderr,"Shared memory %s is not ready\n",s->name);
+    close(fd);
+    return -1;
+  }
+  s->size=(size_t) sb.st_size;
+  s->hdr=(struct rffft_shm_header *) mmap(NULL,s->size,PROT_READ,MAP_SHARED,fd,0);
+  close(fd);
+  if (s->hdr==MAP_FAILED) {
+    fprintf(stderr,"Error mapping shared memory %s: %s\n",s->name,strerror(errno));
+    return -1;
+  }
+  s->ring=(char *) s->hdr+sizeof(struct rffft_shm_header);
+
+  if (memcmp(s->hdr->magic,RFFFT_SHM_MAGIC,8)!=0 || s->hdr->version!=RFFFT_SHM_VERSION) {
+    fprintf(stderr,"Shared memory %s is not an rffft ring of version %d\n",s->name,RFFFT_SHM_VERSION);
+    munmap(s->hdr,s->size);
+    return -1;
+  }
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+  return 0;
+}
+
+uint64_t rffft_shm_count(struct rffft_shm *s)
+{
+  return LOAD(&s->hdr->nsub);
+}
+
+const struct rffft_shm_slot *rffft_shm_slot(struct rffft_shm *s,uint64_t n)
+{
+  return slot(s,n);
+}
+
+int rffft_shm_valid(struct rffft_shm *s,uint64_t n)
+{
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+  return LOAD(&slot(s,n)->seq)==2*n+2;
+}
+
+long rffft_shm_read(struct rffft_shm *s,uint64_t n,void *data,size_t size)
+{
+  struct rffft_shm_slot *sl=slot(s,n);
+  uint64_t seq;
+  size_t m;
+
+  seq=LOAD(&sl->seq);
+  if (seq<2*n+2)
+    return 0;
+  if (seq>2*n+2)
+    return -1;
+
+  m=sl->size;
+  memcpy(data,sl->data,(m<size) ? m : size);
+
+  // Overwritten while copying
+  if (rffft_shm_valid(s,n)==0)
+    return -1;
+
+  return (long) m;
+}
+
+void rffft_shm_close(struct rffft_shm *s)
+{
+  munmap(s->hdr,s->size);
+  if (s->owner)
+    shm_unlink(s->name);
+
+  return;
+}
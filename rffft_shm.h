@@ -0,0 +1,73 @@
+#ifndef _RFFFT_SHM_H
+#define _RFFFT_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RFFFT_SHM_MAGIC "RFFFTSHM"
+#define RFFFT_SHM_VERSION 1
+
+// A POSIX shared memory object holding a ring of the latest subints. It
+// starts with this 64 byte header, followed by nslot slots of slotsize
+// bytes; subint n goes into slot n%nslot. Fields are in native byte order.
+struct rffft_shm_header {
+  char magic[8];             // RFFFT_SHM_MAGIC, set once the ring is ready
+  uint32_t version;          // RFFFT_SHM_VERSION
+  uint32_t nslot;            // Number of slots
+  uint64_t slotsize;         // Bytes per slot, a multiple of 64
+  uint64_t nsub;             // Subints published so far
+  char pad[32];
+};
+
+// Slot, each holds a subint as stored in .bin files: the 256 byte header
+// followed by the power values. The sequence number is odd while subint n
+// is written and 2*n+2 once it is complete, so a consumer reading the
+// slot in place checks it before and after use.
+struct rffft_shm_slot {
+  uint64_t seq;              // 2*n+1 while writing subint n, 2*n+2 when done
+  uint64_t size;             // Bytes of the subint
+  char data[48];             // Subint, continuing up to slotsize-16 bytes
+};
+
+struct rffft_shm {
+  char name[64];
+  int owner;                 // Created by this process, unlinked on close
+  size_t size;               // Bytes mapped
+  struct rffft_shm_header *hdr;
+  char *ring;                // First slot
+};
+
+// Create the ring name (e.g. "/rffft") with nslot slots for subints with
+// up to size bytes of data, replacing an existing one
+int rffft_shm_create(struct rffft_shm *s,const char *name,int nslot,size_t size);
+
+// Publish the next subint, its 256 byte header and size bytes of data
+void rffft_shm_publish(struct rffft_shm *s,const char *header,const void *data,size_t size);
+
+// Attach to an existing ring read-only
+int rffft_shm_attach(struct rffft_shm *s,const char *name);
+
+// Number of subints published so far
+uint64_t rffft_shm_count(struct rffft_shm *s);
+
+// Slot of subint n, for reading in place. The data is only valid if
+// rffft_shm_valid(s,n) still holds after use.
+const struct rffft_shm_slot *rffft_shm_slot(struct rffft_shm *s,uint64_t n);
+int rffft_shm_valid(struct rffft_shm *s,uint64_t n);
+
+// Copy subint n into data, at most size bytes. Returns the number of bytes
+// of the subint, 0 if it is not published yet and -1 if it was overwritten.
+long rffft_shm_read(struct rffft_shm *s,uint64_t n,void *data,size_t size);
+
+// Unmap, and remove the ring if this process created it
+void rffft_shm_close(struct rffft_shm *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RFFFT_SHM_H */
@@ -0,0 +1,474 @@
+#include "rffft_internal.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RFFFT_X86
+#endif
+
+// Scale factors converting raw samples to floats
+static float unpack_scale(char format) {
+  switch (format) {
+    case 'c':
+      return 1.0 / 256.0;
+    case 'u':
+      return 1.0 / 128.0;
+    case 'p':
+      return 1.0 / 2048.0;
+    case 'i':
+      return 1.0 / 32768.0;
+    case 'w':
+      return 1.0 / 2147483648.0;
+    default:
+      return 1.0;
+  }
+}
+
+// Portable kernel, also used for the remainder of the vectorized kernels
+static void unpack_scalar(char format, const void * buffer, int nsamp, const float * zw, int sign, int nsquare, float * c) {
+  int i;
+
+  if (format == 'i') {
+    const int16_t * ibuf = (const int16_t *) buffer;
+    for (i = 0; i < nsamp; i++) {
+      c[2 * i] = (float) ibuf[2 * i] / 32768.0 * zw[i];
+      c[2 * i + 1] = (float) ibuf[2 * i + 1] / 32768.0 * zw[i] * sign;
+    }
+  } else if (format == 'c') {
+    const char * cbuf = (const char *) buffer;
+    for (i = 0; i < nsamp; i++) {
+      c[2 * i] = (float) cbuf[2 * i] / 256.0 * zw[i];
+      c[2 * i + 1] = (float) cbuf[2 * i + 1] / 256.0 * zw[i] * sign;
+    }
+  } else if (format == 'u') {
+    const unsigned char * ubuf = (const unsigned char *) buffer;
+    for (i = 0; i < nsamp; i++) {
+      c[2 * i] = (float) (ubuf[2 * i] - 128) / 128.0 * zw[i];
+      c[2 * i + 1] = (float) (ubuf[2 * i + 1] - 128) / 128.0 * zw[i] * sign;
+    }
+  } else if (format == 'p') {
+    // Packed 12 bit, I in the low and Q in the high half of 3 bytes
+    const unsigned char * pbuf = (const unsigned char *) buffer;
+    uint32_t v;
+    for (i = 0; i < nsamp; i++) {
+      v = pbuf[3 * i] | (pbuf[3 * i + 1] << 8) | ((uint32_t) pbuf[3 * i + 2] << 16);
+      c[2 * i] = (float) ((int32_t) (v << 20) >> 20) / 2048.0 * zw[i];
+      c[2 * i + 1] = (float) ((int32_t) (v << 8) >> 20) / 2048.0 * zw[i] * sign;
+    }
+  } else if (format == 'f') {
+    const float * fbuf = (const float *) buffer;
+    for (i = 0; i < nsamp; i++) {
+      c[2 * i] = (float) fbuf[2 * i] * zw[i];
+      c[2 * i + 1] = (float) fbuf[2 * i + 1] * zw[i] * sign;
+    }
+  } else if (format == 'w') {
+    const int32_t * wbuf = (const int32_t *) buffer;
+    for (i = 0; i < nsamp; i++) {
+      c[2 * i] = (float) wbuf[2 * i] / 2147483648 * zw[i];
+      c[2 * i + 1] = (float) wbuf[2 * i + 1] / 2147483648 * zw[i] * sign;
+    }
+  }
+
+  for (i = 0; i < nsquare; i++)
+    rffft_square(c, nsamp);
+}
+
+// The vectorized kernels give results identical to the scalar kernel:
+// scaling by a power of two is exact, so x * scale * zw is rounded once,
+// and the complex square is formed from the same rounded products.
+#ifdef RFFFT_X86
+
+// SSE2, 2 complex samples per iteration
+__attribute__((target("sse2")))
+static void unpack_sse2(char format, const void * buffer, int nsamp, const float * zw, int sign, int nsquare, float * c) {
+  int i, k, n = nsamp & ~1;
+  int32_t pair;
+  uint32_t p0, p1;
+  const unsigned char * p;
+  float scale = unpack_scale(format);
+  __m128 vscale = _mm_setr_ps(scale, scale * sign, scale, scale * sign);
+  __m128 x, w, sq, prod;
+  __m128i v;
+
+  for (i = 0; i < n; i += 2) {
+    // Convert
+    if (format == 'i') {
+      v = _mm_loadl_epi64((const __m128i *) ((const int16_t *) buffer + 2 * i));
+      x = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+    } else if (format == 'c') {
+      memcpy(&pair, (const int8_t *) buffer + 2 * i, sizeof(int32_t));
+      v = _mm_cvtsi32_si128(pair);
+      v = _mm_unpacklo_epi8(v, v);
+      x = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 24));
+    } else if (format == 'u') {
+      memcpy(&pair, (const uint8_t *) buffer + 2 * i, sizeof(int32_t));
+      v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(pair), _mm_setzero_si128());
+      v = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+      x = _mm_cvtepi32_ps(_mm_sub_epi32(v, _mm_set1_epi32(128)));
+    } else if (format == 'p') {
+      p = (const unsigned char *) buffer + 3 * i;
+      p0 = p[0] | (p[1] << 8) | ((uint32_t) p[2] << 16);
+      p1 = p[3] | (p[4] << 8) | ((uint32_t) p[5] << 16);
+      v = _mm_setr_epi32(p0 << 20, p0 << 8, p1 << 20, p1 << 8);
+      x = _mm_cvtepi32_ps(_mm_srai_epi32(v, 20));
+    } else if (format == 'w') {
+      x = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *) ((const int32_t *) buffer + 2 * i)));
+    } else {
+      x = _mm_loadu_ps((const float *) buffer + 2 * i);
+    }
+
+    // Scale, conjugate and window
+    w = _mm_castpd_ps(_mm_load1_pd((const double *) (zw + i)));
+    w = _mm_unpacklo_ps(w, w);
+    x = _mm_mul_ps(_mm_mul_ps(x, vscale), w);
+
+    // Square
+    for (k = 0; k < nsquare; k++) {
+      sq = _mm_mul_ps(x, x);
+      prod = _mm_mul_ps(x, _mm_shuffle_ps(x, x, 0xB1));
+      sq = _mm_sub_ps(sq, _mm_shuffle_ps(sq, sq, 0xB1));
+      prod = _mm_add_ps(prod, prod);
+      x = _mm_unpacklo_ps(_mm_shuffle_ps(sq, sq, 0x08), _mm_shuffle_ps(prod, prod, 0x0D));
+    }
+
+    _mm_storeu_ps(c + 2 * i, x);
+  }
+
+  // Remainder
+  if (n < nsamp)
+    unpack_scalar(format, (const char *) buffer + (size_t) n * rffft_sample_size(format), nsamp - n, zw + n, sign, nsquare, c + 2 * n);
+}
+
+// AVX2, 4 complex samples per iteration
+__attribute__((target("avx2")))
+static void unpack_avx2(char format, const void * buffer, int nsamp, const float * zw, int sign, int nsquare, float * c) {
+  int i, k, n = nsamp & ~3;
+  float scale = unpack_scale(format);
+  __m256 vscale = _mm256_setr_ps(scale, scale * sign, scale, scale * sign, scale, scale * sign, scale, scale * sign);
+  __m256 x, w, sq, prod;
+  __m256i v;
+  __m128 w4;
+  // Packed 12 bit: the 3 bytes of each sample into the dwords of I and Q,
+  // then shift each 12 bit half to the top and back to sign extend it
+  __m256i pidx = _mm256_setr_epi8(0, 1, 2, -1, 0, 1, 2, -1, 3, 4, 5, -1, 3, 4, 5, -1,
+                                  6, 7, 8, -1, 6, 7, 8, -1, 9, 10, 11, -1, 9, 10, 11, -1);
+  __m256i pshift = _mm256_setr_epi32(20, 8, 20, 8, 20, 8, 20, 8);
+
+  // Packed loads read 16 bytes for 12, keep them within the buffer
+  if (format == 'p')
+    n = (nsamp >= 6) ? (nsamp - 2) & ~3 : 0;
+
+  for (i = 0; i < n; i += 4) {
+    // Convert
+    if (format == 'i') {
+      x = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) ((const int16_t *) buffer + 2 * i))));
+    } else if (format == 'c') {
+      x = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *) ((const int8_t *) buffer + 2 * i))));
+    } else if (format == 'u') {
+      x = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) ((const uint8_t *) buffer + 2 * i))), _mm256_set1_epi32(128)));
+    } else if (format == 'p') {
+      v = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) ((const uint8_t *) buffer + 3 * i)));
+      v = _mm256_sllv_epi32(_mm256_shuffle_epi8(v, pidx), pshift);
+      x = _mm256_cvtepi32_ps(_mm256_srai_epi32(v, 20));
+    } else if (format == 'w') {
+      x = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *) ((const int32_t *) buffer + 2 * i)));
+    } else {
+      x = _mm256_loadu_ps((const float *) buffer + 2 * i);
+    }
+
+    // Scale, conjugate and window
+    w4 = _mm_loadu_ps(zw + i);
+    w = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_unpacklo_ps(w4, w4)), _mm_unpackhi_ps(w4, w4), 1);
+    x = _mm256_mul_ps(_mm256_mul_ps(x, vscale), w);
+
+    // Square
+    for (k = 0; k < nsquare; k++) {
+      sq = _mm256_mul_ps(x, x);
+      prod = _mm256_mul_ps(x, _mm256_permute_ps(x, 0xB1));
+      sq = _mm256_sub_ps(sq, _mm256_permute_ps(sq, 0xB1));
+      prod = _mm256_add_ps(prod, prod);
+      x = _mm256_blend_ps(sq, prod, 0xAA);
+    }
+
+    _mm256_storeu_ps(c + 2 * i, x);
+  }
+
+  // Remainder
+  if (n < nsamp)
+    unpack_sse2(format, (const char *) buffer + (size_t) n * rffft_sample_size(format), nsamp - n, zw + n, sign, nsquare, c + 2 * n);
+}
+
+// AVX-512, 8 complex samples per iteration
+__attribute__((target("avx512f")))
+static void unpack_avx512(char format, const void * buffer, int nsamp, const float * zw, int sign, int nsquare, float * c) {
+  int i, k, n = nsamp & ~7;
+  float scale = unpack_scale(format);
+  __m512 vscale = _mm512_setr_ps(scale, scale * sign, scale, scale * sign, scale, scale * sign, scale, scale * sign,
+                                 scale, scale * sign, scale, scale * sign, scale, scale * sign, scale, scale * sign);
+  __m512i idx = _mm512_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7);
+  __m512 x, w, sq, prod;
+
+  // Byte shuffles need AVX-512BW, packed samples use the AVX2 kernel
+  if (format == 'p')
+    n = 0;
+
+  for (i = 0; i < n; i += 8) {
+    // Convert
+    if (format == 'i') {
+      x = _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i *) ((const int16_t *) buffer + 2 * i))));
+    } else if (format == 'c') {
+      x = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i *) ((const int8_t *) buffer + 2 * i))));
+    } else if (format == 'u') {
+      x = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *) ((const uint8_t *) buffer + 2 * i))), _mm512_set1_epi32(128)));
+    } else if (format == 'w') {
+      x = _mm512_cvtepi32_ps(_mm512_loadu_si512((const void *) ((const int32_t *) buffer + 2 * i)));
+    } else {
+      x = _mm512_loadu_ps((const float *) buffer + 2 * i);
+    }
+
+    // Scale, conjugate and window
+    w = _mm512_permutexvar_ps(idx, _mm512_castps256_ps512(_mm256_loadu_ps(zw + i)));
+    x = _mm512_mul_ps(_mm512_mul_ps(x, vscale), w);
+
+    // Square
+    for (k = 0; k < nsquare; k++) {
+      sq = _mm512_mul_ps(x, x);
+      prod = _mm512_mul_ps(x, _mm512_permute_ps(x, 0xB1));
+      sq = _mm512_sub_ps(sq, _mm512_permute_ps(sq, 0xB1));
+      prod = _mm512_add_ps(prod, prod);
+      x = _mm512_mask_blend_ps(0xAAAA, sq, prod);
+    }
+
+    _mm512_storeu_ps(c + 2 * i, x);
+  }
+
+  // Remainder
+  if (n < nsamp)
+    unpack_avx2(format, (const char *) buffer + (size_t) n * rffft_sample_size(format), nsamp - n, zw + n, sign, nsquare, c + 2 * n);
+}
+
+#endif
+
+// Blanker kernels: the power of each sample is compared with the
+// threshold scaled by its weight, and the power and weight of the samples
+// below are summed into 8 partial sums, sample i going into sum i % 8.
+// The vectorized kernels keep these in their lanes, so all kernels give
+// identical results.
+static int count_scalar(const float * x, const float * w2, int i0, int nsamp, float thresh, float * acc, float * wacc) {
+  int i, nabove = 0;
+  float p;
+
+  for (i = i0; i < nsamp; i++) {
+    p = x[2 * i] * x[2 * i] + x[2 * i + 1] * x[2 * i + 1];
+    if (p > thresh * w2[i]) {
+      nabove++;
+    } else {
+      acc[i % 8] += p;
+      wacc[i % 8] += w2[i];
+    }
+  }
+
+  return nabove;
+}
+
+#ifdef RFFFT_X86
+
+// SSE2, 8 complex samples per iteration in two halves
+__attribute__((target("sse2")))
+static int count_sse2(const float * x, const float * w2, int nsamp, float thresh, float * acc, float * wacc) {
+  int i, k, n = nsamp & ~7;
+  int32_t na[4];
+  __m128 vt = _mm_set1_ps(thresh), a[2], wa[2], s0, s1, p, w, above;
+  __m128i vna = _mm_setzero_si128();
+
+  for (k = 0; k < 2; k++) {
+    a[k] = _mm_loadu_ps(acc + 4 * k);
+    wa[k] = _mm_loadu_ps(wacc + 4 * k);
+  }
+
+  for (i = 0; i < n; i += 8) {
+    for (k = 0; k < 2; k++) {
+      // Power, from the squares of I and Q
+      s0 = _mm_loadu_ps(x + 2 * (i + 4 * k));
+      s1 = _mm_loadu_ps(x + 2 * (i + 4 * k) + 4);
+      s0 = _mm_mul_ps(s0, s0);
+      s1 = _mm_mul_ps(s1, s1);
+      p = _mm_add_ps(_mm_shuffle_ps(s0, s1, 0x88), _mm_shuffle_ps(s0, s1, 0xDD));
+
+      // Compare, count and sum
+      w = _mm_loadu_ps(w2 + i + 4 * k);
+      above = _mm_cmpgt_ps(p, _mm_mul_ps(vt, w));
+      a[k] = _mm_add_ps(a[k], _mm_andnot_ps(above, p));
+      wa[k] = _mm_add_ps(wa[k], _mm_andnot_ps(above, w));
+      vna = _mm_sub_epi32(vna, _mm_castps_si128(above));
+    }
+  }
+
+  for (k = 0; k < 2; k++) {
+    _mm_storeu_ps(acc + 4 * k, a[k]);
+    _mm_storeu_ps(wacc + 4 * k, wa[k]);
+  }
+  _mm_storeu_si128((__m128i *) na, vna);
+
+  return na[0] + na[1] + na[2] + na[3] + count_scalar(x, w2, n, nsamp, thresh, acc, wacc);
+}
+
+// AVX2, 8 complex samples per iteration
+__attribute__((target("avx2")))
+static int count_avx2(const float * x, const float * w2, int nsamp, float thresh, float * acc, float * wacc) {
+  int i, n = nsamp & ~7;
+  int32_t na[8];
+  __m256 vt = _mm256_set1_ps(thresh), a, wa, s0, s1, p, w, above;
+  __m256i vna = _mm256_setzero_si256();
+
+  a = _mm256_loadu_ps(acc);
+  wa = _mm256_loadu_ps(wacc);
+
+  for (i = 0; i < n; i += 8) {
+    // Power, the in-lane shuffles leave samples 0, 1, 4, 5, 2, 3, 6, 7
+    s0 = _mm256_loadu_ps(x + 2 * i);
+    s1 = _mm256_loadu_ps(x + 2 * i + 8);
+    s0 = _mm256_mul_ps(s0, s0);
+    s1 = _mm256_mul_ps(s1, s1);
+    p = _mm256_add_ps(_mm256_shuffle_ps(s0, s1, 0x88), _mm256_shuffle_ps(s0, s1, 0xDD));
+    p = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(p), 0xD8));
+
+    // Compare, count and sum
+    w = _mm256_loadu_ps(w2 + i);
+    above = _mm256_cmp_ps(p, _mm256_mul_ps(vt, w), _CMP_GT_OQ);
+    a = _mm256_add_ps(a, _mm256_andnot_ps(above, p));
+    wa = _mm256_add_ps(wa, _mm256_andnot_ps(above, w));
+    vna = _mm256_sub_epi32(vna, _mm256_castps_si256(above));
+  }
+
+  _mm256_storeu_ps(acc, a);
+  _mm256_storeu_ps(wacc, wa);
+  _mm256_storeu_si256((__m256i *) na, vna);
+
+  return na[0] + na[1] + na[2] + na[3] + na[4] + na[5] + na[6] + na[7] + count_scalar(x, w2, n, nsamp, thresh, acc, wacc);
+}
+
+#endif
+
+static int detect_simd_level(void) {
+#ifdef RFFFT_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return RFFFT_SIMD_AVX512;
+  if (__builtin_cpu_supports("avx2"))
+    return RFFFT_SIMD_AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return RFFFT_SIMD_SSE2;
+#endif
+  return RFFFT_SIMD_NONE;
+}
+
+// Detected on first use, as the kernels are selected for every spectrum
+// by several threads
+int rffft_simd_level(void) {
+  static int level = -1;
+  int l = __atomic_load_n(&level, __ATOMIC_RELAXED);
+
+  if (l < 0) {
+    l = detect_simd_level();
+    __atomic_store_n(&level, l, __ATOMIC_RELAXED);
+  }
+
+  return l;
+}
+
+const char * rffft_simd_name(int level) {
+  switch (level) {
+    case RFFFT_SIMD_SSE2:
+      return "SSE2";
+    case RFFFT_SIMD_AVX2:
+      return "AVX2";
+    case RFFFT_SIMD_AVX512:
+      return "AVX-512";
+    default:
+      return "none";
+  }
+}
+
+void rffft_unpack_simd(int level, char format, const void * buffer, int nsamp, const float * zw, int sign, int nsquare, float * c) {
+#ifdef RFFFT_X86
+  if (level >= RFFFT_SIMD_AVX512) {
+    unpack_avx512(format, buffer, nsamp, zw, sign, nsquare, c);
+    return;
+  } else if (level == RFFFT_SIMD_AVX2) {
+    unpack_avx2(format, buffer, nsamp, zw, sign, nsquare, c);
+    return;
+  } else if (level == RFFFT_SIMD_SSE2) {
+    unpack_sse2(format, buffer, nsamp, zw, sign, nsquare, c);
+    return;
+  }
+#endif
+  unpack_scalar(format, buffer, nsamp, zw, sign, nsquare, c);
+}
+
+void rffft_unpack(char format, const void * buffer, int nsamp, const float * zw, int sign, int nsquare, float * c) {
+  rffft_unpack_simd(rffft_simd_level(), format, buffer, nsamp, zw, sign, nsquare, c);
+}
+
+void rffft_square(float * c, int nsamp) {
+  int i;
+  float re, im;
+
+  for (i = 0; i < nsamp; i++) {
+    re = c[2 * i] * c[2 * i] - c[2 * i + 1] * c[2 * i + 1];
+    im = 2 * c[2 * i] * c[2 * i + 1];
+    c[2 * i] = re;
+    c[2 * i + 1] = im;
+  }
+}
+
+int rffft_count_above_simd(int level, const float * x, const float * w2, int nsamp, float thresh, float * sum, float * wsum) {
+  int l, nabove;
+  float acc[8] = {0.0}, wacc[8] = {0.0};
+
+#ifdef RFFFT_X86
+  if (level >= RFFFT_SIMD_AVX2)
+    nabove = count_avx2(x, w2, nsamp, thresh, acc, wacc);
+  else if (level == RFFFT_SIMD_SSE2)
+    nabove = count_sse2(x, w2, nsamp, thresh, acc, wacc);
+  else
+#endif
+    nabove = count_scalar(x, w2, 0, nsamp, thresh, acc, wacc);
+
+  for (l = 1; l < 8; l++) {
+    acc[0] += acc[l];
+    wacc[0] += wacc[l];
+  }
+  *sum = acc[0];
+  *wsum = wacc[0];
+
+  return nabove;
+}
+
+int rffft_count_above(const float * x, const float * w2, int nsamp, float thresh, float * sum, float * wsum) {
+  return rffft_count_above_simd(rffft_simd_level(), x, w2, nsamp, thresh, sum, wsum);
+}
+
+int rffft_blank(float * x, const float * w2, int nsamp, float thresh, int clip, float * sum, float * wsum) {
+  int i, nblank;
+  float p, g;
+
+  // Impulses are rare, so only then go over the samples again
+  nblank = rffft_count_above(x, w2, nsamp, thresh, sum, wsum);
+  if (nblank == 0)
+    return 0;
+
+  for (i = 0; i < nsamp; i++) {
+    p = x[2 * i] * x[2 * i] + x[2 * i + 1] * x[2 * i + 1];
+    if (p > thresh * w2[i]) {
+      g = (clip) ? sqrtf(thresh * w2[i] / p) : 0.0f;
+      x[2 * i] *= g;
+      x[2 * i + 1] *= g;
+    }
+  }
+
+  return nblank;
+}
@@ -0,0 +1,385 @@
+// For O_DIRECT
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "rffft_writer.h"
+
+// Alignment of buffers, and of write sizes and offsets with O_DIRECT
+#define ALIGN 4096
+
+// Monotonic clock (s)
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+
+  return ts.tv_sec+1e-9*ts.tv_nsec;
+}
+
+// Write n bytes, retrying after interrupts and short writes
+static int write_all(int fd,const char *buf,size_t n)
+{
+  ssize_t m;
+
+  while (n>0) {
+    m=write(fd,buf,n);
+    if (m<0 && errno==EINTR)
+      continue;
+    if (m<=0)
+      return -1;
+    buf+=m;
+    n-=m;
+  }
+
+  return 0;
+}
+
+// Take a free buffer, waiting for the writer thread if there is none
+static char *get_buffer(struct rffft_writer *w)
+{
+  char *buf;
+  double t0;
+
+  pthread_mutex_lock(&w->lock);
+  if (w->nfree==0) {
+    t0=now();
+    while (w->nfree==0)
+      pthread_cond_wait(&w->cond,&w->lock);
+    w->tstall+=now()-t0;
+  }
+  buf=w->free[--w->nfree];
+  pthread_mutex_unlock(&w->lock);
+
+  return buf;
+}
+
+// Queue a buffer of a file for writing
+static void queue(struct rffft_writer *w,struct rffft_wfile *f,char *buf,size_t n,int close)
+{
+  struct rffft_wjob *job;
+  double t0;
+
+  pthread_mutex_lock(&w->lock);
+  if (w->head-w->tail>=2*w->nbuf) {
+    t0=now();
+    while (w->head-w->tail>=2*w->nbuf)
+      pthread_cond_wait(&w->cond,&w->lock);
+    w->tstall+=now()-t0;
+  }
+  job=&w->job[w->head%(2*w->nbuf)];
+  job->file=f;
+  job->buf=buf;
+  job->n=n;
+  job->close=close;
+  w->head++;
+  if (w->head-w->tail>w->nqueue)
+    w->nqueue=(int) (w->head-w->tail);
+  pthread_cond_broadcast(&w->cond);
+  pthread_mutex_unlock(&w->lock);
+
+  return;
+}
+
+// Open a file on its first write. O_DIRECT is not supported by every file
+// system, so the file is opened normally if it is refused.
+static void open_file(struct rffft_writer *w,struct rffft_wfile *f)
+{
+  int flags=O_WRONLY|O_CREAT|O_TRUNC;
+
+#ifdef O_DIRECT
+  if (w->direct)
+    f->fd=open(f->path,flags|O_DIRECT,0644);
+  if (w->direct==0 || (f->fd<0 && errno==EINVAL))
+    f->fd=open(f->path,flags,0644);
+#else
+  f->fd=open(f->path,flags,0644);
+#endif
+  if (f->fd<0) {
+    fprintf(stderr,"Error opening %s: %s\n",f->path,strerror(errno));
+    w->nerror++;
+  }
+
+  return;
+}
+
+// Hand over the data of open files that waited longer than tflush,
+// keeping an unaligned tail for direct I/O. Called by the writer thread
+// with the lock held; files being filled by the caller are skipped until
+// the next scan.
+static void flush_files(struct rffft_writer *w)
+{
+  struct rffft_wfile *f;
+  struct rffft_wjob *job;
+  char *buf;
+  size_t m;
+  double t=now();
+
+  for (f=w->files;f!=NULL && w->head-w->tail<2*w->nbuf;f=f->next) {
+    if (pthread_mutex_trylock(&f->lock)!=0)
+      continue;
+    if (f->buf!=NULL && t-f->tfirst>w->tflush) {
+      m=(w->direct) ? f->n/ALIGN*ALIGN : f->n;
+      buf=NULL;
+      if (m>0 && m<f->n && w->nfree>0) {
+        buf=w->free[--w->nfree];
+        memcpy(buf,f->buf+m,f->n-m);
+      }
+      if (m==f->n || buf!=NULL) {
+        job=&w->job[w->head%(2*w->nbuf)];
+        job->file=f;
+        job->buf=f->buf;
+        job->n=m;
+        job->close=0;
+        w->head++;
+        if (w->head-w->tail>w->nqueue)
+          w->nqueue=(int) (w->head-w->tail);
+        f->buf=buf;
+        f->n-=m;
+        f->tfirst=t;
+      }
+    }
+    pthread_mutex_unlock(&f->lock);
+  }
+
+  return;
+}
+
+// Wait for a signal for at most dt seconds
+static void timed_wait(struct rffft_writer *w,double dt)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME,&ts);
+  ts.tv_sec+=(time_t) dt;
+  ts.tv_nsec+=(long) (1e9*(dt-(time_t) dt));
+  if (ts.tv_nsec>=1000000000) {
+    ts.tv_sec++;
+    ts.tv_nsec-=1000000000;
+  }
+  pthread_cond_timedwait(&w->cond,&w->lock,&ts);
+
+  return;
+}
+
+// Writer thread, writes queued buffers in order
+static void *writer_thread(void *arg)
+{
+  struct rffft_writer *w=(struct rffft_writer *) arg;
+  struct rffft_wjob job;
+  struct rffft_wfile *f;
+  size_t m;
+  int status;
+  double tscan=0.0;
+
+  for (;;) {
+    // Wait for a job, handing over data of files that waited too long,
+    // even while the input stalls
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+      if (w->tflush>0.0 && now()>=tscan) {
+        flush_files(w);
+        tscan=now()+0.25*w->tflush;
+      }
+      if (w->head!=w->tail || w->done)
+        break;
+      if (w->tflush>0.0)
+        timed_wait(w,0.25*w->tflush);
+      else
+        pthread_cond_wait(&w->cond,&w->lock);
+    }
+    if (w->head==w->tail) {
+      pthread_mutex_unlock(&w->lock);
+      break;
+    }
+    job=w->job[w->tail%(2*w->nbuf)];
+    pthread_mutex_unlock(&w->lock);
+
+    f=job.file;
+    if (f->fd==-1)
+      open_file(w,f);
+
+    // Only the last write of a file may be unaligned, and is finished
+    // through the page cache
+    if (f->fd>=0 && job.n>0) {
+      m=(w->direct) ? job.n/ALIGN*ALIGN : job.n;
+      status=write_all(f->fd,job.buf,m);
+#ifdef O_DIRECT
+      if (status==0 && m<job.n) {
+        fcntl(f->fd,F_SETFL,fcntl(f->fd,F_GETFL)&~O_DIRECT);
+        status=write_all(f->fd,job.buf+m,job.n-m);
+      }
+#endif
+      if (status!=0) {
+        fprintf(stderr,"Error writing %s: %s\n",f->path,strerror(errno));
+        w->nerror++;
+      }
+      w->nwrite++;
+      w->nbytes+=job.n;
+    }
+    if (job.close) {
+      if (f->fd>=0)
+        close(f->fd);
+      pthread_mutex_destroy(&f->lock);
+      free(f);
+    }
+
+    // Release the buffer and the job
+    pthread_mutex_lock(&w->lock);
+    if (job.buf!=NULL)
+      w->free[w->nfree++]=job.buf;
+    w->tail++;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+  }
+
+  return NULL;
+}
+
+int rffft_writer_start(struct rffft_writer *w,int nbuf,size_t bufsize,int direct,double tflush)
+{
+  int i;
+
+#ifndef O_DIRECT
+  if (direct) {
+    fprintf(stderr,"Direct I/O is not supported on this system, writing through the page cache\n");
+    direct=0;
+  }
+#endif
+
+  w->nbuf=nbuf;
+  w->bufsize=(bufsize+ALIGN-1)/ALIGN*ALIGN;
+  w->direct=direct;
+  w->tflush=tflush;
+  w->free=(char **) malloc(sizeof(char *)*nbuf);
+  for (i=0;i<nbuf;i++) {
+    if (posix_memalign((void **) &w->free[i],ALIGN,w->bufsize)!=0) {
+      fprintf(stderr,"Error allocating output buffers\n");
+      return -1;
+    }
+  }
+  w->nfree=nbuf;
+  w->job=(struct rffft_wjob *) malloc(sizeof(struct rffft_wjob)*2*nbuf);
+  w->files=NULL;
+  w->head=0;
+  w->tail=0;
+  w->done=0;
+  w->nwrite=0;
+  w->nbytes=0.0;
+  w->nqueue=0;
+  w->tstall=0.0;
+  w->nerror=0;
+  pthread_mutex_init(&w->lock,NULL);
+  pthread_cond_init(&w->cond,NULL);
+
+  if (pthread_create(&w->thread,NULL,writer_thread,w)!=0) {
+    fprintf(stderr,"Error creating threads\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+struct rffft_wfile *rffft_writer_open(struct rffft_writer *w,const char *path)
+{
+  struct rffft_wfile *f;
+
+  f=(struct rffft_wfile *) malloc(sizeof(struct rffft_wfile));
+  snprintf(f->path,sizeof(f->path),"%s",path);
+  f->fd=-1;
+  f->buf=NULL;
+  f->n=0;
+  f->tfirst=0.0;
+  pthread_mutex_init(&f->lock,NULL);
+
+  // Register the file for flushing by the writer thread
+  pthread_mutex_lock(&w->lock);
+  f->prev=NULL;
+  f->next=w->files;
+  if (w->files!=NULL)
+    w->files->prev=f;
+  w->files=f;
+  pthread_mutex_unlock(&w->lock);
+
+  return f;
+}
+
+void rffft_writer_write(struct rffft_writer *w,struct rffft_wfile *f,const void *data,size_t n)
+{
+  const char *ptr=(const char *) data;
+  size_t m;
+
+  // Fill buffers, and queue them once full
+  pthread_mutex_lock(&f->lock);
+  while (n>0) {
+    if (f->buf==NULL) {
+      f->buf=get_buffer(w);
+      f->n=0;
+      f->tfirst=now();
+    }
+    m=(n<w->bufsize-f->n) ? n : w->bufsize-f->n;
+    memcpy(f->buf+f->n,ptr,m);
+    f->n+=m;
+    ptr+=m;
+    n-=m;
+    if (f->n==w->bufsize) {
+      queue(w,f,f->buf,f->n,0);
+      f->buf=NULL;
+    }
+  }
+  pthread_mutex_unlock(&f->lock);
+
+  return;
+}
+
+void rffft_writer_close(struct rffft_writer *w,struct rffft_wfile *f)
+{
+  // Unregister the file, after which the writer thread no longer flushes it
+  pthread_mutex_lock(&w->lock);
+  if (f->prev!=NULL)
+    f->prev->next=f->next;
+  else
+    w->files=f->next;
+  if (f->next!=NULL)
+    f->next->prev=f->prev;
+  pthread_mutex_unlock(&w->lock);
+
+  queue(w,f,f->buf,f->n,1);
+
+  return;
+}
+
+void rffft_writer_finish(struct rffft_writer *w)
+{
+  int i;
+
+  pthread_mutex_lock(&w->lock);
+  w->done=1;
+  pthread_cond_broadcast(&w->cond);
+  pthread_mutex_unlock(&w->lock);
+  pthread_join(w->thread,NULL);
+
+  pthread_mutex_destroy(&w->lock);
+  pthread_cond_destroy(&w->cond);
+  for (i=0;i<w->nfree;i++)
+    free(w->free[i]);
+  free(w->free);
+  free(w->job);
+
+  return;
+}
+
+void rffft_writer_report(struct rffft_writer *w)
+{
+  printf("Output writer: %ld writes of %.3f MB in total, at most %d of %d writes queued, waited %.3f s for free buffers\n",w->nwrite,w->nbytes*1e-6,w->nqueue,2*w->nbuf,w->tstall);
+  if (w->nerror>0)
+    printf("Output writer: %d errors\n",w->nerror);
+
+  return;
+}
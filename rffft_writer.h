@@ -0,0 +1,77 @@
+#ifndef _RFFFT_WRITER_H
+#define _RFFFT_WRITER_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Output file, filled by the caller and written by the writer thread,
+// which also hands over a buffer that is not filled in time
+struct rffft_wfile {
+  char path[256];
+  int fd;                    // File descriptor [-1: not opened yet]
+  char *buf;                 // Buffer being filled [NULL: none]
+  size_t n;                  // Bytes in buf
+  double tfirst;             // Time the first byte went into buf (s)
+  pthread_mutex_t lock;      // Guards buf, n and tfirst
+  struct rffft_wfile *prev,*next; // Open files of the writer
+};
+
+// Buffer handed to the writer thread
+struct rffft_wjob {
+  struct rffft_wfile *file;
+  char *buf;
+  size_t n;
+  int close;                 // Close and free the file after writing
+};
+
+// Background writer, coalescing small writes into large ones
+struct rffft_writer {
+  size_t bufsize;            // Bytes per buffer
+  int nbuf;                  // Number of buffers
+  int direct;                // Bypass the page cache with O_DIRECT
+  double tflush;             // Hand over buffers older than this (s)
+  char **free;               // Free buffers
+  int nfree;
+  struct rffft_wjob *job;    // Queue of 2*nbuf jobs
+  struct rffft_wfile *files; // Open files
+  long head,tail;            // Jobs queued and written
+  int done;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t thread;
+
+  // Statistics
+  long nwrite;               // Number of writes
+  double nbytes;             // Bytes written
+  int nqueue;                // Largest number of queued jobs
+  double tstall;             // Time spent waiting for free buffers (s)
+  int nerror;                // Failed opens and writes
+};
+
+// Start the writer thread with nbuf buffers of bufsize bytes
+int rffft_writer_start(struct rffft_writer *w,int nbuf,size_t bufsize,int direct,double tflush);
+
+// New output file, opened by the writer thread on its first write
+struct rffft_wfile *rffft_writer_open(struct rffft_writer *w,const char *path);
+
+// Append n bytes to a file
+void rffft_writer_write(struct rffft_writer *w,struct rffft_wfile *f,const void *data,size_t n);
+
+// Write the remaining bytes and close the file, which is freed
+void rffft_writer_close(struct rffft_writer *w,struct rffft_wfile *f);
+
+// Wait for all files to be written and stop the writer thread
+void rffft_writer_finish(struct rffft_writer *w);
+
+// Print write statistics
+void rffft_writer_report(struct rffft_writer *w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RFFFT_WRITER_H */
@@ -8,6 +8,7 @@
 
 #define LIM 128
 #define NMAX 64
+#define NBLOCK 60
 
 
 
@@ -38,7 +39,7 @@ void filter(struct spectrogram s,int site_id,float sigma,char *filename,int grav
       // Find average
       for (j=0,s1=s2=0.0;j<s.nchan;j++) {
 	if (mask[j]==1) {
-	  s1+=s.z[i+s.nsub*j];
+	  s1+=SPEC_Z(s,i,j);
 	  s2+=1.0;
 	}
       }
@@ -47,7 +48,7 @@ void filter(struct spectrogram s,int site_id,float sigma,char *filename,int grav
       // Find standard deviation
       for (j=0,s1=s2=0.0;j<s.nchan;j++) {
 	if (mask[j]==1) {
-	  dz=s.z[i+s.nsub*j]-avg;
+	  dz=SPEC_Z(s,i,j)-avg;
 	  s1+=dz*dz;
 	  s2+=1.0;
 	}
@@ -56,7 +57,7 @@ void filter(struct spectrogram s,int site_id,float sigma,char *filename,int grav
 
       // Update mask
       for (j=0,l=0;j<s.nchan;j++) {
-	if (fabs(s.z[i+s.nsub*j]-avg)>sigma*std) {
+	if (fabs(SPEC_Z(s,i,j)-avg)>sigma*std) {
 	  mask[j]=0;
 	  l++;
 	}
@@ -64,7 +65,7 @@ void filter(struct spectrogram s,int site_id,float sigma,char *filename,int grav
     }
        // Reset mask
     for (j=0;j<s.nchan;j++) {
-      sig[j]=(s.z[i+s.nsub*j]-avg)/std;
+      sig[j]=(SPEC_Z(s,i,j)-avg)/std;
       if (sig[j]>sigma) 
 	mask[j]=1;
       else
@@ -74,13 +75,13 @@ void filter(struct spectrogram s,int site_id,float sigma,char *filename,int grav
     // Find maximum when points are adjacent
     for (j=0;j<s.nchan-1;j++) {
       if (mask[j]==1 && mask[j+1]==1) {
-	if (s.z[i+s.nsub*j]<s.z[i+s.nsub*(j+1)])
+	if (SPEC_Z(s,i,j)<SPEC_Z(s,i,j+1))
 	  mask[j]=0;
       }
     }
     for (j=s.nchan-2;j>=0;j--) {
       if (mask[j]==1 && mask[j-1]==1) {
-	if (s.z[i+s.nsub*j]<s.z[i+s.nsub*(j-1)])
+	if (SPEC_Z(s,i,j)<SPEC_Z(s,i,j-1))
 	  mask[j]=0;
       }
     }
@@ -112,7 +113,9 @@ void usage(void)
   printf("rffind: Find signals RF observations\n\n");
   printf("-p <path>    Input path to file /a/b/c_??????.bin\n");
   printf("-s <start>   Number of starting subintegration [0]\n");
-  printf("-l <length>  Number of subintegrations to plot [3600]\n");
+  printf("-l <length>  Number of subintegrations to search [all]\n");
+  printf("-T <start>   Start time (YYYY-MM-DDTHH:MM:SS.sss) instead of -s, found in <path>.idx\n");
+  printf("-E <end>     End time instead of -l\n");
   printf("-f <freq>    Frequency to zoom into (Hz)\n");
   printf("-w <bw>      Bandwidth to zoom into (Hz)\n");
   printf("-o <offset>  Frequency offset to apply\n");
@@ -124,17 +127,14 @@ void usage(void)
 
 int main(int argc,char *argv[])
 {
-  int i,j,k,l,j0,j1,m=2,n;
-  struct spectrogram s;
+  struct spectrogram_stream r;
   char path[128];
-  int isub=0,nsub=0;
+  int isub=0,nsub=0,status;
   char *env;
   int site_id=0,graves=0;
-  float avg,std;
   int arg=0;
   float sigma=5.0;
-  FILE *file;
-  double f,f0=0.0,df0=0.0;
+  double f0=0.0,df0=0.0,mjd0=0.0,mjd1=0.0;
   char filename[128]="find.dat";
 
   // Get site
@@ -147,7 +147,7 @@ int main(int argc,char *argv[])
 
   // Read arguments
   if (argc>1) {
-    while ((arg=getopt(argc,argv,"p:f:w:s:l:hC:o:S:g"))!=-1) {
+    while ((arg=getopt(argc,argv,"p:f:w:s:l:hC:o:S:gT:E:"))!=-1) {
       switch (arg) {
 	
       case 'p':
@@ -158,6 +158,14 @@ int main(int argc,char *argv[])
 	isub=atoi(optarg);
 	break;
 
+      case 'T':
+	mjd0=nfd2mjd(optarg);
+	break;
+
+      case 'E':
+	mjd1=nfd2mjd(optarg);
+	break;
+
       case 'C':
 	site_id=atoi(optarg);
 	break;
@@ -200,38 +208,21 @@ int main(int argc,char *argv[])
     return 0;
   }
 
-  if (nsub==0) {
-    // Read data
-    for (i=isub;;i++) {
-      s=read_spectrogram(path,i,nsub,f0,df0,1,0.0);
-
-      // Exit on emtpy file
-      if (s.nsub==0)
-	break;
-      
-      printf("Read spectrogram\n%d channels, %d subints\nFrequency: %g MHz\nBandwidth: %g MHz\n",s.nchan,s.nsub,s.freq*1e-6,s.samp_rate*1e-6);
-    
-      // Filter
-      filter(s,site_id,sigma,filename,graves);
-
-      // Free
-      free_spectrogram(s);
-    }
-  } else {
-    // Read data
-    s=read_spectrogram(path,isub,nsub,f0,df0,1,0.0);
-
-    // Exit on emtpy file
-    if (s.nsub>0) {
-      printf("Read spectrogram\n%d channels, %d subints\nFrequency: %g MHz\nBandwidth: %g MHz\n",s.nchan,s.nsub,s.freq*1e-6,s.samp_rate*1e-6);
-      
-      // Filter
-      filter(s,site_id,sigma,filename,graves);
-    }
-
-    // Free
-    free_spectrogram(s);
-  }
+  // Open stream, without -l or -E up to the last file
+  if (mjd0>0.0)
+    status=open_spectrogram_stream_mjd(&r,path,mjd0,mjd1,nsub,NBLOCK,f0,df0,1,0.0);
+  else
+    status=open_spectrogram_stream(&r,path,isub,nsub,NBLOCK,f0,df0,1,0.0);
+  if (status==0)
+    printf("Read spectrogram\n%d channels\nFrequency: %g MHz\nBandwidth: %g MHz\n",r.s.nchan,r.s.freq*1e-6,r.s.samp_rate*1e-6);
+
+  // Filter blocks of subints
+  if (status==0)
+    while (read_spectrogram_stream(&r)>0)
+      filter(r.s,site_id,sigma,filename,graves);
+
+  // Free
+  close_spectrogram_stream(&r);
 
   return 0;
 }
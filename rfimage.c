@@ -0,0 +1,20 @@
+#include <cpgplot.h>
+#include "rfimage.h"
+
+// Draw the spectrogram image, block by block of subints spaced alike
+void plot_spectrogram(struct spectrogram s,float a1,float a2,int gray)
+{
+  int i,n,stride;
+  float tr[]=SPEC_TR;
+
+  for (i=0;i<s.nsub;i+=n) {
+    n=spectrogram_block(s,i,&stride);
+    tr[0]=-0.5+(float) i;
+    if (gray==1)
+      cpggray(SPEC_ROW(s,i),stride,n,1,s.nchan,1,n,a1,a2,tr);
+    else
+      cpgimag(SPEC_ROW(s,i),stride,n,1,s.nchan,1,n,a1,a2,tr);
+  }
+
+  return;
+}
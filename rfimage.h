@@ -0,0 +1,10 @@
+#ifndef RFIMAGE_H
+#define RFIMAGE_H
+
+#include "rfio.h"
+
+// Draw the spectrogram image with PGPLOT, in gray scale from a1 to a2 if
+// gray is set and with the color table otherwise
+void plot_spectrogram(struct spectrogram s,float a1,float a2,int gray);
+
+#endif
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include "rftime.h"
+#include "rfio.h"
+
+void usage(void)
+{
+  printf("rfindex: Index the subints of RF observations, for seeking in time\n\n");
+  printf("-p <path>    Input path to file /a/b/c_??????.bin, writes /a/b/c.idx\n");
+  printf("-s <start>   Number of the first file to index [0]\n");
+  printf("-T <start>   Print the subints from this time on (YYYY-MM-DDTHH:MM:SS.sss) instead\n");
+  printf("-E <end>     Print the subints up to this time\n");
+  printf("-h           This help\n");
+}
+
+int main(int argc,char *argv[])
+{
+  int arg=0,isub=0,jsub;
+  char path[128]="",nfd0[32]="",nfd1[32]="";
+  long n;
+  double mjd0=0.0,mjd1=0.0;
+
+  // Read arguments
+  if (argc>1) {
+    while ((arg=getopt(argc,argv,"p:s:T:E:h"))!=-1) {
+      switch (arg) {
+
+      case 'p':
+	strcpy(path,optarg);
+	break;
+
+      case 's':
+	isub=atoi(optarg);
+	break;
+
+      case 'T':
+	strcpy(nfd0,optarg);
+	break;
+
+      case 'E':
+	strcpy(nfd1,optarg);
+	break;
+
+      case 'h':
+	usage();
+	return 0;
+
+      default:
+	usage();
+	return 0;
+      }
+    }
+  } else {
+    usage();
+    return 0;
+  }
+  if (strlen(path)==0) {
+    usage();
+    return 0;
+  }
+
+  // Look up a time range
+  if (strlen(nfd0)>0) {
+    mjd0=nfd2mjd(nfd0);
+    if (strlen(nfd1)>0)
+      mjd1=nfd2mjd(nfd1);
+    n=find_index(path,mjd0,mjd1,&isub,&jsub);
+    if (n<0) {
+      fprintf(stderr,"%s.idx does not exist\n",path);
+      return -1;
+    }
+    printf("%ld subints from subint %d of %s_%06d.bin\n",n,jsub,path,isub);
+
+    return 0;
+  }
+
+  // Index the series
+  n=build_index(path,isub);
+  if (n<0)
+    return -1;
+  printf("Indexed %ld subints in %s.idx\n",n,path);
+
+  return 0;
+}
@@ -2,23 +2,370 @@
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
 #include "rftime.h"
 #include "rfio.h"
 #include "zscale.h"
 
-struct spectrogram read_spectrogram(char *prefix,int isub,int nsub,double f0,double df0,int nbin,double foff)
+// Map nsub subints of nch float channels from the files, starting at
+// subint jsub of file isub, pointing zrow at the data in place. Returns
+// -1, leaving nothing allocated, if a file can not be mapped or holds
+// subints of another format.
+static int map_spectrogram(struct spectrogram *s,char *prefix,int isub,int jsub,int nsub,int nch)
+{
+  int i,k,l,fd,status,nchan,dummy,flag=0;
+  char filename[128],header[257],nfd[32],*map;
+  double freq,samp_rate;
+  float length;
+  size_t size=256+sizeof(float)*nch;
+  struct stat st;
+
+  printf("Mapping %.2f MB\n",(4* (float) nch * (float) nsub)/(1024 * 1024));
+
+  // Allocate
+  s->z=(float *) calloc(nch,sizeof(float));
+  s->zavg=NULL;
+  s->zstd=NULL;
+  s->zrow=(float **) malloc(sizeof(float *)*nsub);
+  s->mjd=(double *) calloc(nsub,sizeof(double));
+  s->length=(float *) calloc(nsub,sizeof(float));
+  s->map=NULL;
+  s->mapsize=NULL;
+  s->nmap=0;
+  header[256]='\0';
+
+  // Loop over files
+  for (k=0,l=0;l<nsub;k++) {
+    // Generate filename
+    sprintf(filename,"%s_%06d.bin",prefix,k+isub);
+
+    // Open file
+    fd=open(filename,O_RDONLY);
+    if (fd<0) {
+      printf("%s does not exist\n",filename);
+      break;
+    }
+    if (fstat(fd,&st)<0 || st.st_size<size) {
+      close(fd);
+      continue;
+    }
+
+    // Map file, privately so consumers may modify the data
+    map=mmap(NULL,st.st_size,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0);
+    if (map==MAP_FAILED) {
+      perror(filename);
+      close(fd);
+      flag=1;
+      break;
+    }
+    s->map=(void **) realloc(s->map,sizeof(void *)*(s->nmap+1));
+    s->mapsize=(size_t *) realloc(s->mapsize,sizeof(size_t)*(s->nmap+1));
+    s->map[s->nmap]=map;
+    s->mapsize[s->nmap]=st.st_size;
+    s->nmap++;
+    printf("opened %s\n",filename);
+
+    // Loop over contents of file, reading headers without faulting in
+    // the pages of the data
+    for (i=(k==0) ? jsub : 0;(i+1)*size<=st.st_size && l<nsub;i++,l++) {
+      if (pread(fd,header,256,i*size)!=256) {
+	flag=1;
+	break;
+      }
+      status=sscanf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\n",nfd,&freq,&samp_rate,&length,&nchan,&dummy);
+      if (strstr(header,"NBITS         8")!=NULL || status<5 || nchan!=nch) {
+	flag=1;
+	break;
+      }
+
+      s->mjd[l]=nfd2mjd(nfd)+0.5*length/86400.0;
+      s->length[l]=length;
+      s->zrow[l]=(float *) (map+i*size+256);
+    }
+    close(fd);
+    if (flag==1)
+      break;
+  }
+
+  // Give up on a subint that can not be mapped
+  if (flag==1) {
+    free_spectrogram(*s);
+    s->z=NULL;
+    s->zrow=NULL;
+    s->mjd=NULL;
+    s->length=NULL;
+    s->map=NULL;
+    s->mapsize=NULL;
+    s->nmap=0;
+    return -1;
+  }
+
+  // Subints beyond the end of the data are zero, as when copying
+  for (;l<nsub;l++)
+    s->zrow[l]=s->z;
+
+  return 0;
+}
+
+// Averages and deviations of the subints, and the plotting limits
+static void spectrogram_limits(struct spectrogram *s)
+{
+  int i,j;
+  float *zs,sum,avg;
+  double z1,z2;
+
+  // Compute averages, summing in registers
+  for (i=0;i<s->nsub;i++) {
+    zs=SPEC_ROW(*s,i);
+    for (j=0,sum=0.0;j<s->nchan;j++) 
+      if (!isnan(zs[j]) && !isinf(zs[j]))
+	sum+=zs[j];
+    s->zavg[i]=sum/(float) s->nchan;
+  }
+
+  // Compute deviations
+  for (i=0;i<s->nsub;i++) {
+    zs=SPEC_ROW(*s,i);
+    avg=s->zavg[i];
+    for (j=0,sum=0.0;j<s->nchan;j++) 
+      if (!isnan(zs[j]) && !isinf(zs[j]))
+	sum+=pow(avg-zs[j],2);
+    s->zstd[i]=sqrt(sum/(float) s->nchan);
+  }
+
+  // Compute limits
+  for (i=0;i<s->nsub;i++) {
+    if (i==0) {
+      s->zmin=s->zavg[i]-1.0*s->zstd[i];
+      s->zmax=s->zavg[i]+1.0*s->zstd[i];
+    } else {
+      if (s->zavg[i]-1.0*s->zstd[i]<s->zmin) s->zmin=s->zavg[i]-1.0*s->zstd[i];
+      if (s->zavg[i]+1.0*s->zstd[i]>s->zmax) s->zmax=s->zavg[i]+1.0*s->zstd[i];
+    }
+  }
+
+  zscale(s, s->nsub, 0.25,&z1, &z2);
+  s->zmin = z1;
+  s->zmax = z2;
+}
+
+// Threads loading copied spectrograms [0: one per processor]
+static int nthreads_load=0;
+
+void set_spectrogram_threads(int nthreads)
+{
+  nthreads_load=nthreads;
+}
+
+// Files of a copied spectrogram, with the subints each contributes found
+// up front from the file sizes, so the files can be loaded in parallel
+struct load_state {
+  struct spectrogram *s;
+  char *prefix;
+  int isub0,nbits,j0,nbin;      // First file, format of the files
+  size_t size;                 // Bytes per subint
+  int nfile;
+  int *jsub;                   // First subint read from each file
+  int *n;                      // Subints read from each file
+  long *l0;                    // Index of the first of them
+  long ntot;                   // Subints read from all files
+  int next;                    // Next file to load
+  pthread_mutex_t lock;
+};
+
+// Add subint l, of file m, to bin i
+static int load_subint(struct load_state *ls,int fd,int m,long l,int i,char *buf)
+{
+  int j,status,nchan,dummy;
+  char header[257],nfd[32];
+  double freq,samp_rate;
+  float length,zavg,zstd,*z,*zs;
+  struct spectrogram *s=ls->s;
+
+  if (pread(fd,buf,ls->size,(off_t) (ls->jsub[m]+l-ls->l0[m])*ls->size)!=ls->size)
+    return -1;
+  memcpy(header,buf,256);
+  header[256]='\0';
+  if (ls->nbits==-32)
+    status=sscanf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\n",nfd,&freq,&samp_rate,&length,&nchan,&dummy);
+  else
+    status=sscanf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\nNBITS         8\nMEAN         %f\nRMS          %f",nfd,&freq,&samp_rate,&length,&nchan,&dummy,&zavg,&zstd);
+  if (status<4)
+    return -1;
+  s->mjd[i]+=nfd2mjd(nfd)+0.5*length/86400.0;
+  s->length[i]+=length;
+
+  // Add to the subint, which is contiguous
+  zs=SPEC_ROW(*s,i);
+  if (ls->nbits==-32) {
+    z=(float *) (buf+256)+ls->j0;
+    for (j=0;j<s->nchan;j++)
+      zs[j]+=z[j];
+  } else {
+    for (j=0;j<s->nchan;j++)
+      zs[j]+=(float) (6.0/256.0*(float) buf[256+ls->j0+j]*zstd+zavg);
+  }
+
+  return 0;
+}
+
+// Load the bins that start in file k, reading on into the next files for
+// a bin that spans them, so every file fills its own range of subints
+static void load_file(struct load_state *ls,int k,char *buf)
+{
+  int i,i0,i1,j,m,fd=-1,fm=-1,nadd;
+  long l;
+  char filename[160];
+  struct spectrogram *s=ls->s;
+
+  i0=(ls->l0[k]+ls->nbin-1)/ls->nbin;
+  i1=(ls->l0[k]+ls->n[k]+ls->nbin-1)/ls->nbin;
+  if (i1>s->nsub)
+    i1=s->nsub;
+
+  for (i=i0,m=k;i<i1;i++) {
+    for (j=0;j<s->nchan;j++)
+      SPEC_Z(*s,i,j)=0.0;
+
+    // Add the subints of the bin, as far as they were written
+    for (l=(long) i*ls->nbin,nadd=0;l<(long) (i+1)*ls->nbin && l<ls->ntot;l++) {
+      while (l>=ls->l0[m]+ls->n[m])
+	m++;
+      if (m!=fm) {
+	if (fd>=0)
+	  close(fd);
+	sprintf(filename,"%s_%06d.bin",ls->prefix,ls->isub0+m);
+	fd=open(filename,O_RDONLY);
+	fm=m;
+      }
+      if (fd<0 || load_subint(ls,fd,m,l,i,buf)<0)
+	break;
+      nadd++;
+    }
+
+    // Scale
+    if (nadd>1) {
+      s->mjd[i]/=(float) nadd;
+      for (j=0;j<s->nchan;j++)
+	SPEC_Z(*s,i,j)/=(float) nadd;
+    }
+  }
+  if (fd>=0)
+    close(fd);
+
+  return;
+}
+
+static void *load_files(void *arg)
+{
+  struct load_state *ls=(struct load_state *) arg;
+  char *buf;
+  int k;
+
+  buf=(char *) malloc(ls->size);
+  for (;;) {
+    pthread_mutex_lock(&ls->lock);
+    k=ls->next++;
+    pthread_mutex_unlock(&ls->lock);
+    if (k>=ls->nfile)
+      break;
+    load_file(ls,k,buf);
+  }
+  free(buf);
+
+  return NULL;
+}
+
+// Read nsub subints from subint jsub of file isub into the allocated
+// spectrogram s, decoding the files on parallel threads
+static void load_subints(struct spectrogram *s,char *prefix,int isub,int jsub,int nsub,int nch,int nbits,int j0,int nbin)
+{
+  int i,j,k,nthreads;
+  char filename[128];
+  struct stat st;
+  struct load_state ls;
+  pthread_t *thread;
+
+  memset(&ls,0,sizeof(struct load_state));
+  ls.s=s;
+  ls.prefix=prefix;
+  ls.isub0=isub;
+  ls.nbits=nbits;
+  ls.j0=j0;
+  ls.nbin=nbin;
+  ls.size=256+(size_t) nch*((nbits==8) ? 1 : sizeof(float));
+
+  // Subints of every file, up to a missing file
+  for (k=0;ls.ntot<nsub;k++) {
+    sprintf(filename,"%s_%06d.bin",prefix,k+isub);
+    if (stat(filename,&st)<0) {
+      printf("%s does not exist\n",filename);
+      break;
+    }
+    printf("opened %s\n",filename);
+    ls.jsub=(int *) realloc(ls.jsub,sizeof(int)*(k+1));
+    ls.n=(int *) realloc(ls.n,sizeof(int)*(k+1));
+    ls.l0=(long *) realloc(ls.l0,sizeof(long)*(k+1));
+    ls.jsub[k]=(k==0) ? jsub : 0;
+    ls.n[k]=st.st_size/ls.size-ls.jsub[k];
+    if (ls.n[k]<0)
+      ls.n[k]=0;
+    if (ls.ntot+ls.n[k]>nsub)
+      ls.n[k]=nsub-ls.ntot;
+    ls.l0[k]=ls.ntot;
+    ls.ntot+=ls.n[k];
+  }
+  ls.nfile=k;
+
+  // Threads, at most one per file
+  nthreads=(nthreads_load>0) ? nthreads_load : (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (nthreads>ls.nfile)
+    nthreads=ls.nfile;
+  if (nthreads<1)
+    nthreads=1;
+  pthread_mutex_init(&ls.lock,NULL);
+  thread=(pthread_t *) malloc(sizeof(pthread_t)*nthreads);
+  for (i=1;i<nthreads;i++)
+    if (pthread_create(&thread[i],NULL,load_files,&ls)!=0)
+      break;
+  load_files(&ls);
+  for (k=1;k<i;k++)
+    pthread_join(thread[k],NULL);
+  free(thread);
+  pthread_mutex_destroy(&ls.lock);
+
+  // Zero the subints beyond the end of the data
+  for (i=(ls.ntot+nbin-1)/nbin;i<s->nsub;i++)
+    for (j=0;j<s->nchan;j++)
+      SPEC_Z(*s,i,j)=0.0;
+
+  free(ls.jsub);
+  free(ls.n);
+  free(ls.l0);
+
+  return;
+}
+
+// Read nsub subints, starting at subint jsub of file isub
+static struct spectrogram read_subints(char *prefix,int isub,int jsub,int nsub,double f0,double df0,int nbin,double foff)
 {
-  int i,j,k,l,flag=0,status,msub,ibin,nadd,nbits=-32;
-  char filename[128],header[256],nfd[32];
+  int j,status,msub,nbits=-32;
+  char filename[128],header[256];
   FILE *file;
   struct spectrogram s;
-  float *z,zavg,zstd;
-  char *cz;
-  int nch,j0,j1;
-  double freq,samp_rate;
+  float zavg,zstd;
+  int nch=0,j0,j1;
   float length;
-  int nchan,dummy;
-  float s1,s2;
+  double z1,z2;
+
+  // Nothing allocated yet
+  memset(&s,0,sizeof(struct spectrogram));
 
   // Open first file to get number of channels
   sprintf(filename,"%s_%06d.bin",prefix,isub);
@@ -39,6 +386,19 @@ struct spectrogram read_spectrogram(char *prefix,int isub,int nsub,double f0,dou
     status=sscanf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\nNBITS         8\nMEAN         %f\nRMS          %f",s.nfd0,&s.freq,&s.samp_rate,&length,&nch,&msub,&zavg,&zstd);
     nbits=8;
   }
+  if (status<5 || nch<=0) {
+    fprintf(stderr,"%s is not a spectrogram\n",filename);
+    fclose(file);
+    s.nsub=0;
+    return s;
+  }
+
+  // Start of the first subint
+  if (jsub>0) {
+    fseeko(file,(off_t) jsub*(256+nch*((nbits==8) ? 1 : sizeof(float))),SEEK_SET);
+    if (fread(header,sizeof(char),256,file)==256)
+      sscanf(header,"HEADER\nUTC_START    %s\n",s.nfd0);
+  }
   s.freq+=foff;
   
   // Close file
@@ -64,160 +424,557 @@ struct spectrogram read_spectrogram(char *prefix,int isub,int nsub,double f0,dou
   }
 
   // Read whole file if not specified
-  if (nsub==0 && msub>0)
-    nsub=msub;
+  if (nsub==0 && msub>jsub)
+    nsub=msub-jsub;
 
-  // Number of subints
+  // Number of subints, of whole bins only
   s.nsub=nsub/nbin;
+  nsub=s.nsub*nbin;
   s.msub=msub;
   s.isub=isub;
+  s.jsub=jsub;
+
+  // Map float subints in place when they are neither added nor zoomed
+  if (nbin==1 && j0==0 && j1==nch && nbits==-32 && map_spectrogram(&s,prefix,isub,jsub,s.nsub,nch)==0) {
+    zscale(&s, s.nsub, 0.25,&z1, &z2);
+    printf("z1 = %f, z2 = %f\n", z1, z2);
+    s.zmin = z1;
+    s.zmax = z2;
+
+    return s;
+  }
   
   printf("Allocating %.2f MB of memory\n",(4* (float) s.nchan * (float) s.nsub)/(1024 * 1024));
   
   // Allocate
   s.z=(float *) malloc(sizeof(float)*s.nchan*s.nsub);
+  s.zrow=(float **) malloc(sizeof(float *)*s.nsub);
   s.zavg=(float *) malloc(sizeof(float)*s.nsub);
   s.zstd=(float *) malloc(sizeof(float)*s.nsub);
-  z=(float *) malloc(sizeof(float)*nch);
-  cz=(char *) malloc(sizeof(char)*nch);
   s.mjd=(double *) malloc(sizeof(double)*s.nsub);
   s.length=(float *) malloc(sizeof(float)*s.nsub);
 
-  // Initialize
-  for (j=0;j<s.nchan*s.nsub;j++)
-    s.z[j]=0.0;
-  for (j=0;j<s.nsub;j++)
+  // Initialize, the subints are zeroed by the loaders
+  for (j=0;j<s.nsub;j++) {
+    s.zrow[j]=s.z+(size_t) j*s.nchan;
     s.mjd[j]=0.0;
+    s.length[j]=0.0;
+  }
 
-  // Loop over files
-  for (k=0,i=0,l=0,ibin=0,nadd=0;l<nsub;k++) {
-    // Generate filename
-    sprintf(filename,"%s_%06d.bin",prefix,k+isub);
+  // Load the files in parallel
+  load_subints(&s,prefix,isub,jsub,nsub,nch,nbits,j0,nbin);
 
-    // Open file
-    file=fopen(filename,"r");
-    if (file==NULL) {
-      printf("%s does not exist\n",filename);
-      break;
+  // Swap frequency range
+  if (f0>0.0 && df0>0.0) {
+    s.freq=f0;
+    s.samp_rate=df0;
+  }
+
+  // Compute averages, deviations and limits
+  spectrogram_limits(&s);
+  printf("z1 = %f, z2 = %f\n", s.zmin, s.zmax);
+
+  return s;
+}
+
+struct spectrogram read_spectrogram(char *prefix,int isub,int nsub,double f0,double df0,int nbin,double foff)
+{
+  return read_subints(prefix,isub,0,nsub,f0,df0,nbin,foff);
+}
+
+// Number of subints from mjd0 to mjd1, or nsub from mjd0 if mjd1 is 0,
+// and the file and subint of the first, indexing the series if needed
+static long locate_subints(char *prefix,double mjd0,double mjd1,int nsub,int *isub,int *jsub)
+{
+  long n;
+
+  // Index the series if it has no index yet
+  n=find_index(prefix,mjd0,mjd1,isub,jsub);
+  if (n<0) {
+    printf("Indexing %s\n",prefix);
+    if (build_index(prefix,0)>0)
+      n=find_index(prefix,mjd0,mjd1,isub,jsub);
+  }
+
+  // Without an end, read nsub subints
+  if (mjd1<=mjd0 && nsub>0 && n>nsub)
+    n=nsub;
+  if (n<=0) {
+    fprintf(stderr,"No subints of %s in the requested time range\n",prefix);
+    return 0;
+  }
+  printf("Reading %ld subints from subint %d of file %d\n",n,*jsub,*isub);
+
+  return n;
+}
+
+struct spectrogram read_spectrogram_mjd(char *prefix,double mjd0,double mjd1,int nsub,double f0,double df0,int nbin,double foff)
+{
+  int isub,jsub;
+  long n;
+  struct spectrogram s;
+
+  n=locate_subints(prefix,mjd0,mjd1,nsub,&isub,&jsub);
+  if (n==0) {
+    memset(&s,0,sizeof(struct spectrogram));
+    return s;
+  }
+
+  return read_subints(prefix,isub,jsub,(int) n,f0,df0,nbin,foff);
+}
+
+// Read the whole subints of file r->file[b] into buffer b; a missing
+// file gets number -1
+static void load_stream_file(struct spectrogram_stream *r,int b)
+{
+  char filename[160];
+  FILE *file;
+  off_t size;
+  size_t n;
+
+  r->nfile[b]=0;
+  sprintf(filename,"%s_%06d.bin",r->prefix,r->file[b]);
+  file=fopen(filename,"r");
+  if (file==NULL) {
+    r->file[b]=-1;
+    return;
+  }
+
+  // Grow the buffer, which is reused for later files
+  fseeko(file,0,SEEK_END);
+  size=ftello(file);
+  fseeko(file,0,SEEK_SET);
+  if (size>r->alloc[b]) {
+    free(r->data[b]);
+    r->data[b]=(char *) malloc(size);
+    r->alloc[b]=(r->data[b]!=NULL) ? size : 0;
+  }
+  if (r->data[b]!=NULL) {
+    n=fread(r->data[b],1,size,file);
+    r->nfile[b]=n/r->size;
+  }
+  fclose(file);
+
+  return;
+}
+
+static void *prefetch_stream_file(void *arg)
+{
+  struct spectrogram_stream *r=(struct spectrogram_stream *) arg;
+
+  load_stream_file(r,1-r->cur);
+
+  return NULL;
+}
+
+// Read the next file ahead if the stream goes on beyond the current one
+static void prefetch_stream(struct spectrogram_stream *r)
+{
+  int b=1-r->cur;
+
+  r->file[b]=r->file[r->cur]+1;
+  r->nfile[b]=0;
+  if (r->nleft>=0 && r->nleft<=r->nfile[r->cur]-r->pos)
+    return;
+  r->prefetch=(pthread_create(&r->thread,NULL,prefetch_stream_file,r)==0);
+
+  return;
+}
+
+// Move on to the next file, waiting for it to be read ahead; -1 at the
+// end of the series
+static int next_stream_file(struct spectrogram_stream *r)
+{
+  if (r->prefetch) {
+    pthread_join(r->thread,NULL);
+    r->prefetch=0;
+  } else {
+    load_stream_file(r,1-r->cur);
+  }
+  r->cur=1-r->cur;
+  r->pos=0;
+  if (r->file[r->cur]<0) {
+    r->nleft=0;
+    return -1;
+  }
+  printf("opened %s_%06d.bin\n",r->prefix,r->file[r->cur]);
+  prefetch_stream(r);
+
+  return 0;
+}
+
+// Open a stream of nsub subints from subint jsub of file isub
+static int open_stream(struct spectrogram_stream *r,char *prefix,int isub,int jsub,long nsub,int nblock,double f0,double df0,int nbin,double foff)
+{
+  int status,msub,j0,j1;
+  char filename[160],header[256];
+  FILE *file;
+  float length,zavg,zstd;
+  struct spectrogram *s=&r->s;
+
+  memset(r,0,sizeof(struct spectrogram_stream));
+  snprintf(r->prefix,sizeof(r->prefix),"%s",prefix);
+  r->nblock=(nblock>0) ? nblock : 1;
+  r->nbin=(nbin>0) ? nbin : 1;
+  r->nleft=(nsub>0) ? nsub : -1;
+  r->nbits=-32;
+
+  // Format of the series, from the first file
+  sprintf(filename,"%s_%06d.bin",r->prefix,isub);
+  file=fopen(filename,"r");
+  if (file==NULL) {
+    printf("%s does not exist\n",filename);
+    return -1;
+  }
+  status=fread(header,sizeof(char),256,file);
+  fclose(file);
+  if (strstr(header,"NBITS         8")==NULL) {
+    status=sscanf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\n",s->nfd0,&s->freq,&s->samp_rate,&length,&r->nch,&msub);
+  } else {
+    status=sscanf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\nNBITS         8\nMEAN         %f\nRMS          %f",s->nfd0,&s->freq,&s->samp_rate,&length,&r->nch,&msub,&zavg,&zstd);
+    r->nbits=8;
+  }
+  if (status<5 || r->nch<=0) {
+    fprintf(stderr,"%s is not a spectrogram\n",filename);
+    return -1;
+  }
+  r->size=256+(size_t) r->nch*((r->nbits==8) ? 1 : sizeof(float));
+  s->freq+=foff;
+  s->msub=(status==6) ? msub : 0;
+  s->isub=isub;
+
+  // Compute plotting channel
+  if (f0>0.0 && df0>0.0) {
+    s->nchan=(int) (df0/s->samp_rate*(float) r->nch);
+    j0=(int) ((f0-0.5*df0-s->freq+0.5*s->samp_rate)*(float) r->nch/s->samp_rate);
+    j1=(int) ((f0+0.5*df0-s->freq+0.5*s->samp_rate)*(float) r->nch/s->samp_rate);
+    if (j0<0 || j1>r->nch) {
+      fprintf(stderr,"Requested frequency range out of limits\n");
+      return -1;
     }
-    printf("opened %s\n",filename);
+    r->j0=j0;
+    s->freq=f0;
+    s->samp_rate=df0;
+  } else {
+    s->nchan=r->nch;
+    r->j0=0;
+  }
 
-    // Loop over contents of file
-    for (;l<nsub;l++,ibin++) {
-      // Read header
-      status=fread(header,sizeof(char),256,file);
+  // Block, reused for every block
+  s->z=(float *) calloc((size_t) r->nblock*s->nchan,sizeof(float));
+  s->zrow=(float **) malloc(sizeof(float *)*r->nblock);
+  s->zavg=(float *) calloc(r->nblock,sizeof(float));
+  s->zstd=(float *) calloc(r->nblock,sizeof(float));
+  s->mjd=(double *) calloc(r->nblock,sizeof(double));
+  s->length=(float *) calloc(r->nblock,sizeof(float));
+  for (j0=0;j0<r->nblock;j0++)
+    s->zrow[j0]=s->z+(size_t) j0*s->nchan;
 
-      if (status==0)
-	break;
-      if (nbits==-32)
-	status=sscanf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\n",nfd,&freq,&samp_rate,&length,&nchan,&msub);
-      else if (nbits==8)
-	status=sscanf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\nNBITS         8\nMEAN         %f\nRMS          %f",nfd,&freq,&samp_rate,&length,&nchan,&dummy,&zavg,&zstd);
+  // First file, then read the next one ahead
+  r->file[0]=isub;
+  load_stream_file(r,0);
+  printf("opened %s\n",filename);
+  r->pos=jsub;
+  prefetch_stream(r);
 
-      s.mjd[i]+=nfd2mjd(nfd)+0.5*length/86400.0;
-      s.length[i]+=length;
-      nadd++;
+  return 0;
+}
 
-      // Read buffer
-      if (nbits==-32) {
-	status=fread(z,sizeof(float),nch,file);
-      } else if (nbits==8) {
-	status=fread(cz,sizeof(char),nch,file);
-	for (j=0;j<nch;j++)
-	  z[j]=6.0/256.0*(float) cz[j]*zstd+zavg;
-      }
-      if (status==0)
+int open_spectrogram_stream(struct spectrogram_stream *r,char *prefix,int isub,int nsub,int nblock,double f0,double df0,int nbin,double foff)
+{
+  return open_stream(r,prefix,isub,0,nsub,nblock,f0,df0,nbin,foff);
+}
+
+int open_spectrogram_stream_mjd(struct spectrogram_stream *r,char *prefix,double mjd0,double mjd1,int nsub,int nblock,double f0,double df0,int nbin,double foff)
+{
+  int isub,jsub;
+  long n;
+
+  n=locate_subints(prefix,mjd0,mjd1,nsub,&isub,&jsub);
+  if (n==0) {
+    memset(r,0,sizeof(struct spectrogram_stream));
+    return -1;
+  }
+
+  return open_stream(r,prefix,isub,jsub,n,nblock,f0,df0,nbin,foff);
+}
+
+int read_spectrogram_stream(struct spectrogram_stream *r)
+{
+  int i,j,nadd,status,nchan,dummy;
+  char header[257],nfd[32],*p,*cz;
+  double freq,samp_rate;
+  float length,zavg,zstd,*z,*zs;
+  struct spectrogram *s=&r->s;
+
+  header[256]='\0';
+  for (i=0,nadd=0;i<r->nblock && r->nleft!=0;) {
+    // Move on to the next file at the end of this one
+    if (r->pos>=r->nfile[r->cur]) {
+      if (next_stream_file(r)<0)
 	break;
-      
-      // Copy
-      for (j=0;j<s.nchan;j++) 
-	s.z[i+s.nsub*j]+=z[j+j0];
-
-      // Increment
-      if (l%nbin==nbin-1) {
-	// Scale
-	s.mjd[i]/=(float) nadd;
-
-	for (j=0;j<s.nchan;j++) 
-	  s.z[i+s.nsub*j]/=(float) nadd;
-
-	ibin=0;
-	nadd=0;
-	i++;
+      continue;
+    }
+    p=r->data[r->cur]+(size_t) r->pos*r->size;
+    r->pos++;
+    if (r->nleft>0)
+      r->nleft--;
+
+    // Read header
+    memcpy(header,p,256);
+    if (r->nbits==-32)
+      status=sscanf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\n",nfd,&freq,&samp_rate,&length,&nchan,&dummy);
+    else
+      status=sscanf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\nNBITS         8\nMEAN         %f\nRMS          %f",nfd,&freq,&samp_rate,&length,&nchan,&dummy,&zavg,&zstd);
+    if (status<5 || nchan!=r->nch) {
+      fprintf(stderr,"Subint %d of %s_%06d.bin does not match the series\n",r->pos-1,r->prefix,r->file[r->cur]);
+      r->nleft=0;
+      break;
+    }
+
+    // Start a subint, the first of a bin
+    zs=SPEC_ROW(*s,i);
+    if (nadd==0) {
+      if (i==0) {
+	strcpy(s->nfd0,nfd);
+	s->isub=r->file[r->cur];
+	s->jsub=r->pos-1;
       }
+      s->mjd[i]=0.0;
+      s->length[i]=0.0;
+      for (j=0;j<s->nchan;j++)
+	zs[j]=0.0;
     }
+    s->mjd[i]+=nfd2mjd(nfd)+0.5*length/86400.0;
+    s->length[i]+=length;
 
-    // Close file
-    fclose(file);
+    // Add the channels
+    if (r->nbits==-32) {
+      z=(float *) (p+256)+r->j0;
+      for (j=0;j<s->nchan;j++)
+	zs[j]+=z[j];
+    } else {
+      cz=p+256+r->j0;
+      for (j=0;j<s->nchan;j++)
+	zs[j]+=(float) (6.0/256.0*(float) cz[j]*zstd+zavg);
+    }
+    nadd++;
+
+    // Scale a full bin, dropping a trailing partial one
+    if (nadd==r->nbin) {
+      if (nadd>1) {
+	s->mjd[i]/=(float) nadd;
+	for (j=0;j<s->nchan;j++)
+	  zs[j]/=(float) nadd;
+      }
+      nadd=0;
+      i++;
+    }
   }
+  s->nsub=i;
 
-  // Scale last subint
-  if(nadd>0)
-  {
-    s.mjd[i]/=(float) nadd;
+  // Compute averages, deviations and limits
+  if (s->nsub>0)
+    spectrogram_limits(s);
 
-    for (j=0;j<s.nchan;j++)
-      s.z[i+s.nsub*j]/=(float) nadd;
+  return s->nsub;
+}
+
+void close_spectrogram_stream(struct spectrogram_stream *r)
+{
+  if (r->prefetch)
+    pthread_join(r->thread,NULL);
+  free(r->data[0]);
+  free(r->data[1]);
+  free_spectrogram(r->s);
+  memset(r,0,sizeof(struct spectrogram_stream));
+
+  return;
+}
+
+// Index header, the first record of the index
+struct index_header {
+  char magic[8];
+  int32_t version;
+  int32_t nsub;                // Subints per file
+  char pad[16];
+};
+
+// Subints per file of an index, -1 if it is not an index
+static int index_nsub(int fd)
+{
+  struct index_header h;
+
+  if (pread(fd,&h,sizeof(h),0)!=sizeof(h) || memcmp(h.magic,"RFIDX\0\0\0",8)!=0 || h.version!=1 || h.nsub<1)
+    return -1;
+
+  return h.nsub;
+}
+
+int open_index(char *prefix,int isub,int nsub)
+{
+  int fd;
+  char filename[PATH_MAX];
+  struct index_header h;
+
+  if (snprintf(filename,sizeof(filename),"%s.idx",prefix)>=(int) sizeof(filename))
+    return -1;
+  fd=open(filename,O_RDWR|O_CREAT,0644);
+  if (fd<0)
+    return -1;
+
+  // Keep the records of earlier files, unless they were written with
+  // another number of subints per file
+  if (index_nsub(fd)!=nsub)
+    isub=0;
+  memset(&h,0,sizeof(h));
+  memcpy(h.magic,"RFIDX\0\0\0",8);
+  h.version=1;
+  h.nsub=nsub;
+  if (ftruncate(fd,(off_t) sizeof(struct spectrogram_index)*(1+(off_t) isub*nsub))!=0 || pwrite(fd,&h,sizeof(h),0)!=sizeof(h)) {
+    close(fd);
+    return -1;
   }
 
-  // Swap frequency range
-  if (f0>0.0 && df0>0.0) {
-    s.freq=f0;
-    s.samp_rate=df0;
+  return fd;
+}
+
+int write_index(int fd,int nsub,int jsub,struct spectrogram_index *r)
+{
+  off_t pos=(off_t) sizeof(struct spectrogram_index)*(1+(off_t) r->file*nsub+jsub);
+
+  return (pwrite(fd,r,sizeof(struct spectrogram_index),pos)==sizeof(struct spectrogram_index)) ? 0 : -1;
+}
+
+long build_index(char *prefix,int isub)
+{
+  int k,j,fd,nsub=0,nchan,msub,status;
+  long n=0;
+  char filename[PATH_MAX],header[257],nfd[32];
+  double freq,samp_rate;
+  float length;
+  FILE *file;
+  struct spectrogram_index r;
+
+  header[256]='\0';
+  for (k=isub,fd=-1;;k++) {
+    if (snprintf(filename,sizeof(filename),"%s_%06d.bin",prefix,k)>=(int) sizeof(filename))
+      break;
+    file=fopen(filename,"r");
+    if (file==NULL)
+      break;
+
+    // Subints per file, those of the first if the headers do not say
+    for (j=0;fread(header,sizeof(char),256,file)==256;j++) {
+      status=sscanf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\n",nfd,&freq,&samp_rate,&length,&nchan,&msub);
+      if (status<5)
+	break;
+      if (fd<0) {
+	if (status<6) {
+	  fseeko(file,0,SEEK_END);
+	  msub=(int) (ftello(file)/(256+nchan*((strstr(header,"NBITS         8")!=NULL) ? 1 : sizeof(float))));
+	  fseeko(file,256,SEEK_SET);
+	}
+	nsub=msub;
+	fd=open_index(prefix,isub,nsub);
+	if (fd<0) {
+	  fprintf(stderr,"Failed to write %s.idx\n",prefix);
+	  fclose(file);
+	  return -1;
+	}
+      }
+      if (j>=nsub)
+	break;
+
+      r.file=k;
+      r.nchan=nchan;
+      r.offset=ftello(file)-256;
+      r.mjd=nfd2mjd(nfd);
+      r.length=length;
+      r.nbits=(strstr(header,"NBITS         8")!=NULL) ? 8 : 32;
+      if (write_index(fd,nsub,j,&r)==0)
+	n++;
+
+      // Skip to the next subint
+      fseeko(file,(off_t) nchan*r.nbits/8,SEEK_CUR);
+    }
+    fclose(file);
   }
+  if (fd>=0)
+    close(fd);
 
-  // Compute averages
-  for (i=0;i<s.nsub;i++) {
-    s.zavg[i]=0.0;
-    for (j=0;j<s.nchan;j++) 
-      if (!isnan(s.z[i+s.nsub*j]) && !isinf(s.z[i+s.nsub*j]))
-	s.zavg[i]+=s.z[i+s.nsub*j];
-    s.zavg[i]/=(float) s.nchan;
+  return n;
+}
+
+// Record of subint n of an index, with a start time of 0 for subints
+// that were not written
+static void index_record(int fd,long n,struct spectrogram_index *r)
+{
+  if (pread(fd,r,sizeof(struct spectrogram_index),(off_t) sizeof(struct spectrogram_index)*(1+n))!=sizeof(struct spectrogram_index))
+    memset(r,0,sizeof(struct spectrogram_index));
+
+  return;
+}
+
+long find_index(char *prefix,double mjd0,double mjd1,int *isub,int *jsub)
+{
+  int fd,nsub;
+  long n,lo,hi,mid,n0;
+  char filename[PATH_MAX];
+  struct stat st;
+  struct spectrogram_index r;
+
+  if (snprintf(filename,sizeof(filename),"%s.idx",prefix)>=(int) sizeof(filename))
+    return -1;
+  fd=open(filename,O_RDONLY);
+  if (fd<0)
+    return -1;
+  nsub=index_nsub(fd);
+  if (nsub<0 || fstat(fd,&st)!=0) {
+    close(fd);
+    return -1;
   }
+  n=st.st_size/sizeof(struct spectrogram_index)-1;
 
-  // Compute deviations
-  for (i=0;i<s.nsub;i++) {
-    s.zstd[i]=0.0;
-    for (j=0;j<s.nchan;j++) 
-      if (!isnan(s.z[i+s.nsub*j]) && !isinf(s.z[i+s.nsub*j]))
-	s.zstd[i]+=pow(s.zavg[i]-s.z[i+s.nsub*j],2);
-    s.zstd[i]=sqrt(s.zstd[i]/(float) s.nchan);
+  // First subint ending after mjd0
+  for (lo=0,hi=n;lo<hi;) {
+    mid=lo+(hi-lo)/2;
+    index_record(fd,mid,&r);
+    if (r.mjd+r.length/86400.0<=mjd0)
+      lo=mid+1;
+    else
+      hi=mid;
   }
+  n0=lo;
 
-  // Compute limits
-  for (i=0;i<s.nsub;i++) {
-    if (i==0) {
-      s.zmin=s.zavg[i]-1.0*s.zstd[i];
-      s.zmax=s.zavg[i]+1.0*s.zstd[i];
-    } else {
-      if (s.zavg[i]-1.0*s.zstd[i]<s.zmin) s.zmin=s.zavg[i]-1.0*s.zstd[i];
-      if (s.zavg[i]+1.0*s.zstd[i]>s.zmax) s.zmax=s.zavg[i]+1.0*s.zstd[i];
+  // First subint starting at or after mjd1
+  if (mjd1>mjd0) {
+    for (hi=n;lo<hi;) {
+      mid=lo+(hi-lo)/2;
+      index_record(fd,mid,&r);
+      if (r.mjd<mjd1)
+	lo=mid+1;
+      else
+	hi=mid;
     }
+  } else {
+    lo=n;
   }
+  close(fd);
 
-  double z1,z2;
-  zscale(&s, s.nsub, 0.25,&z1, &z2);
-  printf("z1 = %f, z2 = %f\n", z1, z2);
-  s.zmin = z1;
-  s.zmax = z2;
-  // Free 
-  free(z);
-  free(cz);
+  *isub=(int) (n0/nsub);
+  *jsub=(int) (n0%nsub);
 
-  return s;
+  return lo-n0;
 }
 
 void write_spectrogram(struct spectrogram s,char *prefix)
 {
-  int i,j;
+  int i;
   FILE *file;
   char header[256]="",filename[256],nfd[32];
-  float *z;
   double mjd;
 
-  // Allocate
-  z=(float *) malloc(sizeof(float)*s.nchan);
-
   // Generate filename
   sprintf(filename,"%s_%06d.bin",prefix,0);
 
@@ -233,29 +990,68 @@ void write_spectrogram(struct spectrogram s,char *prefix)
     // Generate header
     sprintf(header,"HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nEND\n",nfd,s.freq,s.samp_rate,s.length[i],s.nchan);
 
-    // Copy buffer
-    for (j=0;j<s.nchan;j++) 
-      z[j]=s.z[i+s.nsub*j];
-
-    // Dump contents
+    // Dump contents, subints are contiguous
     fwrite(header,sizeof(char),256,file);
-    fwrite(z,sizeof(float),s.nchan,file);
+    fwrite(SPEC_ROW(s,i),sizeof(float),s.nchan,file);
   }
 
   // Close file
   fclose(file);
 
-  // Free
-  free(z);
-
   return;
 }
 
 void free_spectrogram(struct spectrogram s)
 {
+  int i;
+
+  for (i=0;i<s.nmap;i++)
+    munmap(s.map[i],s.mapsize[i]);
+  free(s.map);
+  free(s.mapsize);
+  free(s.zrow);
   free(s.z);
   free(s.zavg);
   free(s.zstd);
   free(s.mjd);
   free(s.length);
 }
+
+// Mapped file holding row p of a spectrogram, -1 for the row of zeros;
+// addresses of different objects are compared as integers
+static int spectrogram_map(struct spectrogram s,float *p)
+{
+  int k;
+  uintptr_t a=(uintptr_t) p;
+
+  for (k=0;k<s.nmap;k++)
+    if (a>=(uintptr_t) s.map[k] && a<(uintptr_t) s.map[k]+s.mapsize[k])
+      return k;
+
+  return -1;
+}
+
+int spectrogram_block(struct spectrogram s,int i,int *stride)
+{
+  int n,k;
+  uintptr_t d;
+
+  // Single subint, like the zeros beyond the end of the data
+  *stride=s.nchan;
+  if (i+1>=s.nsub)
+    return 1;
+
+  // All subints of a copied spectrogram
+  if (s.nmap==0)
+    return s.nsub-i;
+
+  // Subints of the same mapped file, spaced by their headers
+  k=spectrogram_map(s,s.zrow[i]);
+  if (k<0 || spectrogram_map(s,s.zrow[i+1])!=k)
+    return 1;
+  d=(uintptr_t) s.zrow[i+1]-(uintptr_t) s.zrow[i];
+  for (n=2;i+n<s.nsub && spectrogram_map(s,s.zrow[i+n])==k && (uintptr_t) s.zrow[i+n]-(uintptr_t) s.zrow[i+n-1]==d;n++);
+  *stride=(int) (d/sizeof(float));
+
+  return n;
+}
@@ -1,15 +1,116 @@
 #ifndef RFIO_H
 #define RFIO_H
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
 struct spectrogram {
-  int nsub,nchan,msub,isub;
+  int nsub,nchan,msub;
+  int isub,jsub;               // File of the first subint, and its subint in that file
   double *mjd;
   double freq,samp_rate;
   float *length;
   float *z,*zavg,*zstd;
+  float **zrow;
   float zmin,zmax;
   char nfd0[32];
+  int nmap;
+  void **map;
+  size_t *mapsize;
 };
+
+// Power of subint i in channel j. Subints are stored time-major, one
+// after another, and zrow points to the channels of each, so loops over
+// the channels of a subint run through contiguous memory. Spectrograms
+// that are copied live in z, those mapped straight from the files (nmap
+// files in map) have their subints spaced by the file headers; z then
+// only holds a row of zeros for subints beyond the end of the data, and
+// zavg and zstd are not computed.
+#define SPEC_Z(s,i,j) ((s).zrow[i][j])
+
+// Channels of subint i
+#define SPEC_ROW(s,i) ((s).zrow[i])
+
+// PGPLOT image transform of the time-major layout, passing a block of
+// subints as an array of stride by nsub: element (j,i) is drawn at subint
+// i and channel j
+#define SPEC_TR {-0.5,0.0,1.0,-0.5,1.0,0.0}
+
+// Index of a series of files, <prefix>.idx: a header, then a record per
+// subint, that of subint j of file i at position 1+i*nsub+j, so records
+// can be written in any order; records never written are zero.
+struct spectrogram_index {
+  int32_t file;                // File number
+  int32_t nchan;
+  int64_t offset;              // Position of the subint header (bytes)
+  double mjd;                  // Start of the subint
+  float length;                // Duration (s)
+  int32_t nbits;               // 32 for float power, 8 for bytes
+};
+
 struct spectrogram read_spectrogram(char *prefix,int isub,int nsub,double f0,double df0,int nbin,double foff);
+
+// Subints from mjd0 to mjd1, or nsub subints from mjd0 if mjd1 is 0,
+// found in the index, which is built if missing
+struct spectrogram read_spectrogram_mjd(char *prefix,double mjd0,double mjd1,int nsub,double f0,double df0,int nbin,double foff);
 void write_spectrogram(struct spectrogram s,char *prefix);
+
+// Threads decoding the files of spectrograms that are binned, zoomed or
+// 8 bit, one file at a time each [0: one per processor]
+void set_spectrogram_threads(int nthreads);
 void free_spectrogram(struct spectrogram s);
+
+// Number of subints from subint i on whose channels are spaced by the
+// same stride (floats) in memory, so they can be drawn as one image
+int spectrogram_block(struct spectrogram s,int i,int *stride);
+
+// Streaming reader of a series of files, for processing any length of
+// data in constant memory. Blocks of up to nblock subints, binned and
+// zoomed as by read_spectrogram, are read into s, whose buffers are
+// reused for every block, while a thread reads the next file ahead.
+struct spectrogram_stream {
+  char prefix[128];
+  struct spectrogram s;        // Current block, s.nsub subints
+  int nblock,nbin;
+  long nleft;                  // Subints left to read [-1: up to the last file]
+  int nch,nbits,j0;            // Channels of the files, first one read
+  size_t size;                 // Bytes per subint in the files
+  int cur;                     // Buffer of the current file
+  int pos;                     // Next subint in the current file
+  int file[2];                 // File in each buffer, -1 if missing
+  int nfile[2];                // Whole subints in each buffer
+  char *data[2];
+  size_t alloc[2];
+  int prefetch;                // Whether thread is reading the next file
+  pthread_t thread;
+};
+
+// Open a stream of nsub subints from file isub [nsub 0: all files], in
+// blocks of nblock subints after binning by nbin; returns -1 on failure
+int open_spectrogram_stream(struct spectrogram_stream *r,char *prefix,int isub,int nsub,int nblock,double f0,double df0,int nbin,double foff);
+
+// Open a stream of the subints from mjd0 to mjd1, or of nsub subints from
+// mjd0 if mjd1 is 0, found in the index
+int open_spectrogram_stream_mjd(struct spectrogram_stream *r,char *prefix,double mjd0,double mjd1,int nsub,int nblock,double f0,double df0,int nbin,double foff);
+
+// Read the next block into r->s; returns its number of subints, 0 at the
+// end of the stream
+int read_spectrogram_stream(struct spectrogram_stream *r);
+void close_spectrogram_stream(struct spectrogram_stream *r);
+
+// Open the index of a series for writing, keeping the records of the
+// files before file isub; returns a descriptor, -1 on failure
+int open_index(char *prefix,int isub,int nsub);
+
+// Store the record of subint jsub of file r->file
+int write_index(int fd,int nsub,int jsub,struct spectrogram_index *r);
+
+// Index the files of a series from file isub on, reading their headers;
+// returns the number of subints indexed, -1 on failure
+long build_index(char *prefix,int isub);
+
+// Number of subints from mjd0 to mjd1 [mjd1 0: to the end], and the file
+// isub and subint jsub of the first, by binary search of the index;
+// -1 without an index
+long find_index(char *prefix,double mjd0,double mjd1,int *isub,int *jsub);
 #endif
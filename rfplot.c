@@ -8,6 +8,7 @@
 #include "rftime.h"
 #include "rfio.h"
 #include "rftrace.h"
+#include "rfimage.h"
 
 #define LIM 128
 #define NMAX 64
@@ -24,7 +25,7 @@ struct data {
 
 void dec2sex(double x,char *s,int f,int len);
 void time_axis(double *mjd,int n,float xmin,float xmax,float ymin,float ymax);
-void bin_axis(int isub,int msub,float xmin,float xmax,float ymin,float ymax);
+void bin_axis(int isub,int jsub,int msub,float xmin,float xmax,float ymin,float ymax);
 void usage(void);
 void plot_traces(struct trace *t,int nsat,float fcen,float xmin,float xmax, int show_names);
 struct trace fit_trace(struct spectrogram s,struct select sel,int site_id,int graves);
@@ -42,7 +43,6 @@ float fit_gaussian_point(struct spectrogram s,float x,float y,struct select sel,
 int main(int argc,char *argv[])
 {
   struct spectrogram s;
-  float tr[]={-0.5,1.0,0.0,-0.5,0.0,1.0};
   float cool_l[]={-0.5,0.0,0.17,0.33,0.50,0.67,0.83,1.0,1.7};
   float cool_r[]={0.0,0.0,0.0,0.0,0.6,1.0,1.0,1.0,1.0};
   float cool_g[]={0.0,0.0,0.0,1.0,1.0,1.0,0.6,0.0,1.0};
@@ -71,7 +71,7 @@ int main(int argc,char *argv[])
   double fmin,fmax,fcen,f;
   FILE *file;
   int arg=0,nsub=3600,nbin=1;
-  double f0=0.0,df0=0.0;
+  double f0=0.0,df0=0.0,mjd0=0.0,mjd1=0.0;
   int foverlay=1;
   struct trace *t,tf;
   int nsat,satno,status;
@@ -106,7 +106,7 @@ int main(int argc,char *argv[])
   
   // Read arguments
   if (argc>1) {
-    while ((arg=getopt(argc,argv,"p:f:w:s:l:b:z:hc:C:gm:o:S:W:F:n"))!=-1) {
+    while ((arg=getopt(argc,argv,"p:f:w:s:l:b:z:hc:C:gm:o:S:W:F:nT:E:j:"))!=-1) {
       switch (arg) {
 	
       case 'p':
@@ -116,6 +116,18 @@ int main(int argc,char *argv[])
       case 's':
 	isub=atoi(optarg);
 	break;
+
+      case 'j':
+	set_spectrogram_threads(atoi(optarg));
+	break;
+
+      case 'T':
+	mjd0=nfd2mjd(optarg);
+	break;
+
+      case 'E':
+	mjd1=nfd2mjd(optarg);
+	break;
 	
       case 'l':
 	nsub=atoi(optarg);
@@ -191,13 +203,18 @@ int main(int argc,char *argv[])
   }
 
   // Read data
-  s=read_spectrogram(path,isub,nsub,f0,df0,nbin,foff);
+  if (mjd0>0.0)
+    s=read_spectrogram_mjd(path,mjd0,mjd1,nsub,f0,df0,nbin,foff);
+  else
+    s=read_spectrogram(path,isub,nsub,f0,df0,nbin,foff);
   
   printf("Read spectrogram\n%d channels, %d subints\nFrequency: %g MHz\nBandwidth: %g MHz\n",s.nchan,s.nsub,s.freq*1e-6,s.samp_rate*1e-6);
 
   // Exit on empty data
-  if (s.nsub==0)
-    return 0;
+  if (s.nsub==0) {
+    fprintf(stderr,"No subints to plot\n");
+    return 1;
+  }
   
   // Compute traces
   t=compute_trace(tlefile,s.mjd,s.nsub,site_id,s.freq*1e-6,s.samp_rate*1e-6,&nsat,graves,freqlist);
@@ -252,7 +269,7 @@ int main(int argc,char *argv[])
       cpgswin(xmin,xmax,ymin,ymax);
       
       if (cmap==3) {
-	cpggray(s.z,s.nsub,s.nchan,1,s.nsub,1,s.nchan,zmax,zmin,tr);
+	plot_spectrogram(s,zmax,zmin,1);
       } else {
 	if (cmap==0)
 	  cpgctab(cool_l,cool_r,cool_g,cool_b,9,1.0,0.5);
@@ -260,7 +277,7 @@ int main(int argc,char *argv[])
 	  cpgctab(heat_l,heat_r,heat_g,heat_b,9,1.0,0.5);
 	else if (cmap==2)
 	  cpgctab(viridis_l,viridis_r,viridis_g,viridis_b,256,1.0,0.5);
-	cpgimag(s.z,s.nsub,s.nchan,1,s.nsub,1,s.nchan,zmin,zmax,tr);
+	plot_spectrogram(s,zmin,zmax,0);
       }
 
       // Pixel axis
@@ -269,7 +286,7 @@ int main(int argc,char *argv[])
 	cpgbox("CTSM1",0.,0,"CTSM1",0.,0);
       } else { 
 	cpgbox("C",0.,0,"CTSM1",0.,0);
-	bin_axis(s.isub,s.msub,xmin,xmax,ymin,ymax);
+	bin_axis(s.isub,s.jsub,s.msub,xmin,xmax,ymin,ymax);
       }
       
       // Time axis
@@ -566,8 +583,8 @@ int main(int argc,char *argv[])
 	zzmax=0.0;
 	jmax=0;
 	for (j=j0;j<j1;j++) {
-	  if (s.z[i+s.nsub*j]>zzmax) {
-	    zzmax=s.z[i+s.nsub*j];
+	  if (SPEC_Z(s,i,j)>zzmax) {
+	    zzmax=SPEC_Z(s,i,j);
 	    jmax=j;
 	  }
 	}
@@ -591,8 +608,8 @@ int main(int argc,char *argv[])
 	zzmax=0.0;
 	jmax=0;
 	for (j=j0;j<j1;j++) {
-	  if (s.z[i+s.nsub*j]>zzmax) {
-	    zzmax=s.z[i+s.nsub*j];
+	  if (SPEC_Z(s,i,j)>zzmax) {
+	    zzmax=SPEC_Z(s,i,j);
 	    jmax=j;
 	  }
 	}
@@ -614,10 +631,10 @@ int main(int argc,char *argv[])
       f=s.freq-0.5*s.samp_rate+(double) j*s.samp_rate/(double) s.nchan;
       if (s.mjd[i]>1.0) {
 	if (graves==0)
-	  fprintf(file,"%lf %lf %f %d\n",s.mjd[i],f,s.z[i+s.nsub*j],site_id);
+	  fprintf(file,"%lf %lf %f %d\n",s.mjd[i],f,SPEC_Z(s,i,j),site_id);
 	else 
-	  fprintf(file,"%lf %lf %f %d 9999\n",s.mjd[i],f,s.z[i+s.nsub*j],site_id);
-	printf("%lf %lf %f %d\n",s.mjd[i],f,s.z[i+s.nsub*j],site_id);
+	  fprintf(file,"%lf %lf %f %d 9999\n",s.mjd[i],f,SPEC_Z(s,i,j),site_id);
+	printf("%lf %lf %f %d\n",s.mjd[i],f,SPEC_Z(s,i,j),site_id);
       }
       fclose(file);
     }
@@ -633,10 +650,10 @@ int main(int argc,char *argv[])
       f=s.freq-0.5*s.samp_rate+(double) yfit*s.samp_rate/(double) s.nchan;
       if (s.mjd[i]>1.0) {
 	if (graves==0)
-	  fprintf(file,"%lf %lf %f %d\n",s.mjd[i],f,s.z[i+s.nsub*j],site_id);
+	  fprintf(file,"%lf %lf %f %d\n",s.mjd[i],f,SPEC_Z(s,i,j),site_id);
 	else 
-	  fprintf(file,"%lf %lf %f %d 9999\n",s.mjd[i],f,s.z[i+s.nsub*j],site_id);
-	printf("%lf %lf %f %d\n",s.mjd[i],f,s.z[i+s.nsub*j],site_id);
+	  fprintf(file,"%lf %lf %f %d 9999\n",s.mjd[i],f,SPEC_Z(s,i,j),site_id);
+	printf("%lf %lf %f %d\n",s.mjd[i],f,SPEC_Z(s,i,j),site_id);
       }
       fclose(file);
     }
@@ -671,7 +688,7 @@ int main(int argc,char *argv[])
 	s2=0.0;
 	sn=0;
 	for (j=j0;j<j1;j++) {
-	  z=s.z[i+s.nsub*j];
+	  z=SPEC_Z(s,i,j);
 	  if (z>zzmax) {
 	    zzmax=z;
 	    jmax=j;
@@ -885,11 +902,7 @@ int main(int argc,char *argv[])
   cpgend();
 
   // Free
-  free(s.z);
-  free(s.zavg);
-  free(s.zstd);
-  free(s.mjd);
-  free(s.length);
+  free_spectrogram(s);
   if (tf.n>0) {
     free(tf.mjd);
     free(tf.freq);
@@ -1033,7 +1046,10 @@ void usage(void)
   printf("-p <path>     Input path to file /a/b/c_??????.bin\n");
   printf("-s <start>    Number of starting .bin file [0]\n");
   printf("-l <length>   Number of subintegrations to plot [3600]\n");
+  printf("-T <start>    Start time (YYYY-MM-DDTHH:MM:SS.sss) instead of -s, found in <path>.idx\n");
+  printf("-E <end>      End time instead of -l\n");
   printf("-b <nbin>     Number of subintegrations to bin [1]\n");
+  printf("-j <threads>  Threads loading the files when binning or zooming [one per processor]\n");
   printf("-z <zmax>     Image scaling upper limit [8.0]\n");
   printf("-f <freq>     Frequency to zoom into (Hz)\n");
   printf("-w <bw>       Bandwidth to zoom into (Hz)\n");
@@ -1146,7 +1162,7 @@ struct trace fit_trace(struct spectrogram s,struct select sel,int site_id,int gr
       s2=0.0;
       sn=0;
       for (j=j0;j<j1;j++) {
-	z=s.z[i+s.nsub*j];
+	z=SPEC_Z(s,i,j);
 	s1+=z;
 	s2+=z*z;
 	sn++;
@@ -1231,7 +1247,7 @@ struct trace fit_gaussian_trace(struct spectrogram s,struct select sel,int site_
       // Loop over points
       for (j=j0,l=0;j<j1;j++,l++) {
 	gd.x[l] = (double) j;
-	gd.y[l] = (double) s.z[i+s.nsub*j];
+	gd.y[l] = (double) SPEC_Z(s,i,j);
       }
       gd.n = l;
 
@@ -1373,7 +1389,7 @@ struct trace locate_trace(struct spectrogram s,struct trace t,int site_id,float
     s2=0.0;
     sn=0;
     for (j=j0;j<j1;j++) {
-      z=s.z[i+s.nsub*j];
+      z=SPEC_Z(s,i,j);
       s1+=z;
       s2+=z*z;
       sn++;
@@ -1440,7 +1456,7 @@ void filter(struct spectrogram s,int site_id,float sigma,int graves)
       // Find average
       for (j=0,s1=s2=0.0;j<s.nchan;j++) {
 	if (mask[j]==1) {
-	  s1+=s.z[i+s.nsub*j];
+	  s1+=SPEC_Z(s,i,j);
 	  s2+=1.0;
 	}
       }
@@ -1449,7 +1465,7 @@ void filter(struct spectrogram s,int site_id,float sigma,int graves)
       // Find standard deviation
       for (j=0,s1=s2=0.0;j<s.nchan;j++) {
 	if (mask[j]==1) {
-	  dz=s.z[i+s.nsub*j]-avg;
+	  dz=SPEC_Z(s,i,j)-avg;
 	  s1+=dz*dz;
 	  s2+=1.0;
 	}
@@ -1458,7 +1474,7 @@ void filter(struct spectrogram s,int site_id,float sigma,int graves)
 
       // Update mask
       for (j=0,l=0;j<s.nchan;j++) {
-	if (fabs(s.z[i+s.nsub*j]-avg)>sigma*std) {
+	if (fabs(SPEC_Z(s,i,j)-avg)>sigma*std) {
 	  mask[j]=0;
 	  l++;
 	}
@@ -1466,7 +1482,7 @@ void filter(struct spectrogram s,int site_id,float sigma,int graves)
     }
     // Reset mask
     for (j=0;j<s.nchan;j++) {
-      if (s.z[i+s.nsub*j]-avg>sigma*std) 
+      if (SPEC_Z(s,i,j)-avg>sigma*std) 
 	mask[j]=1;
       else
 	mask[j]=0;
@@ -1475,13 +1491,13 @@ void filter(struct spectrogram s,int site_id,float sigma,int graves)
     // Find maximum when points are adjacent
     for (j=0;j<s.nchan-1;j++) {
       if (mask[j]==1 && mask[j+1]==1) {
-	if (s.z[i+s.nsub*j]<s.z[i+s.nsub*(j+1)])
+	if (SPEC_Z(s,i,j)<SPEC_Z(s,i,j+1))
 	  mask[j]=0;
       }
     }
     for (j=s.nchan-2;j>=0;j--) {
       if (mask[j]==1 && mask[j-1]==1) {
-	if (s.z[i+s.nsub*j]<s.z[i+s.nsub*(j-1)])
+	if (SPEC_Z(s,i,j)<SPEC_Z(s,i,j-1))
 	  mask[j]=0;
       }
     }
@@ -1492,9 +1508,9 @@ void filter(struct spectrogram s,int site_id,float sigma,int graves)
 	f=s.freq-0.5*s.samp_rate+(double) j*s.samp_rate/(double) s.nchan;
 	if (s.mjd[i]>1.0) {
 	  if (graves==0)
-	    fprintf(file,"%lf %lf %f %d\n",s.mjd[i],f,s.z[i+s.nsub*j],site_id);
+	    fprintf(file,"%lf %lf %f %d\n",s.mjd[i],f,SPEC_Z(s,i,j),site_id);
 	  else
-	    fprintf(file,"%lf %lf %f %d 9999 %d %d\n",s.mjd[i],f,s.z[i+s.nsub*j],site_id,i,j);
+	    fprintf(file,"%lf %lf %f %d 9999 %d %d\n",s.mjd[i],f,SPEC_Z(s,i,j),site_id,i,j);
 	}
 	cpgpt1((float) i+0.5,(float) j+0.5,17);
       }
@@ -1539,7 +1555,7 @@ void peakfind(struct spectrogram s,int site_id,int i0,int i1,int j0,int j1)
 
     // Fill array
     for (j=0;j<n;j++)
-      y[j]=s.z[i+s.nsub*(j0+j)];
+      y[j]=SPEC_Z(s,i,j0+j);
 
     // Convolve
     convolve(y,n,w,m,sy);
@@ -1561,7 +1577,7 @@ void peakfind(struct spectrogram s,int site_id,int i0,int i1,int j0,int j1)
 	x0=(float) (j+j0)+b[j]/(b[j]-b[j+1]);
 	f=s.freq-0.5*s.samp_rate+(double) x0*s.samp_rate/(double) s.nchan;
 	if (s.mjd[i]>1.0)
-	  fprintf(file,"%lf %lf %f %d\n",s.mjd[i],f,s.z[i+s.nsub*j],site_id);
+	  fprintf(file,"%lf %lf %f %d\n",s.mjd[i],f,SPEC_Z(s,i,j),site_id);
 	cpgpt1((float) i+0.5,x0+0.5,17);
       }
     }
@@ -1629,7 +1645,7 @@ float fit_gaussian_point(struct spectrogram s,float x,float y,struct select sel,
   // Loop over points
   for (j=j0,l=0;j<j1;j++,l++) {
     gd.x[l] = (double) j;
-    gd.y[l] = (double) s.z[i+s.nsub*j];
+    gd.y[l] = (double) SPEC_Z(s,i,j);
   }
   gd.n = l;
 
@@ -1649,16 +1665,17 @@ float fit_gaussian_point(struct spectrogram s,float x,float y,struct select sel,
   return a[0];
 }
 
-// Plot horizontal axis in bin file steps
-void bin_axis(int isub,int msub,float xmin,float xmax,float ymin,float ymax)
+// Plot horizontal axis in bin file steps, for a plot starting at subint
+// jsub of file isub
+void bin_axis(int isub,int jsub,int msub,float xmin,float xmax,float ymin,float ymax)
 {
   int i,imin,imax,di,istep;
   float x;
   char s[16];
 
   // Get tickmark settings
-  imin=(int) ceil(xmin/msub);
-  imax=(int) floor(xmax/msub);
+  imin=(int) ceil((xmin+jsub)/msub);
+  imax=(int) floor((xmax+jsub)/msub);
   di=imax-imin;
   istep=(int) floor(di/6);
   if (istep==0)
@@ -1666,7 +1683,7 @@ void bin_axis(int isub,int msub,float xmin,float xmax,float ymin,float ymax)
 
   // Add ticks
   for (i=imin;i<imax;i+=istep) {
-    x=i*msub;
+    x=i*msub-jsub;
     sprintf(s,"%d",isub+i);
     cpgtick(xmin,ymax,xmax,ymax,(x-xmin)/(xmax-xmin),0.5,0.5,-0.6,0.0,s);
   }
@@ -7,6 +7,7 @@
 #include "rftime.h"
 #include "rfio.h"
 #include "rftrace.h"
+#include "rfimage.h"
 
 #define LIM 128
 #define NMAX 64
@@ -29,7 +30,6 @@ void filter(struct spectrogram s,int site_id,float sigma,char *filename,int grav
 int main(int argc,char *argv[])
 {
   struct spectrogram s;
-  float tr[]={-0.5,1.0,0.0,-0.5,0.0,1.0};
   float cool_l[]={-0.5,0.0,0.17,0.33,0.50,0.67,0.83,1.0,1.7};
   float cool_r[]={0.0,0.0,0.0,0.0,0.6,1.0,1.0,1.0,1.0};
   float cool_g[]={0.0,0.0,0.0,1.0,1.0,1.0,0.6,0.0,1.0};
@@ -56,7 +56,7 @@ int main(int argc,char *argv[])
   double fmin,fmax,fcen,f;
   FILE *file;
   int arg=0,nsub=1800,nbin=1;
-  double f0=0.0,df0=0.0,dy=2500;
+  double f0=0.0,df0=0.0,dy=2500,mjd0=0.0,mjd1=0.0;
   int foverlay=1;
   struct trace *t,tf;
   int nsat,satno;
@@ -82,7 +82,7 @@ int main(int argc,char *argv[])
 
   // Read arguments
   if (argc>1) {
-    while ((arg=getopt(argc,argv,"p:f:w:s:l:b:z:hc:C:m:gS:qo:O:F:W:A:"))!=-1) {
+    while ((arg=getopt(argc,argv,"p:f:w:s:l:b:z:hc:C:m:gS:qo:O:F:W:A:T:E:j:"))!=-1) {
       switch (arg) {
 	
       case 'p':
@@ -101,6 +101,18 @@ int main(int argc,char *argv[])
       case 's':
 	isub=atoi(optarg);
 	break;
+
+      case 'j':
+	set_spectrogram_threads(atoi(optarg));
+	break;
+
+      case 'T':
+	mjd0=nfd2mjd(optarg);
+	break;
+
+      case 'E':
+	mjd1=nfd2mjd(optarg);
+	break;
 	
       case 'f':
 	f0=(double) atof(optarg);
@@ -171,7 +183,16 @@ int main(int argc,char *argv[])
   }
 
   // Read data
-  s=read_spectrogram(path,isub,nsub,f0,df0,nbin,foff);
+  if (mjd0>0.0)
+    s=read_spectrogram_mjd(path,mjd0,mjd1,nsub,f0,df0,nbin,foff);
+  else
+    s=read_spectrogram(path,isub,nsub,f0,df0,nbin,foff);
+
+  // Exit on empty data
+  if (s.nsub==0) {
+    fprintf(stderr,"No subints to plot\n");
+    return 1;
+  }
   if (s.mjd[0]<54000)
     return 0;
 
@@ -207,7 +228,7 @@ int main(int argc,char *argv[])
   cpgswin(xmin,xmax,ymin,ymax);
   
   if (cmap==3) {
-    cpggray(s.z,s.nsub,s.nchan,1,s.nsub,1,s.nchan,zmax,zmin,tr);
+    plot_spectrogram(s,zmax,zmin,1);
   } else {
     if (cmap==0)
       cpgctab(cool_l,cool_r,cool_g,cool_b,9,1.0,0.5);
@@ -215,10 +236,10 @@ int main(int argc,char *argv[])
       cpgctab(heat_l,heat_r,heat_g,heat_b,9,1.0,0.5);
     else if (cmap==2)
       cpgctab(viridis_l,viridis_r,viridis_g,viridis_b,256,1.0,0.5);
-    cpgimag(s.z,s.nsub,s.nchan,1,s.nsub,1,s.nchan,zmin,zmax,tr);
+    plot_spectrogram(s,zmin,zmax,0);
   }
     
-  cpgimag(s.z,s.nsub,s.nchan,1,s.nsub,1,s.nchan,zmin,zmax,tr);
+  plot_spectrogram(s,zmin,zmax,0);
     
   // Pixel axis
   cpgbox("CTSM1",0.,0,"CTSM1",0.,0);
@@ -266,8 +287,7 @@ int main(int argc,char *argv[])
   cpgend();
   
   // Free
-  free(s.z);
-  free(s.mjd);
+  free_spectrogram(s);
   
   for (i=0;i<nsat;i++) {
     free(t[i].mjd);
@@ -393,8 +413,11 @@ void usage(void)
   printf("-f <freq>     Frequency to zoom into (Hz)\n");
   printf("-w <bw>       Bandwidth to zoom into (Hz)\n");
   printf("-l <length>   Number of subintegrations to plot [3600]\n");
+  printf("-T <start>    Start time (YYYY-MM-DDTHH:MM:SS.sss) instead of -s, found in <path>.idx\n");
+  printf("-E <end>      End time instead of -l\n");
   printf("-F <freqlist> List with frequencies [$ST_DATADIR/data/frequencies.txt]\n");
   printf("-b <nbin>     Number of subintegrations to bin [1]\n");
+  printf("-j <threads>  Threads loading the files when binning or zooming [one per processor]\n");
   printf("-z <zmax>     Image scaling upper limit [8.0]\n");
   printf("-c <tlefile>  File with TLEs [$ST_DATADIR/data/bulk.tle]\n");
   printf("-g            Compute GRAVES reflections\n");
@@ -492,7 +515,7 @@ void filter(struct spectrogram s,int site_id,float sigma,char *filename,int grav
       // Find average
       for (j=0,s1=s2=0.0;j<s.nchan;j++) {
 	if (mask[j]==1) {
-	  s1+=s.z[i+s.nsub*j];
+	  s1+=SPEC_Z(s,i,j);
 	  s2+=1.0;
 	}
       }
@@ -501,7 +524,7 @@ void filter(struct spectrogram s,int site_id,float sigma,char *filename,int grav
       // Find standard deviation
       for (j=0,s1=s2=0.0;j<s.nchan;j++) {
 	if (mask[j]==1) {
-	  dz=s.z[i+s.nsub*j]-avg;
+	  dz=SPEC_Z(s,i,j)-avg;
 	  s1+=dz*dz;
 	  s2+=1.0;
 	}
@@ -510,7 +533,7 @@ void filter(struct spectrogram s,int site_id,float sigma,char *filename,int grav
 
       // Update mask
       for (j=0,l=0;j<s.nchan;j++) {
-	if (fabs(s.z[i+s.nsub*j]-avg)>sigma*std) {
+	if (fabs(SPEC_Z(s,i,j)-avg)>sigma*std) {
 	  mask[j]=0;
 	  l++;
 	}
@@ -518,7 +541,7 @@ void filter(struct spectrogram s,int site_id,float sigma,char *filename,int grav
     }
        // Reset mask
     for (j=0;j<s.nchan;j++) {
-      sig[j]=(s.z[i+s.nsub*j]-avg)/std;
+      sig[j]=(SPEC_Z(s,i,j)-avg)/std;
       if (sig[j]>sigma) 
 	mask[j]=1;
       else
@@ -528,13 +551,13 @@ void filter(struct spectrogram s,int site_id,float sigma,char *filename,int grav
     // Find maximum when points are adjacent
     for (j=0;j<s.nchan-1;j++) {
       if (mask[j]==1 && mask[j+1]==1) {
-	if (s.z[i+s.nsub*j]<s.z[i+s.nsub*(j+1)])
+	if (SPEC_Z(s,i,j)<SPEC_Z(s,i,j+1))
 	  mask[j]=0;
       }
     }
     for (j=s.nchan-2;j>=0;j--) {
       if (mask[j]==1 && mask[j-1]==1) {
-	if (s.z[i+s.nsub*j]<s.z[i+s.nsub*(j-1)])
+	if (SPEC_Z(s,i,j)<SPEC_Z(s,i,j-1))
 	  mask[j]=0;
       }
     }
@@ -0,0 +1,131 @@
+// Benchmark of loading a spectrogram with read_spectrogram and of a pass
+// over the channels of every subint, as done by the filters of rffind and
+// rfplot, of the same pass over a stream of blocks of a file each, and of
+// loading a binned spectrogram on one and on all processors.
+// Usage: tests/bench_rfio [nchan [nsub]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "../rfio.h"
+
+// Subints per file, as written by rffft
+#define NSUB 60
+
+static double seconds(void) {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + 1e-6 * tv.tv_usec;
+}
+
+// Sigma clipped mean and deviation of every subint
+static float filter_pass(struct spectrogram s) {
+  int i, j, k;
+  float s1, s2, avg = 0.0, std = 0.0, dz, sum = 0.0;
+
+  for (i = 0; i < s.nsub; i++) {
+    avg = 0.0;
+    std = INFINITY;
+    for (k = 0; k < 3; k++) {
+      for (j = 0, s1 = s2 = 0.0; j < s.nchan; j++) {
+        if (fabs(SPEC_Z(s, i, j) - avg) <= 3.0 * std) {
+          s1 += SPEC_Z(s, i, j);
+          s2 += 1.0;
+        }
+      }
+      avg = s1 / s2;
+      for (j = 0, s1 = s2 = 0.0; j < s.nchan; j++) {
+        dz = SPEC_Z(s, i, j) - avg;
+        s1 += dz * dz;
+        s2 += 1.0;
+      }
+      std = sqrt(s1 / s2);
+    }
+    sum += avg + std;
+  }
+
+  return sum;
+}
+
+int main(int argc, char * argv[]) {
+  int i, j, k, nchan = 40000, nsub = 3600;
+  char dir[] = "/tmp/bench_rfioXXXXXX", prefix[64], filename[96], header[256];
+  float * z, sum;
+  struct spectrogram s;
+  struct spectrogram_stream r;
+  double t0, t1, t2;
+  FILE * file;
+  struct rusage ru;
+
+  if (argc > 1)
+    nchan = atoi(argv[1]);
+  if (argc > 2)
+    nsub = atoi(argv[2]);
+  if (mkdtemp(dir) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+  sprintf(prefix, "%s/bench", dir);
+
+  // Spectrogram of noise
+  z = (float *) malloc(sizeof(float) * nchan);
+  for (k = 0; k * NSUB < nsub; k++) {
+    sprintf(filename, "%s_%06d.bin", prefix, k);
+    file = fopen(filename, "w");
+    for (i = k * NSUB; i < (k + 1) * NSUB && i < nsub; i++) {
+      memset(header, 0, sizeof(header));
+      sprintf(header, "HEADER\nUTC_START    2024-01-01T00:%02d:%02d.000\nFREQ         100000000.000000 Hz\nBW           2000000.000000 Hz\nLENGTH       1.000000 s\nNCHAN        %d\nNSUB         %d\nEND\n", i / 60 % 60, i % 60, nchan, NSUB);
+      for (j = 0; j < nchan; j++)
+        z[j] = 1.0 + (float) rand() / RAND_MAX;
+      fwrite(header, 1, sizeof(header), file);
+      fwrite(z, sizeof(float), nchan, file);
+    }
+    fclose(file);
+  }
+  free(z);
+
+  // Streamed first, the resident size being the maximum so far
+  t0 = seconds();
+  sum = 0.0;
+  open_spectrogram_stream(&r, prefix, 0, nsub, NSUB, 0.0, 0.0, 1, 0.0);
+  while (read_spectrogram_stream(&r) > 0)
+    sum += filter_pass(r.s);
+  close_spectrogram_stream(&r);
+  t1 = seconds();
+  getrusage(RUSAGE_SELF, &ru);
+  printf("Stream and filter pass: %.3f s, %.1f MB resident (%g)\n", t1 - t0, ru.ru_maxrss / 1024.0, sum);
+
+  t0 = seconds();
+  s = read_spectrogram(prefix, 0, nsub, 0.0, 0.0, 1, 0.0);
+  t1 = seconds();
+  getrusage(RUSAGE_SELF, &ru);
+  sum = filter_pass(s);
+  t2 = seconds();
+
+  printf("Spectrogram: %d channels, %d subints\n", s.nchan, s.nsub);
+  printf("Load: %.3f s, %.1f MB resident\n", t1 - t0, ru.ru_maxrss / 1024.0);
+  printf("Filter pass: %.3f s (%g)\n", t2 - t1, sum);
+  free_spectrogram(s);
+
+  // Copied, binned by two, on one thread and on one per processor
+  for (k = 1; k >= 0; k--) {
+    set_spectrogram_threads(k);
+    t0 = seconds();
+    s = read_spectrogram(prefix, 0, nsub, 0.0, 0.0, 2, 0.0);
+    t1 = seconds();
+    printf("Binned load, %s: %.3f s\n", (k == 1) ? "1 thread" : "all threads", t1 - t0);
+    free_spectrogram(s);
+  }
+  for (k = 0; k * NSUB < nsub; k++) {
+    sprintf(filename, "%s_%06d.bin", prefix, k);
+    unlink(filename);
+  }
+  rmdir(dir);
+
+  return 0;
+}
@@ -1,5 +1,6 @@
 #include "tests_rffft_internal.h"
 #include "tests_rftles.h"
+#include "tests_rfio.h"
 
 #include <stdarg.h>
 #include <stddef.h>
@@ -12,6 +13,7 @@ int main(void) {
 
   failures += run_rffft_internal_tests();
   failures += run_tle_tests();
+  failures += run_rfio_tests();
 
   return failures;
 }
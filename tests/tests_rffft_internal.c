@@ -4,9 +4,22 @@
 #include <stddef.h>
 #include <setjmp.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
 #include <cmocka.h>
 
 #include "../rffft_internal.h"
+#include "../rffft_ddc.h"
+#include "../rffft_shm.h"
+#include "../rffft_net.h"
+#include "../rffft_pipeline.h"
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <pthread.h>
 
 // Tests
 
@@ -51,6 +64,11 @@ void rffft_internal_parse_satdump_filenames(void **state) {
   assert_memory_equal(&ref_format, &format, 1);
   assert_string_equal("2023-08-07T16:36:47.749", starttime);
 
+  // compressed file
+  ref_format = 'z';
+  assert_int_equal(0, rffft_params_from_filename("2023-08-05_08-02-00_16000000SPS_2274000000Hz.ziq", &samplerate, &frequency, &format, starttime));
+  assert_memory_equal(&ref_format, &format, 1);
+
   assert_int_equal(-1, rffft_params_from_filename("2023-08-05-19:59:30_16000000SPS_402000000Hz.f32", &samplerate, &frequency, &format, starttime));
 }
 
@@ -92,12 +110,585 @@ void rffft_internal_parse_sdrconsole_filenames(void **state) {
   assert_int_equal(-1, rffft_params_from_filename("07-Yol-2023 181711.798 401.774MHz.wav", &samplerate, &frequency, &format, starttime));
 }
 
+// Test sample unpacking, squaring and power accumulation
+void rffft_internal_unpack_and_accumulate(void **state) {
+  int16_t ibuf[8] = {16384, -16384, 0, 32767, -32768, 0, 8192, 8192};
+  char cbuf[8] = {64, -64, 0, 127, -128, 0, 32, 32};
+  unsigned char pbuf[6] = {0x00, 0xF8, 0x7F, 0x01, 0xF0, 0xFF};
+  float zw[4] = {1.0, 0.5, 0.5, 1.0};
+  float c[8], d[8] = {1.0, 0.0, 0.0, 2.0, 3.0, 0.0, 0.0, 4.0};
+  float z[4] = {0.0, 0.0, 0.0, 0.0};
+  float zs[16];
+  int i;
+
+  assert_int_equal(2, rffft_sample_size('c'));
+  assert_int_equal(2, rffft_sample_size('u'));
+  assert_int_equal(3, rffft_sample_size('p'));
+  assert_int_equal(4, rffft_sample_size('i'));
+  assert_int_equal(8, rffft_sample_size('f'));
+  assert_int_equal(8, rffft_sample_size('w'));
+  assert_int_equal(0, rffft_sample_size('x'));
+
+  // int16 with inverted frequencies
+  rffft_unpack('i', ibuf, 4, zw, -1, 0, c);
+  assert_float_equal(0.5, c[0], 1e-6);
+  assert_float_equal(0.5, c[1], 1e-6);
+  assert_float_equal(0.0, c[2], 1e-6);
+  assert_float_equal(-0.5, c[3], 1e-4);
+  assert_float_equal(-0.5, c[4], 1e-6);
+  assert_float_equal(0.25, c[6], 1e-6);
+  assert_float_equal(-0.25, c[7], 1e-6);
+
+  // Packed 12 bit, (-2048, 2047), (1, -1)
+  rffft_unpack('p', pbuf, 2, zw, 1, 0, c);
+  assert_float_equal(-1.0, c[0], 1e-6);
+  assert_float_equal(2047.0 / 2048.0, c[1], 1e-6);
+  assert_float_equal(0.5 / 2048.0, c[2], 1e-6);
+  assert_float_equal(-0.5 / 2048.0, c[3], 1e-6);
+
+  // char
+  rffft_unpack('c', cbuf, 4, zw, 1, 0, c);
+  assert_float_equal(0.25, c[0], 1e-6);
+  assert_float_equal(-0.25, c[1], 1e-6);
+  assert_float_equal(-0.25, c[4], 1e-6);
+
+  // (0.25-0.25i)^2 = -0.125i
+  rffft_square(c, 1);
+  assert_float_equal(0.0, c[0], 1e-6);
+  assert_float_equal(-0.125, c[1], 1e-6);
+
+  // Power with swapped halves
+  rffft_accumulate(d, 4, z);
+  rffft_accumulate(d, 4, z);
+  assert_float_equal(18.0, z[0], 1e-6);
+  assert_float_equal(32.0, z[1], 1e-6);
+  assert_float_equal(2.0, z[2], 1e-6);
+  assert_float_equal(8.0, z[3], 1e-6);
+
+  // Peak, minimum and squared power, with powers 9, 16, 1, 4 and then 4 times those
+  for (i = 0; i < 16; i++)
+    zs[i] = (i >= 8 && i < 12) ? HUGE_VALF : 0.0;
+  rffft_accumulate_stats(d, 4, zs);
+  for (i = 0; i < 8; i++)
+    d[i] *= 2.0;
+  rffft_accumulate_stats(d, 4, zs);
+  assert_float_equal(45.0, zs[0], 1e-6);
+  assert_float_equal(36.0, zs[4], 1e-6);
+  assert_float_equal(9.0, zs[8], 1e-6);
+  assert_float_equal(81.0 + 1296.0, zs[12], 1e-3);
+  assert_float_equal(16.0, zs[9], 1e-6);
+  assert_float_equal(256.0 + 4096.0, zs[13], 1e-3);
+}
+
+// Test that the vectorized unpack kernels match the scalar kernel exactly
+void rffft_internal_unpack_simd(void **state) {
+  const char formats[] = {'c', 'u', 'p', 'i', 'f', 'w'};
+  int nsamp = 37, level, nsquare, sign, i, j;
+  char raw[37 * 8];
+  float fbuf[2 * 37], zw[37], ref[2 * 37], c[2 * 37];
+  const void * buffer;
+
+  // Samples covering the full range of the integer formats
+  for (i = 0; i < (int) sizeof(raw); i++)
+    raw[i] = (char) (i * 73 + 19);
+  for (i = 0; i < nsamp; i++) {
+    fbuf[2 * i] = 0.01 * (i - 18);
+    fbuf[2 * i + 1] = 0.003 * (i * i % 29) - 0.04;
+    zw[i] = 0.54 - 0.46 * cos(2.0 * M_PI * i / (nsamp - 1));
+  }
+
+  for (j = 0; j < 6; j++) {
+    buffer = (formats[j] == 'f') ? (const void *) fbuf : (const void *) raw;
+    for (nsquare = 0; nsquare <= 2; nsquare++) {
+      for (sign = -1; sign <= 1; sign += 2) {
+        rffft_unpack_simd(RFFFT_SIMD_NONE, formats[j], buffer, nsamp, zw, sign, nsquare, ref);
+        for (level = RFFFT_SIMD_SSE2; level <= rffft_simd_level(); level++) {
+          rffft_unpack_simd(level, formats[j], buffer, nsamp, zw, sign, nsquare, c);
+          assert_memory_equal(ref, c, sizeof(ref));
+        }
+      }
+    }
+  }
+}
+
+// Test the polyphase filterbank prototype and folding
+void rffft_internal_pfb(void **state) {
+  int nchan = 8, ntap = 4, i;
+  float h[32], x[64], c[16];
+  double sum = 0.0, gain = 0.0;
+
+  rffft_pfb_coefficients(nchan, ntap, h);
+
+  // Symmetric, peaked in the middle, with the DC gain of the Hamming window
+  for (i = 0; i < nchan * ntap; i++) {
+    assert_float_equal(h[i], h[nchan * ntap - 1 - i], 1e-6);
+    assert_true(h[i] <= h[15]);
+    sum += h[i];
+  }
+  for (i = 0; i < nchan; i++)
+    gain += 0.54 - 0.46 * cos(2.0 * M_PI * i / (nchan - 1));
+  assert_float_equal(gain, sum, 1e-4);
+
+  // A constant input folds to the sum of the taps of each channel
+  for (i = 0; i < 2 * nchan * ntap; i++)
+    x[i] = (i % 2 == 0) ? 1.0 : -2.0;
+  rffft_pfb(x, h, nchan, ntap, c);
+  for (i = 0; i < nchan; i++) {
+    sum = h[i] + h[i + nchan] + h[i + 2 * nchan] + h[i + 3 * nchan];
+    assert_float_equal(sum, c[2 * i], 1e-6);
+    assert_float_equal(-2.0 * sum, c[2 * i + 1], 1e-6);
+  }
+}
+
+// Test the impulse blanker: samples above the threshold are zeroed or
+// clipped, the others are summed and left alone
+void rffft_internal_blank(void **state) {
+  float x[2 * 19], y[2 * 19], w2[19], sum, wsum, ref, wref;
+  int i, n, nref, level;
+
+  for (i = 0; i < 19; i++) {
+    x[2 * i] = (i % 2 == 0) ? 1.0 : -1.0;
+    x[2 * i + 1] = 0.0;
+    w2[i] = 1.0;
+  }
+  x[6] = 6.0;
+  x[6 + 1] = 8.0;
+  x[2 * 17 + 1] = 4.0;
+  memcpy(y, x, sizeof(x));
+
+  // Nothing above the threshold
+  assert_int_equal(0, rffft_blank(x, w2, 19, 200.0, 0, &sum, &wsum));
+  assert_float_equal(17.0 + 100.0 + 17.0, sum, 1e-4);
+  assert_float_equal(19.0, wsum, 1e-4);
+  assert_memory_equal(x, y, sizeof(x));
+
+  // Read-only count, then zero samples 3 and 17
+  assert_int_equal(2, rffft_count_above(x, w2, 19, 4.0, &sum, &wsum));
+  assert_float_equal(17.0, sum, 1e-4);
+  assert_float_equal(17.0, wsum, 1e-4);
+  assert_memory_equal(x, y, sizeof(x));
+  assert_int_equal(2, rffft_blank(x, w2, 19, 4.0, 0, &sum, &wsum));
+  for (i = 0; i < 19; i++) {
+    if (i == 3 || i == 17) {
+      assert_float_equal(0.0, x[2 * i], 0.0);
+      assert_float_equal(0.0, x[2 * i + 1], 0.0);
+    } else {
+      assert_float_equal(y[2 * i], x[2 * i], 0.0);
+    }
+  }
+
+  // Clip to an amplitude of 2, keeping the phase
+  memcpy(x, y, sizeof(x));
+  assert_int_equal(2, rffft_blank(x, w2, 19, 4.0, 1, &sum, &wsum));
+  assert_float_equal(1.2, x[6], 1e-6);
+  assert_float_equal(1.6, x[7], 1e-6);
+  assert_float_equal(-2.0 / sqrt(17.0), x[2 * 17], 1e-6);
+  assert_float_equal(8.0 / sqrt(17.0), x[2 * 17 + 1], 1e-6);
+
+  // Windowed samples, compared before windowing: sample 17 (power 17,
+  // windowed by 0.5) passes, and the estimate of the mean power is kept
+  memcpy(x, y, sizeof(x));
+  for (i = 0; i < 19; i++) {
+    w2[i] = (i % 2 == 0) ? 1.0 : 0.25;
+    x[2 * i] *= (i % 2 == 0) ? 1.0 : 0.5;
+    x[2 * i + 1] *= (i % 2 == 0) ? 1.0 : 0.5;
+  }
+  assert_int_equal(1, rffft_count_above(x, w2, 19, 20.0, &sum, &wsum));
+  assert_float_equal(10.0 + 7.0 * 0.25 + 17.0 * 0.25, sum, 1e-4);
+  assert_float_equal(10.0 + 8.0 * 0.25, wsum, 1e-4);
+
+  // The vectorized kernels match the scalar kernel exactly
+  for (i = 0; i < 2 * 19; i++)
+    x[i] = 0.1 * ((i * 37) % 23) - 1.0;
+  for (level = RFFFT_SIMD_NONE; level <= rffft_simd_level(); level++) {
+    for (n = 0; n <= 19; n += 3) {
+      nref = rffft_count_above_simd(RFFFT_SIMD_NONE, x, w2, n, 2.0, &ref, &wref);
+      assert_int_equal(nref, rffft_count_above_simd(level, x, w2, n, 2.0, &sum, &wsum));
+      assert_memory_equal(&ref, &sum, sizeof(float));
+      assert_memory_equal(&wref, &wsum, sizeof(float));
+    }
+  }
+}
+
+// Test the down-converter: a tone at the mixing frequency ends up at zero
+// frequency with a gain of sqrt(ndec), a tone outside the band is rejected
+void rffft_internal_ddc(void **state) {
+  struct rffft_ddc ddc;
+  float x[2 * 320], y[2 * 40];
+  int i, j;
+
+  assert_int_equal(50, rffft_ddc_factor(20000, 400, 1));
+  assert_int_equal(40, rffft_ddc_factor(20000, 401, 1));
+  assert_int_equal(2, rffft_ddc_factor(100, 30, 1));
+  assert_int_equal(1, rffft_ddc_factor(100, 60, 1));
+  assert_int_equal(1, rffft_ddc_factor(12, 5, 4));
+
+  for (j = 0; j < 2; j++) {
+    // Tone at 1/8 of the sample rate, or 0.3 above it
+    for (i = 0; i < 320; i++) {
+      x[2 * i] = cos(2.0 * M_PI * (0.125 + 0.3 * j) * i);
+      x[2 * i + 1] = sin(2.0 * M_PI * (0.125 + 0.3 * j) * i);
+    }
+
+    // Decimate by 8 in two calls, to cover the history between them
+    rffft_ddc_init(&ddc, 8, 8, 64, 'f', 1, 0);
+    rffft_ddc_process(&ddc, x, 16, y);
+    rffft_ddc_process(&ddc, x + 2 * 128, 24, y + 2 * 16);
+    rffft_ddc_free(&ddc);
+
+    // Skip the filter transient
+    for (i = 16; i < 40; i++) {
+      assert_float_equal((j == 0) ? sqrt(8.0) : 0.0, y[2 * i], 1e-3);
+      assert_float_equal(0.0, y[2 * i + 1], 1e-3);
+    }
+  }
+}
+
+// Test parsing of RIFF and RF64 WAV headers
+void rffft_internal_wav_header(void **state) {
+  // 16 bit PCM, with a LIST chunk of odd length before the samples
+  const unsigned char riff[] = {
+    'R', 'I', 'F', 'F', 54, 0, 0, 0, 'W', 'A', 'V', 'E',
+    'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 2, 0, 0x80, 0x3E, 0, 0, 0, 0xFA, 0, 0, 4, 0, 16, 0,
+    'L', 'I', 'S', 'T', 3, 0, 0, 0, 'a', 'b', 'c', 0,
+    'd', 'a', 't', 'a', 8, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8};
+  // Extensible 32 bit float RF64, with the data size in the ds64 chunk
+  const unsigned char rf64[] = {
+    'R', 'F', '6', '4', 0xFF, 0xFF, 0xFF, 0xFF, 'W', 'A', 'V', 'E',
+    'd', 's', '6', '4', 28, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    'f', 'm', 't', ' ', 40, 0, 0, 0, 0xFE, 0xFF, 2, 0, 0x40, 0x42, 0x0F, 0, 0, 0, 0, 0, 8, 0, 32, 0,
+    22, 0, 32, 0, 3, 0, 0, 0, 3, 0, 0, 0, 0, 0, 0x10, 0, 0x80, 0, 0, 0xAA, 0, 0x38, 0x9B, 0x71,
+    'd', 'a', 't', 'a', 0xFF, 0xFF, 0xFF, 0xFF};
+  struct rffft_wav wav;
+  FILE * file;
+
+  file = tmpfile();
+  fwrite(riff, 1, sizeof(riff), file);
+  rewind(file);
+  assert_int_equal(0, rffft_wav_header(file, &wav));
+  assert_int_equal('i', wav.format);
+  assert_int_equal(2, wav.nchannel);
+  assert_float_equal(16000, wav.samp_rate, 1e-12);
+  assert_int_equal(56, wav.offset);
+  assert_int_equal(8, wav.size);
+  assert_int_equal(1, fgetc(file));
+  fclose(file);
+
+  file = tmpfile();
+  fwrite(rf64, 1, sizeof(rf64), file);
+  rewind(file);
+  assert_int_equal(0, rffft_wav_header(file, &wav));
+  assert_int_equal('f', wav.format);
+  assert_float_equal(1e6, wav.samp_rate, 1e-12);
+  assert_int_equal(sizeof(rf64), wav.offset);
+  assert_int_equal(0x200000000LL, wav.size);
+  fclose(file);
+
+  // Not a WAV file
+  file = tmpfile();
+  fwrite(riff + 12, 1, sizeof(riff) - 12, file);
+  rewind(file);
+  assert_int_equal(-1, rffft_wav_header(file, &wav));
+  fclose(file);
+}
+
+// Test parsing of SatDump .ziq headers
+void rffft_internal_ziq_header(void **state) {
+  const unsigned char header[] = {
+    'Z', 'I', 'Q', '_', 1, 16, 0x00, 0x24, 0xF4, 0, 0, 0, 0, 0, 3, 0, 0, 0, 0, 0, 0, 0, 'a', 'b', 'c', 0x28};
+  struct rffft_ziq ziq;
+  FILE * file;
+
+  file = tmpfile();
+  fwrite(header, 1, sizeof(header), file);
+  rewind(file);
+  assert_int_equal(0, rffft_ziq_header(file, &ziq));
+  assert_int_equal('i', ziq.format);
+  assert_int_equal(1, ziq.compressed);
+  assert_float_equal(16e6, ziq.samp_rate, 1e-12);
+  assert_int_equal(25, ziq.offset);
+  assert_int_equal(0x28, fgetc(file));
+  fclose(file);
+
+  // 12 bit samples are not supported
+  file = tmpfile();
+  fwrite(header, 1, sizeof(header), file);
+  fseek(file, 5, SEEK_SET);
+  fputc(12, file);
+  rewind(file);
+  assert_int_equal(-1, rffft_ziq_header(file, &ziq));
+  fclose(file);
+}
+
+// Test publishing to and reading from a shared memory ring
+void rffft_internal_shm_ring(void **state) {
+  struct rffft_shm pub, sub;
+  char header[256], buf[512];
+  float z[4];
+  const struct rffft_shm_slot * slot;
+  int i;
+
+  assert_int_equal(0, rffft_shm_create(&pub, "/rffft_test", 2, sizeof(z)));
+  assert_int_equal(0, rffft_shm_attach(&sub, "/rffft_test"));
+  assert_int_equal(0, rffft_shm_count(&sub));
+  assert_int_equal(0, rffft_shm_read(&sub, 0, buf, sizeof(buf)));
+
+  // Publish three subints into two slots
+  memset(header, 0, sizeof(header));
+  for (i = 0; i < 3; i++) {
+    sprintf(header, "HEADER\nSUBINT %d\nEND\n", i);
+    z[0] = z[1] = z[2] = z[3] = (float) i;
+    rffft_shm_publish(&pub, header, z, sizeof(z));
+  }
+  assert_int_equal(3, rffft_shm_count(&sub));
+
+  // The first subint was overwritten, the last one can be read
+  assert_int_equal(-1, rffft_shm_read(&sub, 0, buf, sizeof(buf)));
+  assert_int_equal(256 + sizeof(z), rffft_shm_read(&sub, 2, buf, sizeof(buf)));
+  assert_string_equal("HEADER\nSUBINT 2\nEND\n", buf);
+  memcpy(z, buf + 256, sizeof(z));
+  assert_float_equal(2.0, z[3], 0.0);
+  assert_int_equal(0, rffft_shm_read(&sub, 3, buf, sizeof(buf)));
+
+  // In place
+  slot = rffft_shm_slot(&sub, 1);
+  assert_string_equal("HEADER\nSUBINT 1\nEND\n", slot->data);
+  assert_true(rffft_shm_valid(&sub, 1));
+
+  rffft_shm_close(&sub);
+  rffft_shm_close(&pub);
+  assert_int_equal(-1, rffft_shm_attach(&sub, "/rffft_test"));
+}
+
+// Test the statistics lines of the header of a realtime subint with
+// impulse blanking, which do not all fit
+void rffft_internal_header_stats(void **state) {
+  const char stats[] =
+    "BLANKED      0.000125\n"
+    "DRIFT        -0.001250 s\n"
+    "GAPS         1 0.250000 s\n"
+    "BEHIND       3\n";
+  char header[512], nfd[32];
+  double freq, bw;
+  float length;
+  int nchan, nsub;
+
+  // All lines fit at a low frequency
+  sprintf(header, "HEADER\nUTC_START    2024-01-01T00:00:00.000\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\n", 1e6, 2e4, 1.0, 20, 10);
+  assert_int_equal(4, rffft_header_stats(header, stats));
+  assert_true(strlen(header) < 256);
+  assert_non_null(strstr(header, "BEHIND       3\nEND\n"));
+
+  // Lines are dropped from the end at a high frequency and rate
+  sprintf(header, "HEADER\nUTC_START    2024-01-01T00:00:00.000\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\n", 2274e6, 16e6, 1.0, 40000, 60);
+  assert_int_equal(3, rffft_header_stats(header, stats));
+  assert_true(strlen(header) < 256);
+  assert_non_null(strstr(header, "\nNSUB         60\nBLANKED      0.000125\nDRIFT        -0.001250 s\nGAPS         1 0.250000 s\nEND\n"));
+
+  // With load shedding, the integration time goes before the clock
+  sprintf(header, "HEADER\nUTC_START    2024-01-01T00:00:00.000\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\n", 2274e6, 16e6, 1.0, 40000, 60);
+  assert_int_equal(3, rffft_header_stats(header, "BLANKED      0.000125\nINTEG        0.998000 s\nDRIFT        -0.001250 s\nGAPS         1 0.250000 s\nBEHIND       3\n"));
+  assert_non_null(strstr(header, "\nNSUB         60\nBLANKED      0.000125\nINTEG        0.998000 s\nDRIFT        -0.001250 s\nEND\n"));
+
+  // The fixed keywords still parse
+  assert_int_equal(6, sscanf(header, "HEADER\nUTC_START    %s\nFREQ         %lf Hz\nBW           %lf Hz\nLENGTH       %f s\nNCHAN        %d\nNSUB         %d\n", nfd, &freq, &bw, &length, &nchan, &nsub));
+  assert_int_equal(40000, nchan);
+  assert_int_equal(60, nsub);
+}
+
+// Test SigMF metadata, with two segments of which the second jumps in time
+void rffft_internal_sigmf(void **state) {
+  const char meta[] =
+    "{\"global\": {\"core:datatype\": \"ci16_le\", \"core:sample_rate\": 1000,\n"
+    "  \"core:description\": \"a \\\"quoted\\\" [text]\", \"core:extensions\": [{\"name\": \"x\", \"optional\": true}]},\n"
+    " \"captures\": [{\"core:sample_start\": 0, \"core:header_bytes\": 16, \"core:frequency\": 1.0e8, \"core:datetime\": \"2024-01-01T00:00:00.5Z\"},\n"
+    "  {\"core:sample_start\": 2000, \"core:header_bytes\": 8, \"core:datetime\": \"2024-01-01T00:01:00Z\"}],\n"
+    " \"annotations\": [{\"core:sample_start\": 2500, \"core:sample_count\": 100, \"core:label\": \"burst\", \"core:freq_lower_edge\": 99.9e6}]}";
+  struct rffft_sigmf sigmf;
+  double t;
+  FILE * file;
+
+  file = tmpfile();
+  fputs(meta, file);
+  rewind(file);
+  assert_int_equal(0, rffft_sigmf_meta(file, &sigmf));
+  fclose(file);
+  assert_int_equal('i', sigmf.format);
+  assert_float_equal(1000, sigmf.samp_rate, 1e-12);
+  assert_int_equal(2, sigmf.ncapture);
+  assert_int_equal(1, sigmf.gaps);
+  assert_float_equal(1e8, sigmf.capture[0].frequency, 1e-6);
+  assert_int_equal(1, sigmf.nannotation);
+  assert_string_equal("burst", sigmf.annotation[0].label);
+  assert_int_equal(2500, sigmf.annotation[0].sample_start);
+  assert_int_equal(100, sigmf.annotation[0].sample_count);
+  assert_float_equal(99.9e6, sigmf.annotation[0].freq_lower, 1e-6);
+
+  // Samples follow the header bytes of their segment
+  assert_int_equal(0, rffft_sigmf_segment(&sigmf, 1999));
+  assert_int_equal(1, rffft_sigmf_segment(&sigmf, 2000));
+  assert_int_equal(16, rffft_sigmf_offset(&sigmf, 0));
+  assert_int_equal(16 + 1999 * 4, rffft_sigmf_offset(&sigmf, 1999));
+  assert_int_equal(24 + 2000 * 4, rffft_sigmf_offset(&sigmf, 2000));
+
+  // 2024-01-01 is 19723 days after 1970-01-01
+  assert_int_equal(0, rffft_datetime("2024-01-01T00:00:00.5Z", &t));
+  assert_float_equal(19723 * 86400.0 + 0.5, t, 1e-6);
+  assert_float_equal(t + 1.0, rffft_sigmf_time(&sigmf, 1000), 1e-6);
+  assert_float_equal(t + 60.0, rffft_sigmf_time(&sigmf, 2500), 1e-6);
+
+  // Times between the segments map to the start of the second
+  assert_int_equal(1000, rffft_sigmf_sample(&sigmf, t + 1.0));
+  assert_int_equal(2000, rffft_sigmf_sample(&sigmf, t + 30.0));
+  assert_int_equal(2500, rffft_sigmf_sample(&sigmf, t + 60.0));
+  assert_int_equal(0, rffft_sigmf_sample(&sigmf, t - 1.0));
+  rffft_sigmf_free(&sigmf);
+
+  // Real valued and big endian samples are not supported
+  file = tmpfile();
+  fputs("{\"global\": {\"core:datatype\": \"ri16_le\", \"core:sample_rate\": 1000}}", file);
+  rewind(file);
+  assert_int_equal(-1, rffft_sigmf_meta(file, &sigmf));
+  fclose(file);
+
+  // Invalid JSON
+  file = tmpfile();
+  fputs("{\"global\": {\"core:datatype\": \"ci16_le\", \"core:sample_rate\": 1000}", file);
+  rewind(file);
+  assert_int_equal(-1, rffft_sigmf_meta(file, &sigmf));
+  fclose(file);
+}
+
+// Test the jitter buffer of sequenced UDP input over loopback
+void rffft_internal_net_udp(void **state) {
+  struct rffft_net n;
+  struct sockaddr_in addr;
+  const int order[] = {0, 1, 3, 2, 5, 8};
+  unsigned char packet[8 + 16];
+  int16_t x[64];
+  int i, j, fd, m;
+
+  // 8 samples of 2 bytes per datagram, a jitter buffer of 2 datagrams
+  assert_int_equal(0, rffft_net_open(&n, "udp://127.0.0.1:0?seq", 2, 0.0, 1000.0, 0.016));
+  assert_true(n.port > 0);
+
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(n.port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (i = 0; i < 6; i++) {
+    memset(packet, 0, sizeof(packet));
+    packet[0] = order[i];
+    for (j = 0; j < 8; j++) {
+      x[j] = order[i] * 8 + j + 1;
+      memcpy(packet + 8 + 2 * j, &x[j], 2);
+    }
+    sendto(fd, packet, sizeof(packet), 0, (struct sockaddr *) &addr, sizeof(addr));
+  }
+  close(fd);
+
+  // Datagrams 0 to 6 are committed, 4 and 6 given up as 8 arrived
+  for (m = 0; m < 56; m += rffft_net_read(&n, x + m, 56 - m));
+  for (i = 0; i < 7; i++) {
+    for (j = 0; j < 8; j++)
+      assert_int_equal((i == 4 || i == 6) ? 0 : i * 8 + j + 1, x[i * 8 + j]);
+  }
+  assert_int_equal(2, n.nlost);
+  assert_int_equal(1, n.nreorder);
+  assert_int_equal(6, n.npacket);
+
+  // Closing flushes the datagram still waiting for 7
+  rffft_net_close(&n);
+  assert_int_equal(3, n.nlost);
+}
+
+// Zero samples, nsamp in total
+struct tee_source {
+  long nsamp;
+};
+
+static int tee_source_read(void *input, void *buffer, int nsamp) {
+  struct tee_source * src = (struct tee_source *) input;
+
+  if (nsamp > src->nsamp)
+    nsamp = (int) src->nsamp;
+  memset(buffer, 0, (size_t) nsamp * 2);
+  src->nsamp -= nsamp;
+
+  return nsamp;
+}
+
+static void tee_count(void *output, struct rffft_subint *s) {
+  *(int *) output += s->nframe;
+}
+
+static void *tee_run(void *arg) {
+  struct rffft_pipeline * p = (struct rffft_pipeline *) arg;
+
+  rffft_pipeline_run(p);
+  rffft_tee_close(p->input);
+
+  return NULL;
+}
+
+// Test a tee feeding two pipelines, of which the first stops after two
+// subints, as with a time window, long before the input ends
+void rffft_internal_tee_window(void **state) {
+  struct tee_source src = { 8 * 1048576 };
+  struct rffft_tee tee;
+  struct rffft_pipeline p[2];
+  pthread_t thread[2];
+  float zw[64];
+  int i, nframe[2] = { 0, 0 };
+
+  for (i = 0; i < 64; i++)
+    zw[i] = 1.0;
+  assert_int_equal(0, rffft_tee_start(&tee, 2, rffft_sample_size('c'), tee_source_read, &src));
+  for (i = 0; i < 2; i++) {
+    memset(&p[i], 0, sizeof(p[i]));
+    p[i].nchan = 64;
+    p[i].nint = 1024;
+    p[i].nuse = 1;
+    p[i].nbatch = 1;
+    p[i].informat = 'c';
+    p[i].sign = 1;
+    p[i].ntap = 1;
+    p[i].zw = zw;
+    p[i].nsubmax = (i == 0) ? 2 : 0;
+    p[i].read = rffft_tee_read;
+    p[i].input = &tee.reader[i];
+    p[i].write = tee_count;
+    p[i].output = &nframe[i];
+    assert_int_equal(0, pthread_create(&thread[i], NULL, tee_run, &p[i]));
+  }
+  for (i = 0; i < 2; i++)
+    pthread_join(thread[i], NULL);
+  rffft_tee_finish(&tee);
+
+  // The second pipeline transformed every sample
+  assert_int_equal(2 * 1024, nframe[0]);
+  assert_int_equal(8 * 16384, nframe[1]);
+}
+
 // Entry point to run all tests
 int run_rffft_internal_tests() {
   const struct CMUnitTest tests[] = {
     cmocka_unit_test(rffft_internal_parse_satdump_filenames),
     cmocka_unit_test(rffft_internal_parse_gqrx_filenames),
     cmocka_unit_test(rffft_internal_parse_sdrconsole_filenames),
+    cmocka_unit_test(rffft_internal_unpack_and_accumulate),
+    cmocka_unit_test(rffft_internal_unpack_simd),
+    cmocka_unit_test(rffft_internal_pfb),
+    cmocka_unit_test(rffft_internal_blank),
+    cmocka_unit_test(rffft_internal_ddc),
+    cmocka_unit_test(rffft_internal_wav_header),
+    cmocka_unit_test(rffft_internal_header_stats),
+    cmocka_unit_test(rffft_internal_sigmf),
+    cmocka_unit_test(rffft_internal_ziq_header),
+    cmocka_unit_test(rffft_internal_shm_ring),
+    cmocka_unit_test(rffft_internal_net_udp),
+    cmocka_unit_test(rffft_internal_tee_window),
   };
 
   return cmocka_run_group_tests_name("rffft internal", tests, NULL, NULL);
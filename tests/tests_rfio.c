@@ -0,0 +1,232 @@
+#include "tests_rfio.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <cmocka.h>
+
+#include "../rfio.h"
+#include "../rftime.h"
+
+// Write nfile files of three subints of four channels, one per second,
+// each channel holding the number of the subint
+static void write_series(char * prefix, int nfile) {
+  char filename[96], header[256];
+  float z[4];
+  int i, j;
+  FILE * file;
+
+  for (i = 0; i < nfile; i++) {
+    sprintf(filename, "%s_%06d.bin", prefix, i);
+    file = fopen(filename, "w");
+    for (j = 0; j < 3; j++) {
+      memset(header, 0, sizeof(header));
+      sprintf(header, "HEADER\nUTC_START    2024-01-01T00:00:%02d.000\nFREQ         100000000.000000 Hz\nBW           2000000.000000 Hz\nLENGTH       1.000000 s\nNCHAN        4\nNSUB         3\nEND\n", 3 * i + j);
+      z[0] = z[1] = z[2] = z[3] = 3 * i + j;
+      fwrite(header, 1, sizeof(header), file);
+      fwrite(z, sizeof(float), 4, file);
+    }
+    fclose(file);
+  }
+}
+
+// Test indexing a series of two files of three subints, and reading a
+// time range of it through the index
+void rfio_index(void **state) {
+  char dir[] = "/tmp/tests_rfioXXXXXX", prefix[64], filename[96];
+  int i, isub, jsub, stride;
+  struct spectrogram s;
+
+  assert_non_null(mkdtemp(dir));
+  sprintf(prefix, "%s/test", dir);
+  write_series(prefix, 2);
+
+  // Without an index
+  assert_int_equal(-1, find_index(prefix, nfd2mjd("2024-01-01T00:00:02.5"), 0.0, &isub, &jsub));
+
+  assert_int_equal(6, build_index(prefix, 0));
+
+  // Subints 2 to 4
+  assert_int_equal(3, find_index(prefix, nfd2mjd("2024-01-01T00:00:02.5"), nfd2mjd("2024-01-01T00:00:04.5"), &isub, &jsub));
+  assert_int_equal(0, isub);
+  assert_int_equal(2, jsub);
+
+  // Subint 4 to the end
+  assert_int_equal(2, find_index(prefix, nfd2mjd("2024-01-01T00:00:04.0"), 0.0, &isub, &jsub));
+  assert_int_equal(1, isub);
+  assert_int_equal(1, jsub);
+
+  // After the end
+  assert_int_equal(0, find_index(prefix, nfd2mjd("2024-01-01T00:01:00.0"), 0.0, &isub, &jsub));
+
+  // Mapped in place, the subints of the second file spaced by their headers
+  s = read_spectrogram_mjd(prefix, nfd2mjd("2024-01-01T00:00:02.5"), nfd2mjd("2024-01-01T00:00:04.5"), 0, 0.0, 0.0, 1, 0.0);
+  assert_int_equal(3, s.nsub);
+  assert_int_equal(2, s.nmap);
+  assert_int_equal(0, s.isub);
+  assert_int_equal(2, s.jsub);
+  assert_string_equal("2024-01-01T00:00:02.000", s.nfd0);
+  for (i = 0; i < 3; i++)
+    assert_float_equal(2 + i, SPEC_Z(s, i, 3), 0.0);
+  assert_int_equal(2, spectrogram_block(s, 1, &stride));
+  assert_int_equal(4 + 64, stride);
+  free_spectrogram(s);
+
+  // Copied
+  s = read_spectrogram_mjd(prefix, nfd2mjd("2024-01-01T00:00:02.5"), nfd2mjd("2024-01-01T00:00:04.5"), 0, 0.0, 0.0, 3, 0.0);
+  assert_int_equal(1, s.nsub);
+  assert_int_equal(0, s.nmap);
+  assert_float_equal(3.0, SPEC_Z(s, 0, 0), 1e-6);
+  assert_int_equal(1, spectrogram_block(s, 0, &stride));
+  free_spectrogram(s);
+
+  // After the end, empty
+  s = read_spectrogram_mjd(prefix, nfd2mjd("2024-01-01T00:01:00.0"), 0.0, 0, 0.0, 0.0, 1, 0.0);
+  assert_int_equal(0, s.nsub);
+  assert_null(s.mjd);
+
+  for (i = 0; i < 2; i++) {
+    sprintf(filename, "%s_%06d.bin", prefix, i);
+    unlink(filename);
+  }
+  sprintf(filename, "%s.idx", prefix);
+  unlink(filename);
+  rmdir(dir);
+}
+
+// Test falling back to copying a series whose second file has more
+// channels than the first, which can not be mapped
+void rfio_mixed(void **state) {
+  char dir[] = "/tmp/tests_rfioXXXXXX", prefix[64], filename[96], header[256];
+  float z[8];
+  int i, j, stride;
+  struct spectrogram s;
+  FILE * file;
+
+  assert_non_null(mkdtemp(dir));
+  sprintf(prefix, "%s/test", dir);
+  for (i = 0; i < 2; i++) {
+    sprintf(filename, "%s_%06d.bin", prefix, i);
+    file = fopen(filename, "w");
+    for (j = 0; j < 3; j++) {
+      memset(header, 0, sizeof(header));
+      sprintf(header, "HEADER\nUTC_START    2024-01-01T00:00:%02d.000\nFREQ         100000000.000000 Hz\nBW           2000000.000000 Hz\nLENGTH       1.000000 s\nNCHAN        %d\nNSUB         3\nEND\n", 3 * i + j, 4 + 4 * i);
+      z[0] = z[1] = z[2] = z[3] = z[4] = z[5] = z[6] = z[7] = 3 * i + j;
+      fwrite(header, 1, sizeof(header), file);
+      fwrite(z, sizeof(float), 4 + 4 * i, file);
+    }
+    fclose(file);
+  }
+
+  s = read_spectrogram(prefix, 0, 4, 0.0, 0.0, 1, 0.0);
+  assert_int_equal(4, s.nsub);
+  assert_int_equal(0, s.nmap);
+  assert_null(s.map);
+  assert_null(s.mapsize);
+  for (i = 0; i < 3; i++)
+    assert_float_equal(i, SPEC_Z(s, i, 0), 0.0);
+  assert_int_equal(4, spectrogram_block(s, 0, &stride));
+  assert_int_equal(4, stride);
+  free_spectrogram(s);
+
+  for (i = 0; i < 2; i++) {
+    sprintf(filename, "%s_%06d.bin", prefix, i);
+    unlink(filename);
+  }
+  rmdir(dir);
+}
+
+// Test streaming a series of three files in blocks, across the files
+void rfio_stream(void **state) {
+  char dir[] = "/tmp/tests_rfioXXXXXX", prefix[64], filename[96];
+  int i;
+  struct spectrogram_stream r;
+
+  assert_non_null(mkdtemp(dir));
+  sprintf(prefix, "%s/test", dir);
+  write_series(prefix, 3);
+
+  // All subints, binned by two in blocks of two, dropping the last subint
+  assert_int_equal(0, open_spectrogram_stream(&r, prefix, 0, 0, 2, 0.0, 0.0, 2, 0.0));
+  assert_int_equal(2, read_spectrogram_stream(&r));
+  assert_string_equal("2024-01-01T00:00:00.000", r.s.nfd0);
+  assert_float_equal(0.5, SPEC_Z(r.s, 0, 0), 1e-6);
+  assert_float_equal(2.5, SPEC_Z(r.s, 1, 3), 1e-6);
+  assert_float_equal(2.0, r.s.length[1], 1e-6);
+  assert_int_equal(2, read_spectrogram_stream(&r));
+  assert_int_equal(1, r.s.isub);
+  assert_float_equal(4.5, SPEC_Z(r.s, 0, 0), 1e-6);
+  assert_float_equal(6.5, SPEC_Z(r.s, 1, 0), 1e-6);
+  assert_int_equal(0, read_spectrogram_stream(&r));
+  assert_int_equal(0, read_spectrogram_stream(&r));
+  close_spectrogram_stream(&r);
+
+  // Four subints from the second file, zoomed to the upper two channels
+  assert_int_equal(0, open_spectrogram_stream(&r, prefix, 1, 4, 3, 100.5e6, 1e6, 1, 0.0));
+  assert_int_equal(2, r.s.nchan);
+  assert_int_equal(3, read_spectrogram_stream(&r));
+  for (i = 0; i < 3; i++)
+    assert_float_equal(3 + i, SPEC_Z(r.s, i, 1), 0.0);
+  assert_int_equal(1, read_spectrogram_stream(&r));
+  assert_float_equal(6.0, SPEC_Z(r.s, 0, 0), 0.0);
+  assert_int_equal(0, read_spectrogram_stream(&r));
+  close_spectrogram_stream(&r);
+
+  // Missing series
+  sprintf(filename, "%s/none", dir);
+  assert_int_equal(-1, open_spectrogram_stream(&r, filename, 0, 0, 2, 0.0, 0.0, 1, 0.0));
+  close_spectrogram_stream(&r);
+
+  for (i = 0; i < 3; i++) {
+    sprintf(filename, "%s_%06d.bin", prefix, i);
+    unlink(filename);
+  }
+  rmdir(dir);
+}
+
+// Test loading a binned series on one and on several threads, with bins
+// spanning two files and a partial bin at the end of the data
+void rfio_threads(void **state) {
+  char dir[] = "/tmp/tests_rfioXXXXXX", prefix[64], filename[96];
+  int i, k;
+  struct spectrogram s;
+
+  assert_non_null(mkdtemp(dir));
+  sprintf(prefix, "%s/test", dir);
+  write_series(prefix, 3);
+
+  for (k = 1; k <= 3; k++) {
+    set_spectrogram_threads(k);
+    s = read_spectrogram(prefix, 0, 12, 0.0, 0.0, 2, 0.0);
+    assert_int_equal(6, s.nsub);
+    for (i = 0; i < 4; i++)
+      assert_float_equal(2 * i + 0.5, SPEC_Z(s, i, 2), 1e-6);
+    assert_float_equal(8.0, SPEC_Z(s, 4, 0), 0.0);
+    assert_float_equal(1.0, s.length[4], 0.0);
+    assert_float_equal(0.0, SPEC_Z(s, 5, 0), 0.0);
+    assert_float_equal(0.0, s.mjd[5], 0.0);
+    free_spectrogram(s);
+  }
+  set_spectrogram_threads(0);
+
+  for (i = 0; i < 3; i++) {
+    sprintf(filename, "%s_%06d.bin", prefix, i);
+    unlink(filename);
+  }
+  rmdir(dir);
+}
+
+int run_rfio_tests() {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(rfio_index),
+    cmocka_unit_test(rfio_mixed),
+    cmocka_unit_test(rfio_stream),
+    cmocka_unit_test(rfio_threads),
+  };
+
+  return cmocka_run_group_tests_name("rfio", tests, NULL, NULL);
+}
@@ -0,0 +1,14 @@
+#ifndef _TESTS_RFIO_H
+#define _TESTS_RFIO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int run_rfio_tests();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TESTS_RFIO_H */
@@ -25,7 +25,7 @@ void zsc_sample(struct spectrogram *image, int maxpix, double *samples, int *nsa
                 *nsamples = count;
                 return;
             }
-            samples[count++] = image->z[i * nl + j];
+            samples[count++] = SPEC_Z(*image, j, i);
         }
     }
     *nsamples = count;